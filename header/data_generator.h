@@ -14,6 +14,7 @@
 #include <unordered_map>
 #include <valarray>
 
+#include "dictionary.h"
 #include "helper_functions.h"
 
 #define ROW_SIZE 67108864
@@ -104,8 +105,12 @@ public:
     return table;
   }
 
+  /// Reads a table and replaces each value by its code in the dictionary of its column. Tables
+  /// that are joined later must share the dictionaries of the joined columns.
   template <typename OutputSchema, typename InputSchema>
-  static vector<OutputSchema> readFromFileToInt(std::string file_path, size_t table_size) {
+  static vector<OutputSchema>
+  readFromFileToInt(std::string file_path, size_t table_size,
+                    array<Dictionary<string>*, sizeof...(ColumnTypes)> const& dictionaries) {
     std::vector<InputSchema> table;
     vector<OutputSchema> tableInt;
     if(!fileExists(file_path)) {
@@ -136,24 +141,12 @@ public:
       }
     }
 
-    vector<unordered_map<string, int>> dictionaries;
-    for(auto i = 0; i < sizeof...(ColumnTypes); i++) {
-      auto umap = unordered_map<string, int>();
-      dictionaries.emplace_back(umap);
-    }
-    for(auto i = 0; i < table.size(); i++) {
+    for(auto const& row : table) {
       vector<int> rowInt;
       auto j = 0;
-      for_each(table[i], [&](auto const& e) {
-        auto value = 0;
-        try {
-          value = (dictionaries[j]).at(toString(e));
-        } catch(...) {
-          (dictionaries[j]).insert(make_pair(toString(e), i));
-          value = i;
-        }
+      for_each(row, [&](auto const& e) {
+        rowInt.emplace_back(dictionaries[j]->encode(toString(e)));
         j++;
-        rowInt.emplace_back(value);
       });
       tableInt.emplace_back(vectorToTuple<tuple_size_v<OutputSchema>, int, OutputSchema>(rowInt));
     }
@@ -161,6 +154,16 @@ public:
     return tableInt;
   }
 
+  template <typename OutputSchema, typename InputSchema>
+  static vector<OutputSchema> readFromFileToInt(std::string file_path, size_t table_size) {
+    array<Dictionary<string>, sizeof...(ColumnTypes)> ownDictionaries;
+    array<Dictionary<string>*, sizeof...(ColumnTypes)> dictionaries;
+    for(auto i = 0; i < sizeof...(ColumnTypes); i++) {
+      dictionaries[i] = &ownDictionaries[i];
+    }
+    return readFromFileToInt<OutputSchema, InputSchema>(file_path, table_size, dictionaries);
+  }
+
   template <typename Schema = std::tuple<ColumnTypes...>>
   static std::vector<Schema> generateIntegerTuples(const std::string distribution = "random",
                                                    const size_t rows = ROW_SIZE) {
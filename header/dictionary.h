@@ -0,0 +1,75 @@
+#ifndef _DICTIONARY_H_
+#define _DICTIONARY_H_
+
+#include <cstddef>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/// Dense integer codes for the values of one attribute. Relations that join on an attribute
+/// encode it with the same dictionary, so that equal values get equal codes in all of them and
+/// the join can run on the codes. Codes are assigned in order of first appearance starting at 1;
+/// the default value keeps code 0, which the indices treat as the empty key.
+template <typename Value> class Dictionary {
+public:
+  typedef int Code;
+
+private:
+  vector<Value> values;
+  unordered_map<Value, int> codes;
+
+public:
+  Code encode(Value const& value) {
+    if(value == Value()) {
+      return 0;
+    }
+    auto const inserted = codes.try_emplace(value, values.size() + 1);
+    if(inserted.second) {
+      values.push_back(value);
+    }
+    return inserted.first->second;
+  }
+
+  /// Code of a value that was encoded before, or 0 if it never was.
+  Code find(Value const& value) const {
+    auto const code = codes.find(value);
+    return code == codes.end() ? 0 : code->second;
+  }
+
+  Value decode(Code code) const { return code == 0 ? Value() : values[code - 1]; }
+
+  size_t size() const { return values.size(); }
+};
+
+/// Replaces every value of rows by its code in the dictionary of its column. Columns that are
+/// joined with each other must be given the same dictionary.
+template <typename... Values>
+vector<tuple<typename Dictionary<Values>::Code...>>
+encodeRows(vector<tuple<Values...>> const& rows, Dictionary<Values>&... dictionaries) {
+  vector<tuple<typename Dictionary<Values>::Code...>> encoded;
+  encoded.reserve(rows.size());
+  for(auto const& row : rows) {
+    encoded.push_back(apply(
+        [&](auto const&... values) { return make_tuple(dictionaries.encode(values)...); }, row));
+  }
+  return encoded;
+}
+
+/// Turns rows of codes, such as the output of a join on encoded relations, back into values.
+template <typename... Codes, typename... Values>
+vector<tuple<Values...>> decodeRows(vector<tuple<Codes...>> const& rows,
+                                    Dictionary<Values> const&... dictionaries) {
+  static_assert(sizeof...(Codes) == sizeof...(Values), "One dictionary per column");
+  vector<tuple<Values...>> decoded;
+  decoded.reserve(rows.size());
+  for(auto const& row : rows) {
+    decoded.push_back(apply(
+        [&](auto const&... codes) { return make_tuple(dictionaries.decode(codes)...); }, row));
+  }
+  return decoded;
+}
+
+#endif
@@ -10,13 +10,53 @@ using namespace std;
 
 namespace {
 
+/// Calls visit on every tuple of the index that agrees with t on its first prefixLength
+/// attributes, or on every tuple for an empty prefix. Indices that can stream their matches do
+/// so instead of materialising them, and indices that scan in parallel hand over the buffers of
+/// their threads as they are.
+template <typename Tuple, typename WrappedIndex, typename Visit>
+void forEachTupleByPrefix(WrappedIndex const& wrappedIndex, Tuple const& t,
+                          size_t const prefixLength, Visit&& visit) {
+  if(prefixLength == 0) {
+    if constexpr(SupportsPartitionedScan<WrappedIndex, Tuple>::value) {
+      for(auto const& partition : wrappedIndex.scanIndexPartitioned(t)) {
+        for(auto const& tupleFromIndex : partition) {
+          visit(tupleFromIndex);
+        }
+      }
+    } else {
+      for(auto const& tupleFromIndex : wrappedIndex.scanIndex(t)) {
+        visit(tupleFromIndex);
+      }
+    }
+  } else if constexpr(SupportsPrefixStreaming<WrappedIndex, Tuple>::value) {
+    wrappedIndex.forEachByPrefixAndScatterIntoTuple(t, prefixLength, visit);
+  } else {
+    for(auto const& tupleFromIndex :
+        wrappedIndex.lookupByPrefixAndScatterIntoTuple(t, prefixLength)) {
+      visit(tupleFromIndex);
+    }
+  }
+}
+
+/// Tuples of the index that agree with t on its first prefixLength attributes, as weighed by the
+/// join plan. Indices with prefix sketches estimate it; the others count exactly.
+template <typename Tuple, typename WrappedIndex>
+double plannedPrefixCount(WrappedIndex const& wrappedIndex, Tuple const& t,
+                          size_t const prefixLength) {
+  if constexpr(SupportsPrefixEstimates<WrappedIndex, Tuple>::value) {
+    return wrappedIndex.estimatePrefix(t, prefixLength);
+  } else {
+    return wrappedIndex.countPrefix(t, prefixLength);
+  }
+}
+
 template <typename Tuple, typename RelationSet>
 vector<Tuple> genericJoin(Hypergraph const& H, RelationSet const& R,
                           vector<double> const& fractional_cover, Tuple const& prefixTuple) {
   vector<Tuple> Q;
 
   if(H.V.size() == 1) {
-    vector<Tuple> resultFromRelation;
     bool scannedRelation = false;
 
     for(auto i = 0; i < H.E.size(); i++) {
@@ -25,34 +65,29 @@ vector<Tuple> genericJoin(Hypergraph const& H, RelationSet const& R,
         for_each(R, [&](auto const& r) {
           if((r.label == H.E[i].label) && !scannedRelation) {
             auto prefixLength = findPrefixLength(r.attributesInTotalOrder, prefixTuple);
-            if(prefixLength) {
-              resultFromRelation =
-                  r.wrappedIndex.lookupByPrefixAndScatterIntoTuple(prefixTuple, prefixLength);
-            } else {
-              resultFromRelation = r.wrappedIndex.scanIndex(prefixTuple);
-            }
             scannedRelation = true;
 
-            for(auto tupleFromRelation : resultFromRelation) {
-              auto found = true;
-              for(auto j = i + 1; j < H.E.size(); j++) {
-                if(find(H.E[j].attribute_ids.begin(), H.E[j].attribute_ids.end(), H.V[0]) !=
-                   H.E[j].attribute_ids.end()) {
-                  for_each(R, [&](auto const& nextRel) {
-                    if(H.E[j].label == nextRel.label) {
-                      if(nextRel.wrappedIndex.countPrefix(
-                             tupleFromRelation, findPrefixLength(nextRel.attributesInTotalOrder,
-                                                                 tupleFromRelation)) == 0) {
-                        found = false;
-                      }
+            forEachTupleByPrefix(
+                r.wrappedIndex, prefixTuple, prefixLength, [&](Tuple const& tupleFromRelation) {
+                  auto found = true;
+                  for(auto j = i + 1; j < H.E.size(); j++) {
+                    if(find(H.E[j].attribute_ids.begin(), H.E[j].attribute_ids.end(), H.V[0]) !=
+                       H.E[j].attribute_ids.end()) {
+                      for_each(R, [&](auto const& nextRel) {
+                        if(H.E[j].label == nextRel.label) {
+                          if(nextRel.wrappedIndex.countPrefix(
+                                 tupleFromRelation, findPrefixLength(nextRel.attributesInTotalOrder,
+                                                                     tupleFromRelation)) == 0) {
+                            found = false;
+                          }
+                        }
+                      });
                     }
-                  });
-                }
-              }
-              if(found) {
-                Q.emplace_back(tupleFromRelation);
-              }
-            }
+                  }
+                  if(found) {
+                    Q.emplace_back(tupleFromRelation);
+                  }
+                });
           }
         });
         if(scannedRelation) {
@@ -106,9 +141,9 @@ vector<Tuple> genericJoin(Hypergraph const& H, RelationSet const& R,
         for(auto i = 0; i < E2.size(); i++) {
           for_each(R, [&](auto const& r_e) {
             if(r_e.label == E2[i].label) {
-              pi *= pow(
-                  r_e.wrappedIndex.countPrefix(t, findPrefixLength(r_e.attributesInTotalOrder, t)),
-                  Y2[i]);
+              pi *= pow(plannedPrefixCount(r_e.wrappedIndex, t,
+                                           findPrefixLength(r_e.attributesInTotalOrder, t)),
+                        Y2[i]);
             }
           });
         }
@@ -125,14 +160,8 @@ vector<Tuple> genericJoin(Hypergraph const& H, RelationSet const& R,
           }
         } else {
           auto f_prefixLength = findPrefixLength(r_f.attributesInTotalOrder, t);
-          vector<Tuple> R_f_tuples;
 
-          if(f_prefixLength > 0) {
-            R_f_tuples = r_f.wrappedIndex.lookupByPrefixAndScatterIntoTuple(t, f_prefixLength);
-          } else {
-            R_f_tuples = r_f.wrappedIndex.scanIndex(t);
-          }
-          for(auto t_prime : R_f_tuples) {
+          forEachTupleByPrefix(r_f.wrappedIndex, t, f_prefixLength, [&](Tuple const& t_prime) {
             auto found = true;
             for(auto e : E2) {
               for_each(R, [&](auto const& r_e) {
@@ -147,7 +176,7 @@ vector<Tuple> genericJoin(Hypergraph const& H, RelationSet const& R,
             if(found) {
               Q.emplace_back(t_prime);
             }
-          }
+          });
         }
       }
     });
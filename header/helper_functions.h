@@ -60,6 +60,8 @@ template <typename Tuple> size_t CRCHash<Tuple>::operator()(Tuple const& key) co
 template <typename KeyType> struct DefaultValue { KeyType operator()() const; };
 template <> inline int DefaultValue<int>::operator()() const { return 0; }
 template <> inline long DefaultValue<long>::operator()() const { return 0; }
+template <> inline unsigned int DefaultValue<unsigned int>::operator()() const { return 0; }
+template <> inline unsigned long DefaultValue<unsigned long>::operator()() const { return 0; }
 template <> inline string DefaultValue<string>::operator()() const { return ""; }
 
 template <typename KeyType> struct MaxValue { KeyType operator()() const; };
@@ -67,6 +67,26 @@ public:
     return result;
   }
 
+  /// Tuples starting with the prefix whose next column lies in [low, high], in order.
+  template <typename... PrefixColumns, typename RangeKey>
+  std::vector<std::tuple<ColumnTypes...>>
+  prefixRangeLookup(std::tuple<PrefixColumns...> const& prefix_tuple, RangeKey const& low,
+                    RangeKey const& high) const {
+    std::vector<std::tuple<ColumnTypes...>> result;
+    auto const bounds = rangeBounds(prefix_tuple, low, high);
+    for(auto it = bounds.first; it != bounds.second; it++) {
+      result.emplace_back(*it);
+    }
+    return result;
+  }
+
+  template <typename... PrefixColumns, typename RangeKey>
+  size_t prefixRangeCount(std::tuple<PrefixColumns...> const& prefix_tuple, RangeKey const& low,
+                          RangeKey const& high) const {
+    auto const bounds = rangeBounds(prefix_tuple, low, high);
+    return std::distance(bounds.first, bounds.second);
+  }
+
   size_t getSize() const { return size; }
 
   auto scan() const {
@@ -94,6 +114,16 @@ private:
     tie(get<I>(result)...) = t;
     return result;
   }
+
+  template <typename... PrefixColumns, typename RangeKey>
+  auto rangeBounds(std::tuple<PrefixColumns...> const& prefix_tuple, RangeKey const& low,
+                   RangeKey const& high) const {
+    auto lowest = prefixLowerBound(prefix_tuple, make_index_sequence<sizeof...(PrefixColumns)>());
+    auto highest = prefixUpperBound(prefix_tuple, make_index_sequence<sizeof...(PrefixColumns)>());
+    get<sizeof...(PrefixColumns)>(lowest) = low;
+    get<sizeof...(PrefixColumns)>(highest) = high;
+    return std::make_pair(btree.lower_bound(lowest), btree.upper_bound(highest));
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,377 @@
+#ifndef _SONIC_ADAPTIVE_INDEX_H_
+#define _SONIC_ADAPTIVE_INDEX_H_
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+#include "sonic_filter.h"
+#include "sonic_index.h"
+
+using namespace std;
+
+/// Bucket widths an adaptive index chooses among. Up to 16 keys of four bytes, a bucket still
+/// fits the cache line a probe compares at once.
+constexpr array<size_t, 4> adaptiveBucketSizes = {2, 4, 8, 16};
+
+/// Bucket chains of one level below the first: a chain per distinct prefix ending on the level
+/// above, holding the distinct keys of the level that follow that prefix, or its tuples on the
+/// leaf level.
+struct SonicChainShape {
+  size_t chains = 0;
+  size_t entries = 0;
+  /// Entries past the first bucket of their chain, for each width of adaptiveBucketSizes. They
+  /// spill into the buckets later chains start in, and once buckets are full every probe passing
+  /// them runs on to the next empty slot.
+  array<size_t, adaptiveBucketSizes.size()> overflow{};
+
+  double fanOut() const { return chains ? entries / (double)chains : 0; }
+};
+
+/// Shape of the input of an index, estimated from the tuples of a sample of its first-column
+/// keys. Chains below a sampled key are counted whole, so fan-outs are exact for the sampled
+/// keys and only the counts are scaled up to the whole input.
+struct SonicShape {
+  size_t rows = 0;
+  /// Distinct keys of the first level, or all tuples where the first level is the leaf level.
+  size_t firstLevelKeys = 0;
+  /// Levels below the first, top to bottom.
+  vector<SonicChainShape> levels;
+
+  /// Entries of all levels below the first that overflow their chain's bucket at a width.
+  size_t overflow(size_t width) const {
+    size_t overflowing = 0;
+    for(auto const& level : levels) {
+      overflowing += level.overflow[width];
+    }
+    return overflowing;
+  }
+
+  size_t entries() const {
+    size_t entries = 0;
+    for(auto const& level : levels) {
+      entries += level.entries;
+    }
+    return entries;
+  }
+
+  /// Slots the fullest level needs at a width. The leaf level holds every row, whatever the
+  /// sample saw, and the first level is kept at most half full; below it, every chain starts a
+  /// bucket of its own and its overflow takes further slots.
+  size_t slots(size_t width) const {
+    auto slots = max(rows, 2 * firstLevelKeys);
+    for(auto const& level : levels) {
+      slots = max(slots, level.chains * adaptiveBucketSizes[width] + level.overflow[width]);
+    }
+    return slots;
+  }
+};
+
+namespace {
+/// Sonic index that picks its bucket width and slot count when it is built, from the fan-out of
+/// every level in a sample of the input, instead of taking them as template arguments. Each width
+/// of adaptiveBucketSizes is a SonicIndex instantiation of its own, so probes stay specialised
+/// and only the call into the index dispatches on the width. An index that starts empty uses
+/// BucketSize and Capacity until bulkLoad gives it input to sample. Capacity bounds the slots of
+/// every plan from below, and once inserts use up the headroom the index is planned again from
+/// its tuples, for at least twice as many.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+class AdaptiveSonicIndex {
+  static_assert(ColumnIndex == 0, "AdaptiveSonicIndex is only defined for the whole tuple");
+  static_assert(sizeof...(ColumnTypes) >= 2, "Sonic indices hold at least two columns");
+
+  template <size_t Width> using Layout = SonicIndex<RuntimeCapacity, Width, 0, ColumnTypes...>;
+  typedef variant<Layout<2>, Layout<4>, Layout<8>, Layout<16>> Layouts;
+
+  static constexpr size_t columns = sizeof...(ColumnTypes);
+  /// First-column keys are sampled until about this many tuples remain.
+  static constexpr size_t sampleRows = size_t(1) << 16;
+  /// The narrowest width with at most one overflowing entry in this many is chosen.
+  static constexpr size_t overflowTolerance = 64;
+  /// Slots beyond the estimate, in quarters of it, for sampling error and later inserts.
+  static constexpr size_t headroomQuarters = 1;
+  static constexpr size_t minimumSlots = 4 * adaptiveBucketSizes.back();
+
+  SonicShape estimatedShape;
+  Layouts index;
+
+  static constexpr size_t widthOf(size_t bucketSize) {
+    size_t width = 0;
+    while(width < adaptiveBucketSizes.size() && adaptiveBucketSizes[width] != bucketSize) {
+      width++;
+    }
+    return width;
+  }
+  static_assert(widthOf(BucketSize) < adaptiveBucketSizes.size(),
+                "The initial bucket size must be one of adaptiveBucketSizes");
+
+  template <typename InputSchema, size_t... Length>
+  static array<uint64_t, sizeof...(Length)> prefixHashes(InputSchema const& input_tuple,
+                                                          index_sequence<Length...>) {
+    return {prefixFilterHash<DefaultSonicPolicy, tuple<ColumnTypes...>>(
+        input_tuple, make_index_sequence<Length + 1>())...};
+  }
+
+  /// Narrowest width whose overflow stays within overflowTolerance, or the widest one.
+  static size_t chooseWidth(SonicShape const& shape) {
+    auto const entries = shape.entries();
+    for(size_t width = 0; width + 1 < adaptiveBucketSizes.size(); width++) {
+      if(shape.overflow(width) * overflowTolerance <= entries) {
+        return width;
+      }
+    }
+    return adaptiveBucketSizes.size() - 1;
+  }
+
+  template <size_t Alternative = 0> static Layouts layoutOf(size_t width, size_t capacity) {
+    if constexpr(Alternative + 1 < adaptiveBucketSizes.size()) {
+      if(Alternative != width) {
+        return layoutOf<Alternative + 1>(width, capacity);
+      }
+    }
+    return Layouts(in_place_index<Alternative>, capacity);
+  }
+
+  /// Empty layout with the width that shape calls for and the slots it needs for at least rows
+  /// tuples, plus headroom.
+  static Layouts plannedLayout(SonicShape const& shape, size_t rows = 0) {
+    auto const width = chooseWidth(shape);
+    auto const slots = max(shape.slots(width), rows);
+    return layoutOf(width, max({slots + slots * headroomQuarters / 4, Capacity, minimumSlots}));
+  }
+
+  /// Whether incoming more tuples would eat into the headroom, counting the slots that erased
+  /// tuples still hold.
+  bool outgrows(size_t incoming) const {
+    auto const held = visit(
+        [](auto const& layout) { return layout.getSize() + layout.tombstoneCount(); }, index);
+    return (held + incoming) * (4 + headroomQuarters) > getCapacity() * 4;
+  }
+
+  /// Rebuilds the index from its live tuples, dropping tombstones, in a layout planned from them
+  /// for twice as many tuples as it holds once incoming more arrive.
+  void replan(size_t incoming) {
+    vector<tuple<ColumnTypes...>> live;
+    live.reserve(getSize());
+    for(tuple<ColumnTypes...> const& input_tuple : scan()) {
+      live.emplace_back(input_tuple);
+    }
+    auto const rows = 2 * (live.size() + incoming);
+    if(live.empty()) {
+      index = layoutOf(index.index(), max({rows, Capacity, minimumSlots}));
+      return;
+    }
+    estimatedShape = estimateShape(live);
+    index = plannedLayout(estimatedShape, rows);
+    visit([&](auto& layout) { layout.bulkLoad(live); }, index);
+  }
+
+public:
+  explicit AdaptiveSonicIndex(size_t capacity = Capacity)
+      : index(layoutOf(widthOf(BucketSize), capacity)) {}
+
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  AdaptiveSonicIndex(vector<InputSchema> const& input_data)
+      : estimatedShape(estimateShape(input_data)),
+        index(input_data.empty() ? layoutOf(widthOf(BucketSize), Capacity)
+                                 : plannedLayout(estimatedShape)) {
+    for(auto const& input_tuple : input_data) {
+      insert(input_tuple);
+    }
+  }
+
+  /// Samples the tuples whose first-column key hashes into a 1/k slice of the hash range, with k
+  /// chosen to leave about sampleRows of them. Sorted by their prefix hashes, the sampled tuples
+  /// of a chain are adjacent, and so are those of each of its entries.
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  static SonicShape estimateShape(vector<InputSchema> const& input_data) {
+    SonicShape shape;
+    shape.rows = input_data.size();
+    shape.levels.resize(columns - 2);
+    auto const slices = max<size_t>((input_data.size() + sampleRows - 1) / sampleRows, 1);
+
+    vector<array<uint64_t, columns - 1>> sample;
+    sample.reserve(min(input_data.size(), 2 * sampleRows));
+    for(auto const& input_tuple : input_data) {
+      auto const first = prefixFilterHash<DefaultSonicPolicy, tuple<ColumnTypes...>>(
+          input_tuple, make_index_sequence<1>());
+      if((unsigned __int128)first * slices >> 64 == 0) {
+        sample.emplace_back(prefixHashes(input_tuple, make_index_sequence<columns - 1>()));
+      }
+    }
+    sort(sample.begin(), sample.end());
+
+    size_t firstLevelKeys = 0;
+    for(size_t i = 0; i < sample.size(); i++) {
+      firstLevelKeys += columns == 2 || i == 0 || sample[i][0] != sample[i - 1][0];
+    }
+    shape.firstLevelKeys = firstLevelKeys * slices;
+
+    for(size_t level = 1; level + 1 < columns; level++) {
+      auto& chains = shape.levels[level - 1];
+      auto const leaf = level + 2 == columns;
+      size_t entries = 0;
+      for(size_t i = 0; i <= sample.size(); i++) {
+        auto const chainStart = i == 0 || i == sample.size() ||
+                                sample[i][level - 1] != sample[i - 1][level - 1];
+        if(chainStart && i > 0) {
+          chains.chains++;
+          chains.entries += entries;
+          for(size_t width = 0; width < adaptiveBucketSizes.size(); width++) {
+            chains.overflow[width] += entries - min(entries, adaptiveBucketSizes[width]);
+          }
+          entries = 0;
+        }
+        if(i < sample.size()) {
+          entries += leaf || chainStart || sample[i][level] != sample[i - 1][level];
+        }
+      }
+      chains.chains *= slices;
+      chains.entries *= slices;
+      for(auto& overflowing : chains.overflow) {
+        overflowing *= slices;
+      }
+    }
+    return shape;
+  }
+
+  /// Replans an empty index for input_data before loading it, and grows one that holds tuples
+  /// already if input_data would outgrow it.
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  void bulkLoad(vector<InputSchema> const& input_data, size_t threads = 1) {
+    if(getSize() == 0 && !input_data.empty()) {
+      estimatedShape = estimateShape(input_data);
+      index = plannedLayout(estimatedShape);
+    } else if(outgrows(input_data.size())) {
+      replan(input_data.size());
+    }
+    visit([&](auto& layout) { layout.bulkLoad(input_data, threads); }, index);
+  }
+
+  template <typename Tuple = tuple<ColumnTypes...>> void insert(Tuple const& input_tuple) {
+    if(outgrows(1)) {
+      replan(1);
+    }
+    visit([&](auto& layout) { layout.template insert<Tuple>(input_tuple); }, index);
+  }
+
+  /// Erases one occurrence of input_tuple. Returns the number of erased tuples.
+  size_t erase(tuple<ColumnTypes...> const& input_tuple) {
+    return visit([&](auto& layout) { return layout.erase(input_tuple); }, index);
+  }
+
+  size_t pointLookup(tuple<ColumnTypes...> const& input_tuple) {
+    return visit([&](auto& layout) { return layout.pointLookup(input_tuple); }, index);
+  }
+
+  template <typename... PrefixColumns>
+  size_t countPrefix(tuple<PrefixColumns...> const& input_tuple) const {
+    return visit(
+        [&](auto const& layout) {
+          return layout.template countPrefix<PrefixColumns...>(input_tuple);
+        },
+        index);
+  }
+
+  template <typename... PrefixColumns>
+  vector<size_t> countPrefixBatch(vector<tuple<PrefixColumns...>> const& input_tuples) const {
+    return visit([&](auto const& layout) { return layout.countPrefixBatch(input_tuples); }, index);
+  }
+
+  template <typename... PrefixColumns>
+  vector<reference_wrapper<const tuple<ColumnTypes...>>>
+  prefixLookup(tuple<PrefixColumns...> const& input_tuple) const {
+    return visit(
+        [&](auto const& layout) {
+          return layout.template prefixLookup<PrefixColumns...>(input_tuple);
+        },
+        index);
+  }
+
+  /// PrefixCursor of the chosen layout. Every step dispatches on the layout once.
+  template <typename... PrefixColumns> class PrefixCursor {
+    variant<typename Layout<2>::template PrefixCursor<PrefixColumns...>,
+            typename Layout<4>::template PrefixCursor<PrefixColumns...>,
+            typename Layout<8>::template PrefixCursor<PrefixColumns...>,
+            typename Layout<16>::template PrefixCursor<PrefixColumns...>>
+        cursor;
+
+  public:
+    PrefixCursor() = default;
+
+    template <typename LayoutCursor>
+    explicit PrefixCursor(LayoutCursor const& cursor_) : cursor(cursor_) {}
+
+    bool valid() const {
+      return visit([](auto const& layoutCursor) { return layoutCursor.valid(); }, cursor);
+    }
+
+    size_t multiplicity() const {
+      return visit([](auto const& layoutCursor) { return layoutCursor.multiplicity(); }, cursor);
+    }
+
+    tuple<ColumnTypes...> const& operator*() const {
+      return visit(
+          [](auto const& layoutCursor) -> tuple<ColumnTypes...> const& { return *layoutCursor; },
+          cursor);
+    }
+
+    void next() { visit([](auto& layoutCursor) { layoutCursor.next(); }, cursor); }
+  };
+
+  template <typename... PrefixColumns>
+  PrefixCursor<decay_t<PrefixColumns>...>
+  prefixCursor(tuple<PrefixColumns...> const& input_tuple) const {
+    return visit(
+        [&](auto const& layout) {
+          return PrefixCursor<decay_t<PrefixColumns>...>(layout.prefixCursor(input_tuple));
+        },
+        index);
+  }
+
+  vector<reference_wrapper<const tuple<ColumnTypes...>>> scan() const {
+    return visit([](auto const& layout) { return layout.scan(); }, index);
+  }
+
+  template <typename Output, typename Convert>
+  vector<vector<Output>> scanPartitioned(size_t threads, Convert&& convert) const {
+    return visit(
+        [&](auto const& layout) {
+          return layout.template scanPartitioned<Output>(threads, convert);
+        },
+        index);
+  }
+
+  vector<vector<reference_wrapper<const tuple<ColumnTypes...>>>>
+  scanPartitioned(size_t threads) const {
+    return visit([&](auto const& layout) { return layout.scanPartitioned(threads); }, index);
+  }
+
+  size_t getSize() const {
+    return visit([](auto const& layout) { return layout.getSize(); }, index);
+  }
+
+  size_t getCapacity() const {
+    return visit([](auto const& layout) { return layout.getCapacity(); }, index);
+  }
+
+  size_t memoryUsage() const {
+    return visit([](auto const& layout) { return layout.memoryUsage(); }, index);
+  }
+
+  vector<SonicLevelStats> stats() const {
+    return visit([](auto const& layout) { return layout.stats(); }, index);
+  }
+
+  /// Bucket width the index was built with.
+  size_t bucketSize() const { return adaptiveBucketSizes[index.index()]; }
+
+  /// Shape the bucket width was chosen from; all zero unless the index was built from input or
+  /// planned again as it grew.
+  SonicShape const& shape() const { return estimatedShape; }
+};
+} // namespace
+#endif
@@ -0,0 +1,315 @@
+#ifndef _SONIC_COMMON_H_
+#define _SONIC_COMMON_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../../helper_functions.h"
+
+using namespace std;
+
+/// Capacity value selecting a layer whose slot count is chosen at construction time.
+constexpr size_t RuntimeCapacity = 0;
+
+/// Bucket number stored in a freshly created node whose child chain has not been placed yet.
+template <size_t Capacity, size_t BucketSize> constexpr size_t unassignedBucket() {
+  return Capacity == RuntimeCapacity ? numeric_limits<size_t>::max() : Capacity / BucketSize;
+}
+
+/// Width of the child bucket numbers and prefix counts of a layer: 32 bits whenever the slot
+/// count is known at compile time and fits, since neither can exceed it.
+template <size_t Capacity>
+using SlotWord = conditional_t<Capacity != RuntimeCapacity &&
+                                   Capacity <= numeric_limits<uint32_t>::max(),
+                               uint32_t, size_t>;
+
+/// Allocator placing arrays on cache-line boundaries, so that an aligned probe group of keys
+/// never straddles two lines.
+template <typename T> struct CacheLineAllocator {
+  typedef T value_type;
+  static constexpr size_t alignment = 64;
+
+  CacheLineAllocator() = default;
+  template <typename U> CacheLineAllocator(CacheLineAllocator<U> const&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(alignment)));
+  }
+
+  void deallocate(T* p, size_t) { ::operator delete(p, align_val_t(alignment)); }
+
+  template <typename U> bool operator==(CacheLineAllocator<U> const&) const { return true; }
+  template <typename U> bool operator!=(CacheLineAllocator<U> const&) const { return false; }
+};
+
+/// Allocator mapping every array to its own run of huge pages, so that probing a large level
+/// walks few TLB entries. Pages larger than the transparent 2MB ones come from the hugetlbfs pool
+/// and fall back to transparent pages when the pool is empty. With LazyZeroFill, elements whose
+/// initial value is all zero bytes are not written: fresh anonymous pages already read as zero
+/// and are only faulted in once the index touches them. This relies on every element being
+/// constructed right after its array is allocated, as the fixed-size SlotArray does.
+template <typename T, size_t PageSize = (size_t(1) << 21), bool LazyZeroFill = true>
+struct HugePageAllocator {
+  typedef T value_type;
+  static constexpr size_t transparentPageSize = size_t(1) << 21;
+  static_assert(PageSize % transparentPageSize == 0, "Huge pages are multiples of 2MB");
+
+  template <typename U> struct rebind {
+    typedef HugePageAllocator<U, PageSize, LazyZeroFill> other;
+  };
+
+  HugePageAllocator() = default;
+  template <typename U> HugePageAllocator(HugePageAllocator<U, PageSize, LazyZeroFill> const&) {}
+
+  static size_t mappedLength(size_t n) {
+    return (n * sizeof(T) + PageSize - 1) / PageSize * PageSize;
+  }
+
+  T* allocate(size_t n) {
+    auto const length = mappedLength(n);
+    if constexpr(PageSize > transparentPageSize) {
+      auto const sizeFlag = (size_t)__builtin_ctzll(PageSize) << MAP_HUGE_SHIFT;
+      auto* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag, -1, 0);
+      if(mapping != MAP_FAILED) {
+        return static_cast<T*>(mapping);
+      }
+    }
+    // Over-reserve by one huge page and trim both ends, so the array starts on a page boundary.
+    auto* reserved = static_cast<char*>(mmap(nullptr, length + transparentPageSize,
+                                             PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if(reserved == MAP_FAILED) {
+      throw bad_alloc();
+    }
+    auto const head = (transparentPageSize - (uintptr_t)reserved % transparentPageSize) %
+                      transparentPageSize;
+    if(head > 0) {
+      munmap(reserved, head);
+    }
+    munmap(reserved + head + length, transparentPageSize - head);
+    madvise(reserved + head, length, MADV_HUGEPAGE);
+    return reinterpret_cast<T*>(reserved + head);
+  }
+
+  void deallocate(T* p, size_t n) { munmap(p, mappedLength(n)); }
+
+  template <typename U, typename... Args> void construct(U* p, Args&&... args) {
+    if constexpr(LazyZeroFill && sizeof...(Args) == 1 && is_trivially_destructible_v<U>) {
+      if(isZero(args...)) {
+        return;
+      }
+    }
+    ::new((void*)p) U(forward<Args>(args)...);
+  }
+
+  template <typename U> bool operator==(HugePageAllocator<U, PageSize, LazyZeroFill> const&) const {
+    return true;
+  }
+  template <typename U> bool operator!=(HugePageAllocator<U, PageSize, LazyZeroFill> const&) const {
+    return false;
+  }
+
+private:
+  template <typename U> static bool isZero(U const& value) {
+    if constexpr(is_same_v<decay_t<U>, T>) {
+      static char const zeros[sizeof(T)] = {};
+      return memcmp(&value, zeros, sizeof(T)) == 0;
+    } else {
+      return false;
+    }
+  }
+};
+
+/// Compile-time options shared by all levels of a BasicSonicIndex. Variants derive from this
+/// struct and override the members they change.
+struct DefaultSonicPolicy {
+  /// Lookups may run on other threads while a single writer keeps inserting.
+  static constexpr bool concurrentReaders = false;
+  /// Leaves keep one slot per distinct tuple and count its copies.
+  static constexpr bool tupleMultiplicities = false;
+  /// Leaves bit-pack their tuples per bucket instead of storing them whole.
+  static constexpr bool compressedLeaves = false;
+  /// Nodes sketch the distinct keys below them, so that estimatePrefix never walks a leaf chain.
+  static constexpr bool prefixSketches = false;
+  /// A Bloom filter per prefix length of two or more columns rejects lookups of absent prefixes
+  /// before any probe.
+  static constexpr bool prefixFilters = false;
+  /// Hash of the keys of every level.
+  template <typename KeyType> using Hash = CRCHash<KeyType>;
+  /// Allocator of the slot arrays of every level.
+  template <typename T> using Allocator = CacheLineAllocator<T>;
+};
+
+struct ConcurrentSonicPolicy : DefaultSonicPolicy {
+  static constexpr bool concurrentReaders = true;
+};
+
+struct MultisetSonicPolicy : DefaultSonicPolicy {
+  static constexpr bool tupleMultiplicities = true;
+};
+
+/// Places the slot arrays on huge pages; see HugePageAllocator.
+template <typename Base = DefaultSonicPolicy, size_t PageSize = (size_t(1) << 21)>
+struct HugePageSonicPolicy : Base {
+  template <typename T> using Allocator = HugePageAllocator<T, PageSize>;
+};
+
+/// Stores the tuples of the leaf level frame-of-reference encoded in one Payload word per slot;
+/// see CompressedSonicTuple. Columns of wide domains need uint64_t payloads to stay packed.
+template <typename Base = DefaultSonicPolicy, typename Payload = uint32_t>
+struct CompressedLeafSonicPolicy : Base {
+  static constexpr bool compressedLeaves = true;
+  typedef Payload LeafPayload;
+};
+
+/// Keeps a SonicSketch per node for estimatePrefix and estimateDistinct, at one word per node.
+template <typename Base = DefaultSonicPolicy> struct SketchedSonicPolicy : Base {
+  static constexpr bool prefixSketches = true;
+};
+
+/// Puts a SonicPrefixFilter per prefix length of two or more columns in front of every lookup, at
+/// one byte per slot of a level for each of them.
+template <typename Base = DefaultSonicPolicy> struct FilteredSonicPolicy : Base {
+  static constexpr bool prefixFilters = true;
+};
+
+/// Base with its key hash replaced by HashFunction, e.g. a hash from sonic_hash.h.
+template <template <typename> typename HashFunction, typename Base = DefaultSonicPolicy>
+struct HashedSonicPolicy : Base {
+  template <typename KeyType> using Hash = HashFunction<KeyType>;
+};
+
+/// Slot field of a concurrently read index. Only one thread ever writes, so stores publish with
+/// release ordering, loads acquire, and increments need no read-modify-write instruction.
+template <typename T> class PublishedField {
+  static_assert(is_trivially_copyable_v<T>,
+                "Concurrent Sonic readers require trivially copyable columns");
+  atomic<T> value;
+
+public:
+  PublishedField(T initial = T()) : value(initial) {}
+  PublishedField(PublishedField const& other) : value(other.value.load(memory_order_relaxed)) {}
+
+  PublishedField& operator=(PublishedField const& other) { return *this = T(other); }
+
+  PublishedField& operator=(T newValue) {
+    value.store(newValue, memory_order_release);
+    return *this;
+  }
+
+  operator T() const { return value.load(memory_order_acquire); }
+
+  T operator++(int) {
+    auto oldValue = value.load(memory_order_relaxed);
+    value.store(oldValue + 1, memory_order_release);
+    return oldValue;
+  }
+};
+
+template <typename T, bool Published>
+using SlotField = conditional_t<Published, PublishedField<T>, T>;
+
+/// Fixed-size slot array of a layer. It either owns its slots or borrows them from a mapped
+/// index file, in which case writes go to private copy-on-write pages of the mapping.
+template <typename T, typename Allocator = allocator<T>> class SlotArray {
+  vector<T, Allocator> owned;
+  T* slots = nullptr;
+  size_t count = 0;
+  bool borrowed = false;
+
+public:
+  typedef T value_type;
+
+  SlotArray() = default;
+  SlotArray(size_t size, T const& value) : owned(size, value), slots(owned.data()), count(size) {}
+
+  /// Copies always own their slots, so writing to one never shows through a shared mapping.
+  SlotArray(SlotArray const& other)
+      : owned(other.slots, other.slots + other.count), slots(owned.data()), count(other.count) {}
+
+  SlotArray(SlotArray&& other) noexcept
+      : owned(move(other.owned)), slots(other.borrowed ? other.slots : owned.data()),
+        count(other.count), borrowed(other.borrowed) {}
+
+  SlotArray& operator=(SlotArray other) {
+    owned.swap(other.owned);
+    slots = other.borrowed ? other.slots : owned.data();
+    count = other.count;
+    borrowed = other.borrowed;
+    return *this;
+  }
+
+  inline T& operator[](size_t idx) { return slots[idx]; }
+  inline T const& operator[](size_t idx) const { return slots[idx]; }
+
+  T const* data() const { return slots; }
+  size_t size() const { return count; }
+  size_t memoryUsage() const { return count * sizeof(T); }
+
+  void borrow(T* external, size_t size) {
+    owned = vector<T, Allocator>();
+    slots = external;
+    count = size;
+    borrowed = true;
+  }
+};
+
+/// Reciprocal of a slot count chosen at runtime, for reduceToSlot.
+inline uint64_t slotReciprocal(size_t slots) { return ~uint64_t(0) / slots + 1; }
+
+/// hash % slots without a division: Lemire's fastmod, exact whenever both fit in 32 bits, which
+/// every CRCHash value does. Compile-time slot counts need none of this, since the compiler
+/// already turns their modulo into a mask or a multiplication.
+inline size_t reduceToSlot(size_t hash, size_t slots, uint64_t reciprocal) {
+  if((hash | slots) >> 32 == 0) {
+    return (size_t)(((__uint128_t)(reciprocal * hash) * slots) >> 64);
+  }
+  return hash % slots;
+}
+
+/// Position after idx on a ring of size positions, by comparison instead of modulo.
+inline size_t nextOnRing(size_t idx, size_t size) { return idx + 1 == size ? 0 : idx + 1; }
+
+inline size_t roundUpToBucket(size_t capacity, size_t bucketSize) {
+  return ((capacity + bucketSize - 1) / bucketSize) * bucketSize;
+}
+
+/// Words of an occupancy bitmap with one bit per bucket. A leaf sets a bucket's bit once a key
+/// is written to one of its slots; keys stay in place until the layer is rebuilt, so the bits
+/// never need clearing.
+inline size_t occupancyWords(size_t buckets) { return (buckets + 63) / 64; }
+
+template <typename Bitmap> inline void markOccupied(Bitmap& occupied, size_t bucket) {
+  occupied[bucket / 64] = occupied[bucket / 64] | uint64_t(1) << bucket % 64;
+}
+
+/// Calls visit on every bucket in [firstBucket, lastBucket) whose occupancy bit is set, skipping
+/// 64 buckets at a time where a word of the bitmap is zero.
+template <typename Bitmap, typename Visit>
+void forEachOccupiedBucket(Bitmap const& occupied, size_t firstBucket, size_t lastBucket,
+                           Visit&& visit) {
+  for(auto word = firstBucket / 64; word * 64 < lastBucket; word++) {
+    uint64_t bits = occupied[word];
+    if(word == firstBucket / 64) {
+      bits &= ~uint64_t(0) << firstBucket % 64;
+    }
+    if(lastBucket - word * 64 < 64) {
+      bits &= (uint64_t(1) << (lastBucket - word * 64)) - 1;
+    }
+    for(; bits; bits &= bits - 1) {
+      visit(word * 64 + __builtin_ctzll(bits));
+    }
+  }
+}
+
+#endif
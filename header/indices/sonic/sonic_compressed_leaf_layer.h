@@ -0,0 +1,695 @@
+#ifndef _SONIC_COMPRESSED_LEAF_
+#define _SONIC_COMPRESSED_LEAF_
+
+#include <array>
+#include <cstdint>
+#include <emmintrin.h>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "../../helper_functions.h"
+#include "sonic_common.h"
+#include "sonic_persistence.h"
+#include "sonic_probe.h"
+#include "sonic_stats.h"
+
+using namespace std;
+
+/// Maps an integer onto an unsigned word of the same order, so frames subtract without overflow.
+template <typename T> inline uint64_t toOrdered(T value) {
+  if constexpr(is_signed_v<T>) {
+    return (uint64_t)(int64_t)value ^ (uint64_t(1) << 63);
+  } else {
+    return (uint64_t)value;
+  }
+}
+
+template <typename T> inline T fromOrdered(uint64_t bits) {
+  if constexpr(is_signed_v<T>) {
+    return (T)(int64_t)(bits ^ (uint64_t(1) << 63));
+  } else {
+    return (T)bits;
+  }
+}
+
+/// Leaf layer of a CompressedLeafSonicPolicy index. It probes exactly like SonicTuple, but
+/// instead of a copy of every tuple it keeps one Policy::LeafPayload word per slot. The payloads
+/// of a bucket are frame-of-reference encoded: every column except the key, which the slot
+/// already holds, is stored as its distance to the smallest value of that column in the bucket,
+/// in as many bits as the largest distance needs. A bucket whose distances outgrow the payload
+/// spills its tuples, uncompressed, to an overflow array. Tuples only exist decoded, so lookups
+/// return them by value.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename Hash, typename Tuple,
+          typename Policy = DefaultSonicPolicy>
+class CompressedSonicTuple {
+public:
+  typedef tuple_element_t<ColumnIndex, Tuple> KeyType;
+
+private:
+  typedef typename Policy::LeafPayload Payload;
+  static constexpr size_t columns = tuple_size_v<Tuple>;
+  static constexpr size_t payloadBits = 8 * sizeof(Payload);
+  static_assert(is_same_v<Payload, uint32_t> || is_same_v<Payload, uint64_t>,
+                "Payloads are decoded as 32 or 64-bit lanes");
+  static_assert(BucketSize <= 64, "Erased slots are tracked in one word per bucket");
+  static_assert(!Policy::concurrentReaders, "Re-encoding a bucket would race with readers");
+
+  template <size_t... I> static constexpr bool integralColumns(index_sequence<I...>) {
+    return (is_integral_v<tuple_element_t<I, Tuple>> && ...);
+  }
+  static_assert(integralColumns(make_index_sequence<columns>()),
+                "Only integer columns are frame-of-reference encoded");
+
+  typedef conditional_t<BucketSize <= 8, uint8_t,
+                        conditional_t<BucketSize <= 16, uint16_t,
+                                      conditional_t<BucketSize <= 32, uint32_t, uint64_t>>>
+      BucketMask;
+
+  /// Width marking a spilled bucket, stored for the key column, which is never packed. The first
+  /// payload of a spilled bucket holds the number of its overflow bucket.
+  static constexpr uint8_t spilledWidth = 0xff;
+
+  /// A bucket's payloads together with the frame they are encoded against, so that a slot and
+  /// its frame share a cache line.
+  struct BucketFrame {
+    /// Smallest value of every column among the tuples encoded against this frame.
+    Tuple bases = Tuple();
+    array<uint8_t, columns> widths = {};
+    /// Slots of the bucket whose tuple was erased.
+    BucketMask erased = 0;
+    array<Payload, BucketSize> payloads = {};
+  };
+
+  typedef SlotField<SlotWord<Capacity>, false> WordSlot;
+  template <typename T> using Allocator = typename Policy::template Allocator<T>;
+  static size_t constexpr keyPadding = probePadding<KeyType>();
+  static bool constexpr counted = Policy::tupleMultiplicities;
+
+  class NoMultiplicities {};
+
+  SlotArray<KeyType, Allocator<KeyType>> keys;
+  SlotArray<BucketFrame, Allocator<BucketFrame>> frames;
+  vector<Tuple> spilled;
+  conditional_t<counted, SlotArray<WordSlot, Allocator<WordSlot>>, NoMultiplicities>
+      multiplicities;
+  /// Buckets holding keys, so that scans skip empty regions; see occupancyWords.
+  SlotArray<uint64_t, Allocator<uint64_t>> occupied;
+  static Hash constexpr hasher = Hash();
+  size_t bucket_idx;
+  size_t runtimeSlots;
+  uint64_t runtimeReciprocal;
+  size_t tombstones;
+  SonicProbeCounters probeCounters;
+  static bool constexpr runtimeSized = (Capacity == RuntimeCapacity);
+  static size_t constexpr noBucket = unassignedBucket<Capacity, BucketSize>();
+
+  inline bool isEmpty(size_t hash_idx) const {
+    return keys[hash_idx] == DefaultValue<KeyType>()();
+  }
+
+  inline bool isTombstone(size_t hash_idx) const {
+    return frames[hash_idx / BucketSize].erased >> (hash_idx % BucketSize) & 1;
+  }
+
+  inline bool isLive(size_t hash_idx) const { return !isEmpty(hash_idx) && !isTombstone(hash_idx); }
+
+  static bool isSpilled(BucketFrame const& frame) {
+    return frame.widths[ColumnIndex] == spilledWidth;
+  }
+
+  inline size_t spilledPosition(size_t hash_idx) const {
+    return frames[hash_idx / BucketSize].payloads[0] * BucketSize + hash_idx % BucketSize;
+  }
+  inline Tuple& spilledTuple(size_t hash_idx) { return spilled[spilledPosition(hash_idx)]; }
+  inline Tuple const& spilledTuple(size_t hash_idx) const {
+    return spilled[spilledPosition(hash_idx)];
+  }
+
+  template <size_t... I>
+  static array<uint64_t, columns> orderedValues(Tuple const& input_tuple, index_sequence<I...>) {
+    return {toOrdered(get<I>(input_tuple))...};
+  }
+
+  static array<uint64_t, columns> orderedValues(Tuple const& input_tuple) {
+    return orderedValues(input_tuple, make_index_sequence<columns>());
+  }
+
+  /// Bit offsets of the packed columns, which follow each other in column order.
+  static array<uint8_t, columns> offsetsOf(BucketFrame const& frame) {
+    array<uint8_t, columns> offsets;
+    uint8_t offset = 0;
+    for(auto c = 0; c < columns; c++) {
+      offsets[c] = offset;
+      offset += c == ColumnIndex ? 0 : frame.widths[c];
+    }
+    return offsets;
+  }
+
+  /// base + delta in the unsigned type of the column, which wraps to the encoded value.
+  template <typename ColumnType> static ColumnType rebase(ColumnType base, Payload delta) {
+    typedef make_unsigned_t<ColumnType> Unsigned;
+    return (ColumnType)(Unsigned)((Unsigned)base + (Unsigned)delta);
+  }
+
+  static Payload field(Payload payload, size_t offset, size_t width) {
+    return width ? payload >> offset & (Payload)lowBits(width) : 0;
+  }
+
+  template <size_t Column> inline auto column(size_t hash_idx) const {
+    typedef tuple_element_t<Column, Tuple> ColumnType;
+    auto const& frame = frames[hash_idx / BucketSize];
+    if constexpr(Column == ColumnIndex) {
+      return (ColumnType)keys[hash_idx];
+    } else {
+      if(isSpilled(frame)) {
+        return get<Column>(spilledTuple(hash_idx));
+      }
+      size_t offset = 0;
+      for(auto c = 0; c < Column; c++) {
+        offset += c == ColumnIndex ? 0 : frame.widths[c];
+      }
+      return rebase(get<Column>(frame.bases),
+                    field(frame.payloads[hash_idx % BucketSize], offset, frame.widths[Column]));
+    }
+  }
+
+  template <size_t... I> Tuple decode(size_t hash_idx, index_sequence<I...>) const {
+    return Tuple(column<I>(hash_idx)...);
+  }
+
+  /// Whether the live tuple in a slot starts with prefix, comparing only the prefix columns.
+  template <typename Prefix, size_t... I>
+  inline bool matches(size_t hash_idx, Prefix const& prefix, index_sequence<I...>) const {
+    return !isTombstone(hash_idx) && ((column<I>(hash_idx) == get<I>(prefix)) && ...);
+  }
+
+  template <typename... PrefixColumns>
+  inline bool matches(size_t hash_idx, tuple<PrefixColumns...> const& prefix) const {
+    return matches(hash_idx, prefix, make_index_sequence<sizeof...(PrefixColumns)>());
+  }
+
+  /// Payload of values in a packed frame, or false if some distance does not fit its width.
+  static pair<Payload, bool> encode(BucketFrame const& frame,
+                                    array<uint64_t, columns> const& values) {
+    auto const bases = orderedValues(frame.bases);
+    Payload payload = 0;
+    size_t offset = 0;
+    for(auto c = 0; c < columns; c++) {
+      if(c == ColumnIndex) {
+        continue;
+      }
+      if(values[c] < bases[c] || bitWidth(values[c] - bases[c]) > frame.widths[c]) {
+        return {0, false};
+      }
+      if(frame.widths[c]) {
+        payload |= (Payload)(values[c] - bases[c]) << offset;
+      }
+      offset += frame.widths[c];
+    }
+    return {payload, true};
+  }
+
+  template <size_t... I> static array<uint64_t, columns> lowestValues(index_sequence<I...>) {
+    return {toOrdered(numeric_limits<tuple_element_t<I, Tuple>>::lowest())...};
+  }
+
+  template <size_t... I>
+  static void setBases(BucketFrame& frame, array<uint64_t, columns> const& low,
+                       index_sequence<I...>) {
+    frame.bases = Tuple(fromOrdered<tuple_element_t<I, Tuple>>(low[I])...);
+  }
+
+  /// Chooses a frame that covers the live tuples of a bucket plus input_tuple, which is about
+  /// to be written to hash_idx, and re-encodes the live tuples against it. Spills the bucket if
+  /// the distances need more bits than a payload has.
+  void reframe(size_t hash_idx, Tuple const& input_tuple) {
+    auto const first = hash_idx / BucketSize * BucketSize;
+    auto& frame = frames[hash_idx / BucketSize];
+    array<pair<size_t, Tuple>, BucketSize> live;
+    size_t liveCount = 0;
+    for(auto slot = first; slot < first + BucketSize; slot++) {
+      if(slot != hash_idx && isLive(slot)) {
+        live[liveCount++] = {slot, getTupleByIndex(slot)};
+      }
+    }
+
+    auto low = orderedValues(input_tuple);
+    auto high = low;
+    for(auto i = 0; i < liveCount; i++) {
+      auto const values = orderedValues(live[i].second);
+      for(auto c = 0; c < columns; c++) {
+        low[c] = min(low[c], values[c]);
+        high[c] = max(high[c], values[c]);
+      }
+    }
+
+    size_t bits = 0;
+    for(auto c = 0; c < columns; c++) {
+      frame.widths[c] = c == ColumnIndex ? 0 : bitWidth(high[c] - low[c]);
+      bits += frame.widths[c];
+    }
+
+    if(bits > payloadBits) {
+      frame.widths[ColumnIndex] = spilledWidth;
+      frame.payloads[0] = spilled.size() / BucketSize;
+      spilled.resize(spilled.size() + BucketSize, Tuple());
+      for(auto i = 0; i < liveCount; i++) {
+        spilledTuple(live[i].first) = live[i].second;
+      }
+      return;
+    }
+    // Spare bits widen the frames around the current values, so that most later stores still
+    // fit without another re-encoding.
+    auto const spare = (payloadBits - bits) / max<size_t>(columns - 1, 1);
+    auto const smallest = lowestValues(make_index_sequence<columns>());
+    for(auto c = 0; c < columns; c++) {
+      if(c == ColumnIndex) {
+        continue;
+      }
+      frame.widths[c] += spare;
+      auto const slack = lowBits(frame.widths[c]) - (high[c] - low[c]);
+      low[c] -= min(low[c] - smallest[c], slack / 2);
+    }
+    setBases(frame, low, make_index_sequence<columns>());
+    for(auto i = 0; i < liveCount; i++) {
+      frame.payloads[live[i].first % BucketSize] =
+          encode(frame, orderedValues(live[i].second)).first;
+    }
+  }
+
+  /// Writes the non-key columns of input_tuple to a slot, re-encoding its bucket if needed.
+  void store(size_t hash_idx, Tuple const& input_tuple) {
+    auto& frame = frames[hash_idx / BucketSize];
+    if(!isSpilled(frame)) {
+      auto const values = orderedValues(input_tuple);
+      auto payload = encode(frame, values);
+      if(!payload.second) {
+        reframe(hash_idx, input_tuple);
+        if(isSpilled(frame)) {
+          spilledTuple(hash_idx) = input_tuple;
+          return;
+        }
+        payload = encode(frame, values);
+      }
+      frame.payloads[hash_idx % BucketSize] = payload.first;
+      return;
+    }
+    spilledTuple(hash_idx) = input_tuple;
+  }
+
+  /// Decodes the distances of every column of a packed bucket with SSE2, as many payloads per
+  /// instruction as fit a register. deltas[c][i] belongs to column c of slot i of the bucket.
+  void decodeBucket(size_t bucket, array<array<Payload, BucketSize>, columns>& deltas) const {
+    constexpr size_t lanes = 16 / sizeof(Payload);
+    auto const& frame = frames[bucket];
+    auto const offsets = offsetsOf(frame);
+    auto const* payload = frame.payloads.data();
+    for(auto c = 0; c < columns; c++) {
+      auto const width = c == ColumnIndex ? 0 : frame.widths[c];
+      auto const shift = _mm_cvtsi32_si128(offsets[c]);
+      size_t i = 0;
+      for(; i + lanes <= BucketSize; i += lanes) {
+        auto const words = _mm_loadu_si128((__m128i const*)(payload + i));
+        __m128i decoded;
+        if constexpr(sizeof(Payload) == 8) {
+          decoded = _mm_and_si128(_mm_srl_epi64(words, shift), _mm_set1_epi64x(lowBits(width)));
+        } else {
+          decoded = _mm_and_si128(_mm_srl_epi32(words, shift),
+                                  _mm_set1_epi32((uint32_t)lowBits(width)));
+        }
+        _mm_storeu_si128((__m128i*)(deltas[c].data() + i), decoded);
+      }
+      for(; i < BucketSize; i++) {
+        deltas[c][i] = field(payload[i], offsets[c], width);
+      }
+    }
+  }
+
+  template <size_t... I>
+  Tuple assemble(BucketFrame const& frame,
+                 array<array<Payload, BucketSize>, columns> const& deltas, size_t slot,
+                 index_sequence<I...>) const {
+    return Tuple((I == ColumnIndex ? (tuple_element_t<I, Tuple>)keys[slot]
+                                   : rebase(get<I>(frame.bases), deltas[I][slot % BucketSize]))...);
+  }
+
+  template <typename Visit>
+  inline pair<size_t, bool> probeRun(size_t hash_idx, KeyType const& key, bool matchKey,
+                                     Visit&& visit) const {
+    auto const probe = ::probeRun(keys, slots(), hash_idx, key, matchKey, visit);
+    if constexpr(sonicProbeStats) {
+      probeCounters.record(probedSlotsOnRing(hash_idx, probe.first, slots()));
+    }
+    return probe;
+  }
+
+  template <typename Visit>
+  inline pair<size_t, bool> rangeRun(size_t hash_idx, KeyType const& low, KeyType const& high,
+                                     Visit&& visit) const {
+    auto const probe = ::rangeRun(keys, slots(), hash_idx, low, high, visit);
+    if constexpr(sonicProbeStats) {
+      probeCounters.record(probedSlotsOnRing(hash_idx, probe.first, slots()));
+    }
+    return probe;
+  }
+
+  template <typename Visit>
+  inline pair<size_t, bool> probeChains(size_t hash_idx, KeyType const& key, Visit&& visit) const {
+    auto bucket_counter = 1;
+    if(isEmpty(hash_idx)) {
+      return {hash_idx, false};
+    }
+    while(true) {
+      auto const probe = probeRun(hash_idx, key, true, visit);
+      if(probe.second || ColumnIndex > 0 || bucket_counter >= buckets()) {
+        return probe;
+      }
+      hash_idx = (bucket_counter * BucketSize) % slots();
+      bucket_counter++;
+      if(isEmpty(hash_idx)) {
+        return {hash_idx, false};
+      }
+    }
+  }
+
+public:
+  explicit CompressedSonicTuple(size_t capacity = Capacity) {
+    runtimeSlots = runtimeSized ? roundUpToBucket(capacity, BucketSize) : Capacity;
+    runtimeReciprocal = slotReciprocal(runtimeSlots);
+    keys = decltype(keys)(slots() + keyPadding, DefaultValue<KeyType>()());
+    frames = decltype(frames)(buckets(), BucketFrame());
+    if constexpr(counted) {
+      multiplicities = decltype(multiplicities)(slots(), 0);
+    }
+    occupied = decltype(occupied)(occupancyWords(buckets()), 0);
+    bucket_idx = 0;
+    tombstones = 0;
+  }
+
+  inline size_t slots() const {
+    if constexpr(runtimeSized) {
+      return runtimeSlots;
+    } else {
+      return Capacity;
+    }
+  }
+
+  inline size_t buckets() const { return slots() / BucketSize; }
+
+  inline size_t homeSlot(size_t hash_key) const {
+    if constexpr(runtimeSized) {
+      return reduceToSlot(hash_key, runtimeSlots, runtimeReciprocal);
+    } else {
+      return hash_key % Capacity;
+    }
+  }
+
+  inline size_t nextSlot(size_t hash_idx) const { return nextOnRing(hash_idx, slots()); }
+
+  size_t homeSlotOf(KeyType const& key) const { return homeSlot(hasher(key)); }
+
+  vector<KeyType> keysWithHomeSlot(size_t slot) const {
+    vector<KeyType> result;
+    for(auto hash_idx = slot; !isEmpty(hash_idx); hash_idx = nextSlot(hash_idx)) {
+      if(homeSlotOf(keys[hash_idx]) == slot &&
+         find(result.begin(), result.end(), keys[hash_idx]) == result.end()) {
+        result.emplace_back(keys[hash_idx]);
+      }
+    }
+    return result;
+  }
+
+  Tuple getTupleByIndex(size_t tupleIndex) const {
+    return decode(tupleIndex, make_index_sequence<columns>());
+  }
+
+  size_t multiplicityOf(size_t tupleIndex) const {
+    if constexpr(counted) {
+      return multiplicities[tupleIndex];
+    } else {
+      return 1;
+    }
+  }
+
+  /// Buckets whose tuples no longer fit a 64-bit payload and are stored uncompressed.
+  size_t spilledBuckets() const { return spilled.size() / BucketSize; }
+
+  size_t memoryUsage() const {
+    auto const usage = keys.memoryUsage() + frames.memoryUsage() + occupied.memoryUsage() +
+                       spilled.capacity() * sizeof(Tuple);
+    if constexpr(counted) {
+      return usage + multiplicities.memoryUsage();
+    } else {
+      return usage;
+    }
+  }
+
+  size_t tombstoneCount() const { return tombstones; }
+
+  /// Occupancy, runs and overflow of this layer, from one pass over its slots.
+  SonicLevelStats stats() const {
+    SonicLevelStats stats;
+    stats.column = ColumnIndex;
+    stats.leaf = true;
+    auto const used = [&](size_t slot) { return !isEmpty(slot); };
+    countRuns(stats, slots(), BucketSize, used);
+    stats.deadSlots = tombstones;
+    if constexpr(ColumnIndex == 0) {
+      countDisplacements(stats, slots(), BucketSize, used,
+                         [&](size_t slot) { return homeSlotOf(keys[slot]); });
+    }
+    probeCounters.addTo(stats);
+    return stats;
+  }
+
+  void writeTo(SonicFileWriter& writer) const {
+    writer.value<uint64_t>(slots());
+    writer.value<uint64_t>(bucket_idx);
+    writer.value<uint64_t>(tombstones);
+    writer.array(keys.data(), keys.size());
+    writer.array(frames.data(), frames.size());
+    writer.array(occupied.data(), occupied.size());
+    writer.value<uint64_t>(spilled.size());
+    writer.array(spilled.data(), spilled.size());
+    if constexpr(counted) {
+      writer.array(multiplicities.data(), multiplicities.size());
+    }
+  }
+
+  /// Points this layer at the arrays a matching writeTo stored in a mapped file. The overflow
+  /// array keeps growing after loading, so it is copied instead.
+  bool mapFrom(SonicFileReader& reader) {
+    auto const fileSlots = reader.value<uint64_t>();
+    if(!reader.good() || fileSlots == 0 || fileSlots % BucketSize != 0 ||
+       (!runtimeSized && fileSlots != Capacity)) {
+      return false;
+    }
+    runtimeSlots = fileSlots;
+    runtimeReciprocal = slotReciprocal(runtimeSlots);
+    bucket_idx = reader.value<uint64_t>();
+    tombstones = reader.value<uint64_t>();
+    mapArray(reader, keys, slots() + keyPadding);
+    mapArray(reader, frames, buckets());
+    mapArray(reader, occupied, occupancyWords(buckets()));
+    auto const spilledCount = reader.value<uint64_t>();
+    auto const* spilledTuples = reader.template array<Tuple>(spilledCount);
+    if(spilledTuples == nullptr || spilledCount % BucketSize != 0) {
+      return false;
+    }
+    spilled.assign(spilledTuples, spilledTuples + spilledCount);
+    if constexpr(counted) {
+      mapArray(reader, multiplicities, slots());
+    }
+    return reader.good() && bucket_idx < buckets();
+  }
+
+  /// Calls visit on the live tuples of buckets [firstBucket, lastBucket) in slot order.
+  template <typename Visit>
+  void scanBuckets(size_t firstBucket, size_t lastBucket, Visit&& visit) const {
+    array<array<Payload, BucketSize>, columns> deltas;
+    forEachOccupiedBucket(occupied, firstBucket, lastBucket, [&](size_t bucket) {
+      auto const first = bucket * BucketSize;
+      uint64_t live = 0;
+      for(auto i = 0; i < BucketSize; i++) {
+        live |= (uint64_t)isLive(first + i) << i;
+      }
+      if(isSpilled(frames[bucket])) {
+        for(; live; live &= live - 1) {
+          visit(spilledTuple(first + __builtin_ctzll(live)));
+        }
+        return;
+      }
+      // Unpacking a whole bucket only pays off once it holds more than one tuple.
+      if(__builtin_popcountll(live) == 1) {
+        visit(getTupleByIndex(first + __builtin_ctzll(live)));
+        return;
+      }
+      if(live != 0) {
+        decodeBucket(bucket, deltas);
+      }
+      for(; live; live &= live - 1) {
+        visit(assemble(frames[bucket], deltas, first + __builtin_ctzll(live),
+                       make_index_sequence<columns>()));
+      }
+    });
+  }
+
+  vector<Tuple> scan() const {
+    vector<Tuple> results;
+    // Tuples are returned by value, so growing the result would copy them over and over.
+    size_t liveSlots = 0;
+    forEachOccupiedBucket(occupied, 0, buckets(), [&](size_t bucket) {
+      for(auto i = bucket * BucketSize; i < (bucket + 1) * BucketSize; i++) {
+        liveSlots += isLive(i);
+      }
+    });
+    results.reserve(liveSlots);
+    scanBuckets(0, buckets(), [&](Tuple const& data_tuple) { results.push_back(data_tuple); });
+    return results;
+  }
+
+  pair<size_t, size_t> insert(Tuple const& input_tuple, size_t bucket_number_level_up = noBucket) {
+    auto hash_key = hasher(get<ColumnIndex>(input_tuple));
+    auto hash_idx = homeSlot(hash_key);
+
+    // A new chain cannot hold the tuple yet; anywhere else a copy only raises its count.
+    if constexpr(counted) {
+      if(ColumnIndex == 0 || bucket_number_level_up != noBucket) {
+        auto const probe =
+            probeChains(prefixStart(input_tuple, bucket_number_level_up),
+                        get<ColumnIndex>(input_tuple),
+                        [&](size_t slot) { return matches(slot, input_tuple); });
+        if(probe.second) {
+          multiplicities[probe.first]++;
+          return {probe.first, bucket_number_level_up == noBucket
+                                   ? (size_t)(probe.first / BucketSize)
+                                   : bucket_number_level_up};
+        }
+      }
+    }
+
+    if constexpr(ColumnIndex > 0) {
+      hash_idx = bucket_number_level_up != noBucket ? bucket_number_level_up * BucketSize
+                                                    : bucket_idx * BucketSize;
+    }
+
+    if(tombstones > 0) {
+      auto const probe = probeRun(hash_idx, get<ColumnIndex>(input_tuple), false,
+                                  [&](size_t slot) { return isTombstone(slot); });
+      hash_idx = probe.first;
+      tombstones -= probe.second;
+    } else {
+      hash_idx = probeRun(hash_idx, get<ColumnIndex>(input_tuple), false, [](size_t) {
+                   return false;
+                 }).first;
+    }
+
+    store(hash_idx, input_tuple);
+    frames[hash_idx / BucketSize].erased &= ~(BucketMask(1) << hash_idx % BucketSize);
+    if constexpr(counted) {
+      multiplicities[hash_idx] = 1;
+    }
+    keys[hash_idx] = get<ColumnIndex>(input_tuple);
+    markOccupied(occupied, hash_idx / BucketSize);
+
+    if(bucket_number_level_up == noBucket) {
+      bucket_idx = nextOnRing(bucket_idx, buckets());
+      return {hash_idx, (size_t)(hash_idx / BucketSize)};
+    } else {
+      return {hash_idx, bucket_number_level_up};
+    }
+  }
+
+  pair<size_t, size_t> pointLookup(Tuple const& input_tuple, size_t bucket_number_level_up) {
+    auto const probe =
+        probeChains(prefixStart(input_tuple, bucket_number_level_up),
+                    get<ColumnIndex>(input_tuple),
+                    [&](size_t slot) { return matches(slot, input_tuple); });
+    return {probe.first, probe.second ? 1 : 0};
+  }
+
+  /// Drops one copy of input_tuple, turning its slot into a tombstone once no copy is left.
+  /// Returns the number of erased tuples.
+  size_t erase(Tuple const& input_tuple, size_t bucket_number_level_up) {
+    auto const probe =
+        probeChains(prefixStart(input_tuple, bucket_number_level_up),
+                    get<ColumnIndex>(input_tuple),
+                    [&](size_t slot) { return matches(slot, input_tuple); });
+    if(!probe.second) {
+      return 0;
+    }
+    if constexpr(counted) {
+      multiplicities[probe.first] = multiplicities[probe.first] - 1;
+      if(multiplicities[probe.first] > 0) {
+        return 1;
+      }
+    }
+    frames[probe.first / BucketSize].erased |= BucketMask(1) << probe.first % BucketSize;
+    tombstones++;
+    return 1;
+  }
+
+  template <typename... PrefixColumns>
+  pair<size_t, size_t> countPrefix(tuple<PrefixColumns...> const& input_tuple,
+                                   size_t bucket_number_level_up) const {
+    size_t result = 0;
+    auto const probe = probeChains(prefixStart(input_tuple, bucket_number_level_up),
+                                   get<ColumnIndex>(input_tuple), [&](size_t slot) {
+                                     if(matches(slot, input_tuple)) {
+                                       result += multiplicityOf(slot);
+                                     }
+                                     return false;
+                                   });
+    return {probe.first, result};
+  }
+
+  /// Slot at which a prefix lookup starts walking this layer.
+  template <typename... PrefixColumns>
+  size_t prefixStart(tuple<PrefixColumns...> const& input_tuple,
+                     size_t bucket_number_level_up) const {
+    if constexpr(ColumnIndex == 0) {
+      return homeSlot(hasher(get<ColumnIndex>(input_tuple)));
+    } else {
+      return bucket_number_level_up * BucketSize;
+    }
+  }
+
+  /// Prefetches the slot a prefix probe starts at and the bucket holding its payload.
+  template <typename... PrefixColumns>
+  void prefetchPrefix(tuple<PrefixColumns...> const& input_tuple,
+                      size_t bucket_number_level_up) const {
+    auto const slot = prefixStart(input_tuple, bucket_number_level_up);
+    prefetchSlot(keys[slot]);
+    prefetchSlot(frames[slot / BucketSize]);
+  }
+
+  /// First slot from hash_idx on, within the same run, whose tuple starts with the prefix. The
+  /// flag is false once the run ends.
+  template <typename... PrefixColumns>
+  pair<size_t, bool> nextPrefixMatch(tuple<PrefixColumns...> const& input_tuple,
+                                     size_t hash_idx) const {
+    constexpr bool matchKey = sizeof...(PrefixColumns) > ColumnIndex;
+    KeyType key = DefaultValue<KeyType>()();
+    if constexpr(matchKey) {
+      key = get<ColumnIndex>(input_tuple);
+    }
+
+    return probeRun(hash_idx, key, matchKey,
+                    [&](size_t slot) { return matches(slot, input_tuple); });
+  }
+
+  /// First slot from hash_idx on, within the same run, whose live tuple starts with the prefix
+  /// and whose key lies in [low, high]. The prefix binds the columns before this one only.
+  template <typename... PrefixColumns>
+  pair<size_t, bool> nextRangeMatch(tuple<PrefixColumns...> const& input_tuple,
+                                    KeyType const& low, KeyType const& high,
+                                    size_t hash_idx) const {
+    return rangeRun(hash_idx, low, high,
+                    [&](size_t slot) { return matches(slot, input_tuple); });
+  }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef _SONIC_FILTER_H_
+#define _SONIC_FILTER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "sonic_common.h"
+#include "sonic_persistence.h"
+#include "sonic_stats.h"
+
+using namespace std;
+
+/// Shape and, with SONIC_PROBE_STATS, traffic of the prefix filter of one prefix length.
+struct SonicFilterStats {
+  size_t prefixLength = 0;
+  size_t blocks = 0;
+  /// Bits set among all bits of the filter. False positives grow with its eighth power.
+  double fillRatio = 0;
+  /// Lookups asked of the filter and those it answered with a definite miss.
+  size_t probes = 0;
+  size_t rejections = 0;
+
+  double rejectionRate() const { return probes ? rejections / (double)probes : 0; }
+};
+
+/// Lookup counters of a prefix filter, counted with SONIC_PROBE_STATS only; see
+/// SonicProbeCounters.
+class SonicFilterCounters {
+#ifdef SONIC_PROBE_STATS
+  mutable atomic<size_t> probes{0};
+  mutable atomic<size_t> rejections{0};
+
+public:
+  SonicFilterCounters() = default;
+  SonicFilterCounters(SonicFilterCounters const& other) noexcept { *this = other; }
+
+  SonicFilterCounters& operator=(SonicFilterCounters const& other) noexcept {
+    probes.store(other.probes.load(memory_order_relaxed), memory_order_relaxed);
+    rejections.store(other.rejections.load(memory_order_relaxed), memory_order_relaxed);
+    return *this;
+  }
+
+  void record(bool rejected) const {
+    probes.fetch_add(1, memory_order_relaxed);
+    rejections.fetch_add(rejected, memory_order_relaxed);
+  }
+
+  void addTo(SonicFilterStats& stats) const {
+    stats.probes = probes.load(memory_order_relaxed);
+    stats.rejections = rejections.load(memory_order_relaxed);
+  }
+#else
+public:
+  void record(bool) const {}
+  void addTo(SonicFilterStats&) const {}
+#endif
+};
+
+/// Split-block Bloom filter over the hashes of the prefixes of one length. A hash picks one
+/// cache-line block of eight words and sets one bit in each of them, so a lookup reads one cache
+/// line and a miss is certain. Bits are never cleared: erased prefixes keep passing until the
+/// index is compacted.
+template <typename Policy> class SonicPrefixFilter {
+  typedef SlotField<uint64_t, Policy::concurrentReaders> WordSlot;
+  template <typename T> using Allocator = typename Policy::template Allocator<T>;
+  static constexpr size_t blockWords = 8;
+  static constexpr size_t bitsPerSlot = 8;
+  static constexpr uint32_t salts[blockWords] = {0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+                                                 0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31};
+
+  SlotArray<WordSlot, Allocator<WordSlot>> words;
+  size_t blocks = 0;
+  SonicFilterCounters counters;
+
+  size_t blockOf(uint64_t hash) const { return (unsigned __int128)hash * blocks >> 64; }
+
+  static uint64_t bitOf(uint64_t hash, size_t word) {
+    auto const key = (uint32_t)(hash ^ hash >> 32);
+    return uint64_t(1) << ((uint32_t)(key * salts[word]) >> 26);
+  }
+
+public:
+  SonicPrefixFilter() = default;
+
+  /// Eight bits for every slot of an index level, in at least one block.
+  explicit SonicPrefixFilter(size_t slots)
+      : blocks(max<size_t>(slots * bitsPerSlot / (64 * blockWords), 1)) {
+    words = decltype(words)(blocks * blockWords, 0);
+  }
+
+  void add(uint64_t hash) {
+    auto const first = blockOf(hash) * blockWords;
+    for(size_t w = 0; w < blockWords; w++) {
+      words[first + w] = words[first + w] | bitOf(hash, w);
+    }
+  }
+
+  /// False only if no prefix with this hash was ever added.
+  bool mayContain(uint64_t hash) const {
+    auto const first = blockOf(hash) * blockWords;
+    uint64_t missing = 0;
+    for(size_t w = 0; w < blockWords; w++) {
+      missing |= bitOf(hash, w) & ~(uint64_t)words[first + w];
+    }
+    counters.record(missing != 0);
+    return missing == 0;
+  }
+
+  SonicFilterStats stats(size_t prefixLength) const {
+    SonicFilterStats stats;
+    stats.prefixLength = prefixLength;
+    stats.blocks = blocks;
+    size_t setBits = 0;
+    for(size_t i = 0; i < words.size(); i++) {
+      setBits += __builtin_popcountll(words[i]);
+    }
+    stats.fillRatio = words.size() ? setBits / (64.0 * words.size()) : 0;
+    counters.addTo(stats);
+    return stats;
+  }
+
+  size_t memoryUsage() const { return words.memoryUsage(); }
+
+  void writeTo(SonicFileWriter& writer) const {
+    writer.value<uint64_t>(blocks);
+    writer.array(words.data(), words.size());
+  }
+
+  /// Takes its size from the file, like the runtime-sized levels it sits in front of.
+  bool mapFrom(SonicFileReader& reader) {
+    blocks = reader.value<uint64_t>();
+    mapArray(reader, words, blocks * blockWords);
+    return reader.good() && blocks > 0 && words.size() == blocks * blockWords;
+  }
+};
+
+/// Hash of the first Length columns of a tuple, the key of the prefix filter of that length.
+template <typename Policy, typename Columns, typename Tuple, size_t... Column>
+uint64_t prefixFilterHash(Tuple const& prefix, index_sequence<Column...>) {
+  uint64_t hash = sizeof...(Column);
+  ((hash = (hash + typename Policy::template Hash<tuple_element_t<Column, Columns>>()(
+                       get<Column>(prefix))) *
+           0x9E3779B97F4A7C15ull,
+    hash ^= hash >> 29),
+   ...);
+  return hash;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef _SONIC_GROWABLE_INDEX_H_
+#define _SONIC_GROWABLE_INDEX_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "sonic_index.h"
+
+using namespace std;
+
+namespace {
+/// Runtime-sized Sonic index that doubles its capacity once the level arrays reach half of their
+/// buckets. The previous generation stays readable while its level-0 home slots are migrated a
+/// few at a time on every insert; a level-0 key lives in exactly one generation, so lookups are
+/// routed by its old home slot and bucket links are rebuilt by re-inserting into the new levels.
+/// Once the current generation needs compaction, the same migration moves the index into a
+/// fresh generation of equal capacity, which leaves the tombstones behind.
+template <size_t InitialCapacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+class GrowableSonicIndex {
+  static_assert(ColumnIndex == 0, "GrowableSonicIndex is only defined for the whole tuple");
+
+  typedef SonicIndex<RuntimeCapacity, BucketSize, ColumnIndex, ColumnTypes...> Generation;
+  typedef tuple_element_t<0, tuple<ColumnTypes...>> FirstColumnType;
+
+  static constexpr size_t slotsPerTuple = 2 * BucketSize;
+  static constexpr size_t migrationStep = 4 * BucketSize;
+
+  unique_ptr<Generation> current;
+  unique_ptr<Generation> previous;
+  size_t migrationCursor;
+  size_t indexSize;
+
+  bool isMigrated(FirstColumnType const& key) const {
+    return !previous || previous->homeSlotOf(key) < migrationCursor;
+  }
+
+  Generation& generationOf(FirstColumnType const& key) {
+    return isMigrated(key) ? *current : *previous;
+  }
+
+  Generation const& generationOf(FirstColumnType const& key) const {
+    return isMigrated(key) ? *current : *previous;
+  }
+
+  void migrate(size_t homeSlots) {
+    for(auto i = 0; i < homeSlots && previous; i++) {
+      if(migrationCursor == previous->getCapacity()) {
+        previous.reset();
+        return;
+      }
+      for(auto const& key : previous->keysWithHomeSlot(migrationCursor)) {
+        for(auto const& input_tuple :
+            previous->template prefixLookup<FirstColumnType>(tuple<FirstColumnType>{key})) {
+          current->insert(input_tuple.get());
+        }
+      }
+      migrationCursor++;
+    }
+  }
+
+  void startGeneration(size_t capacity) {
+    while(previous) {
+      migrate(migrationStep);
+    }
+    previous = move(current);
+    current = make_unique<Generation>(capacity);
+    migrationCursor = 0;
+  }
+
+  void grow() { startGeneration(current->getCapacity() * 2); }
+
+public:
+  explicit GrowableSonicIndex(size_t capacity = InitialCapacity)
+      : current(make_unique<Generation>(max(capacity, slotsPerTuple))), migrationCursor(0),
+        indexSize(0) {}
+
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  GrowableSonicIndex(vector<InputSchema> const& input_data)
+      : GrowableSonicIndex(max(InitialCapacity, input_data.size() * slotsPerTuple)) {
+    for(auto const& input_tuple : input_data) {
+      insert(input_tuple);
+    }
+  }
+
+  void insert(tuple<ColumnTypes...> const& input_tuple) {
+    if(previous) {
+      migrate(migrationStep);
+    }
+    if((indexSize + 1) * slotsPerTuple > current->getCapacity()) {
+      grow();
+    }
+    generationOf(get<0>(input_tuple)).insert(input_tuple);
+    indexSize++;
+  }
+
+  /// Erases one occurrence of input_tuple. Returns the number of erased tuples.
+  size_t erase(tuple<ColumnTypes...> const& input_tuple) {
+    if(previous) {
+      migrate(migrationStep);
+    }
+    auto const erased = generationOf(get<0>(input_tuple)).erase(input_tuple);
+    indexSize -= erased;
+    if(!previous && current->needsCompaction()) {
+      startGeneration(current->getCapacity());
+    }
+    return erased;
+  }
+
+  size_t pointLookup(tuple<ColumnTypes...> const& input_tuple) {
+    return generationOf(get<0>(input_tuple)).pointLookup(input_tuple);
+  }
+
+  template <typename... PrefixColumns>
+  size_t countPrefix(tuple<PrefixColumns...> const& input_tuple) const {
+    return generationOf(get<0>(input_tuple))
+        .template countPrefix<PrefixColumns...>(input_tuple);
+  }
+
+  template <typename... PrefixColumns>
+  vector<reference_wrapper<const tuple<ColumnTypes...>>>
+  prefixLookup(tuple<PrefixColumns...> const& input_tuple) const {
+    return generationOf(get<0>(input_tuple))
+        .template prefixLookup<PrefixColumns...>(input_tuple);
+  }
+
+  vector<reference_wrapper<const tuple<ColumnTypes...>>> scan() const {
+    auto results = current->scan();
+    if(previous) {
+      for(auto tupleRef : previous->scan()) {
+        if(!isMigrated(get<0>(tupleRef.get()))) {
+          results.emplace_back(tupleRef);
+        }
+      }
+    }
+    return results;
+  }
+
+  size_t getSize() const { return indexSize; }
+
+  size_t getCapacity() const { return current->getCapacity(); }
+
+  bool isMigrating() const { return previous != nullptr; }
+};
+} // namespace
+#endif
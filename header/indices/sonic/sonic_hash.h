@@ -0,0 +1,147 @@
+#ifndef _SONIC_HASH_H_
+#define _SONIC_HASH_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <string>
+#include <type_traits>
+
+#include "../../helper_functions.h"
+#include "sonic_probe.h"
+
+using namespace std;
+
+/// Key hashes a SonicIndex policy can pick instead of CRCHash. All of them return 64 bits, which
+/// matters once a level holds more than 2^32 slots.
+
+/// CRC32 of data with seed, consuming eight bytes per instruction.
+inline uint64_t crc32Words(char const* data, size_t length, uint64_t seed) {
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    seed = _mm_crc32_u64(seed, word);
+  }
+  for(; i < length; i++) {
+    seed = _mm_crc32_u8(seed, data[i]);
+  }
+  return seed;
+}
+
+/// Two independent CRC32 streams with different seeds fill the upper and lower half of the hash.
+template <typename KeyType> struct WordCRCHash {
+  static constexpr uint64_t upperSeed = 0x9E3779B9;
+  static constexpr uint64_t lowerSeed = 0x85EBCA6B;
+
+  size_t operator()(KeyType const& key) const {
+    if constexpr(is_integral_v<KeyType>) {
+      return _mm_crc32_u64(upperSeed, key) << 32 | _mm_crc32_u64(lowerSeed, key);
+    } else {
+      return crc32Words(key.data(), key.size(), upperSeed) << 32 |
+             crc32Words(key.data(), key.size(), lowerSeed);
+    }
+  }
+};
+
+/// Multiplies integer keys by an odd 64-bit constant and folds the high half into the low one,
+/// since slots are picked by the low bits. Other keys fall back to WordCRCHash.
+template <typename KeyType> struct MultiplyShiftHash {
+  static constexpr uint64_t multiplier = 0x9E3779B97F4A7C15;
+
+  size_t operator()(KeyType const& key) const {
+    if constexpr(is_integral_v<KeyType>) {
+      uint64_t const product = (uint64_t)key * multiplier;
+      return product ^ product >> 32;
+    } else {
+      return WordCRCHash<KeyType>()(key);
+    }
+  }
+
+  void hashBatch(KeyType const* keys, size_t count, size_t* hashes) const;
+};
+
+template <typename KeyType>
+__attribute__((target("avx2"))) void multiplyShiftAVX2(KeyType const* keys, size_t count,
+                                                        size_t* hashes) {
+  constexpr uint64_t multiplier = MultiplyShiftHash<KeyType>::multiplier;
+  auto const lowFactor = _mm256_set1_epi64x(multiplier);
+  auto const highFactor = _mm256_set1_epi64x(multiplier >> 32);
+  size_t i = 0;
+  for(; i + 4 <= count; i += 4) {
+    __m256i key;
+    if constexpr(sizeof(KeyType) == 4 && is_signed_v<KeyType>) {
+      key = _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i const*)(keys + i)));
+    } else if constexpr(sizeof(KeyType) == 4) {
+      key = _mm256_cvtepu32_epi64(_mm_loadu_si128((__m128i const*)(keys + i)));
+    } else {
+      key = _mm256_loadu_si256((__m256i const*)(keys + i));
+    }
+    // Low 64 bits of key * multiplier from three 32x32-bit partial products.
+    auto const cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(key, 32), lowFactor),
+                                        _mm256_mul_epu32(key, highFactor));
+    auto const product =
+        _mm256_add_epi64(_mm256_mul_epu32(key, lowFactor), _mm256_slli_epi64(cross, 32));
+    _mm256_storeu_si256((__m256i*)(hashes + i),
+                        _mm256_xor_si256(product, _mm256_srli_epi64(product, 32)));
+  }
+  for(; i < count; i++) {
+    hashes[i] = MultiplyShiftHash<KeyType>()(keys[i]);
+  }
+}
+
+template <typename KeyType>
+void MultiplyShiftHash<KeyType>::hashBatch(KeyType const* keys, size_t count,
+                                           size_t* hashes) const {
+  static bool const avx2 = supportsProbeIsa(ProbeIsa::AVX2);
+  if constexpr(vectorisedProbe<KeyType>) {
+    if(avx2) {
+      multiplyShiftAVX2(keys, count, hashes);
+      return;
+    }
+  }
+  for(auto i = 0; i < count; i++) {
+    hashes[i] = (*this)(keys[i]);
+  }
+}
+
+template <typename Hash, typename KeyType, typename = void>
+struct BatchHashed : false_type {};
+
+template <typename Hash, typename KeyType>
+struct BatchHashed<Hash, KeyType,
+                   void_t<decltype(declval<Hash const&>().hashBatch(
+                       declval<KeyType const*>(), size_t(), declval<size_t*>()))>>
+    : true_type {};
+
+/// Hash of column Column of rows [first, last), written to the same range of hashes. Hashes with
+/// a hashBatch get the keys in blocks copied out of the rows; the others hash the rows in place.
+template <size_t Column, typename KeyType, typename Hash, typename Rows>
+void hashColumn(Rows const& rows, size_t first, size_t last, size_t* hashes) {
+  Hash const hasher = Hash();
+  if constexpr(BatchHashed<Hash, KeyType>::value && is_trivially_copyable_v<KeyType>) {
+    constexpr size_t blockSize = 256;
+    array<KeyType, blockSize> keys;
+    for(size_t begin = first; begin < last; begin += blockSize) {
+      auto const size = min(blockSize, last - begin);
+      for(auto i = 0; i < size; i++) {
+        keys[i] = get<Column>(rows[begin + i]);
+      }
+      hasher.hashBatch(keys.data(), size, hashes + begin);
+    }
+  } else {
+    for(auto i = first; i < last; i++) {
+      hashes[i] = hasher(get<Column>(rows[i]));
+    }
+  }
+}
+
+/// Hash of column Column of every row.
+template <size_t Column, typename KeyType, typename Hash, typename Rows>
+void hashColumn(Rows const& rows, size_t* hashes) {
+  hashColumn<Column, KeyType, Hash>(rows, 0, rows.size(), hashes);
+}
+
+#endif
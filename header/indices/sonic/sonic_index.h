@@ -3,48 +3,242 @@
 
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
 #include "../../helper_functions.h"
+#include "sonic_common.h"
+#include "sonic_filter.h"
+#include "sonic_compressed_leaf_layer.h"
+#include "sonic_hash.h"
 #include "sonic_leaf_layer.h"
 #include "sonic_node_layer.h"
+#include "sonic_persistence.h"
+#include "sonic_sketch.h"
 
 using namespace std;
 
 namespace {
-template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
-class SonicIndex {
+template <typename Policy, size_t Capacity, size_t BucketSize, size_t ColumnIndex,
+          typename... ColumnTypes>
+class BasicSonicIndex {
   static constexpr bool lastLevel = ((ColumnIndex + 2) == sizeof...(ColumnTypes));
-  static constexpr size_t numberOfBuckets = (size_t)(Capacity / BucketSize);
-  size_t indexSize;
+  static constexpr size_t noBucket = unassignedBucket<Capacity, BucketSize>();
+  static constexpr size_t bulkLoadPartitions = 256;
+  /// Fewest leaf slots scanPartitioned hands to a thread of its own.
+  static constexpr size_t scanSlotsPerThread = size_t(1) << 16;
+  static constexpr size_t prefetchGroupSize = 16;
+  static constexpr size_t compactionRatio = 4;
+  static constexpr size_t minimumCompaction = 64;
+  /// Slot arrays are written to disk byte for byte, which only round-trips plain columns.
+  static constexpr bool persistable =
+      !Policy::concurrentReaders && (is_trivially_copyable_v<ColumnTypes> && ...);
+  /// The prefix filters sit in front of the first level. A prefix of one column needs none,
+  /// since a miss on the first level costs a single bucket already.
+  static constexpr bool filtered = Policy::prefixFilters && ColumnIndex == 0;
+  SlotField<size_t, Policy::concurrentReaders> indexSize;
+  /// File the slot arrays of a loaded index point into; it is unmapped with the last user.
+  shared_ptr<MappedSonicFile> mapping;
 
-  class NoFurtherLevels {};
+  class NoFurtherLevels {
+  public:
+    NoFurtherLevels(size_t = 0) {}
+  };
 
   typename conditional<!lastLevel,
-                       SonicIndex<Capacity, BucketSize, ColumnIndex + 1, ColumnTypes...>,
+                       BasicSonicIndex<Policy, Capacity, BucketSize, ColumnIndex + 1,
+                                       ColumnTypes...>,
                        NoFurtherLevels>::type next_level;
 
+  typedef tuple_element_t<ColumnIndex, tuple<ColumnTypes...>> KeyType;
+  typedef typename Policy::template Hash<KeyType> Hasher;
+  /// Hash of the next column's keys, which the node sketches of this level count.
+  typedef typename Policy::template Hash<tuple_element_t<ColumnIndex + 1, tuple<ColumnTypes...>>>
+      NextHasher;
+
   typename conditional<!lastLevel,
-                       SonicLayer<Capacity, BucketSize, ColumnIndex,
-                                  CRCHash<tuple_element_t<ColumnIndex, tuple<ColumnTypes...>>>,
-                                  tuple<ColumnTypes...>>,
+                       SonicLayer<Capacity, BucketSize, ColumnIndex, Hasher,
+                                  tuple<ColumnTypes...>, Policy>,
                        NoFurtherLevels>::type node_level;
 
-  typename conditional<lastLevel,
-                       SonicTuple<Capacity, BucketSize, ColumnIndex,
-                                  CRCHash<tuple_element_t<ColumnIndex, tuple<ColumnTypes...>>>,
-                                  tuple<ColumnTypes...>>,
-                       NoFurtherLevels>::type leaf_level;
+  typedef conditional_t<Policy::compressedLeaves,
+                        CompressedSonicTuple<Capacity, BucketSize, ColumnIndex, Hasher,
+                                             tuple<ColumnTypes...>, Policy>,
+                        SonicTuple<Capacity, BucketSize, ColumnIndex, Hasher,
+                                   tuple<ColumnTypes...>, Policy>>
+      LeafLayer;
+
+  typename conditional<lastLevel, LeafLayer, NoFurtherLevels>::type leaf_level;
+
+  /// Filter i holds the prefixes of i + 2 columns.
+  conditional_t<filtered, array<SonicPrefixFilter<Policy>, sizeof...(ColumnTypes) - 1>,
+                NoFurtherLevels>
+      prefixFilters;
+
+  template <typename Tuple, size_t... Filter>
+  void addToFilters(Tuple const& input_tuple, index_sequence<Filter...>) {
+    (prefixFilters[Filter].add(prefixFilterHash<Policy, tuple<ColumnTypes...>>(
+         input_tuple, make_index_sequence<Filter + 2>())),
+     ...);
+  }
+
+  /// With concurrent readers a node becomes visible before the writer links its child chain.
+  inline bool isLinked(size_t child_bucket) const {
+    return !Policy::concurrentReaders || child_bucket != noBucket;
+  }
+
+  /// Level-0 home slot of a key hashed with Hasher.
+  size_t homeSlotOfHash(size_t hash_key) const {
+    if constexpr(lastLevel) {
+      return leaf_level.homeSlot(hash_key);
+    } else {
+      return node_level.homeSlot(hash_key);
+    }
+  }
+
+  /// Header a file saved from an index of this type starts with.
+  static SonicFileHeader fileHeader() {
+    static_assert(sizeof...(ColumnTypes) <= 16, "Sonic files describe at most 16 columns");
+    SonicFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, sonicFileMagic, sizeof(header.magic));
+    header.version = sonicFileVersion;
+    header.columns = sizeof...(ColumnTypes);
+    header.capacity = Capacity;
+    header.bucketSize = BucketSize;
+    header.flags = Policy::tupleMultiplicities | Policy::compressedLeaves << 1 |
+                   Policy::prefixSketches << 2 | Policy::prefixFilters << 3;
+    uint32_t const columnSizes[] = {sizeof(ColumnTypes)...};
+    copy(begin(columnSizes), end(columnSizes), header.columnSizes);
+    return header;
+  }
+
+  /// Cursor of the level below for a given prefix. Columns the prefix does not bind are bound to
+  /// the key of the node the child hangs off, so the level below can filter on them.
+  template <typename NextLevel, typename... PrefixColumns> static auto childCursorOf() {
+    if constexpr(lastLevel) {
+      return NoFurtherLevels();
+    } else if constexpr(sizeof...(PrefixColumns) <= ColumnIndex) {
+      return typename NextLevel::template PrefixCursor<PrefixColumns..., KeyType>();
+    } else {
+      return typename NextLevel::template PrefixCursor<PrefixColumns...>();
+    }
+  }
 
 public:
+  /// What lookups and scans yield for a tuple: a reference to the stored tuple, or a decoded copy
+  /// of it when the leaves are compressed.
+  typedef conditional_t<Policy::compressedLeaves, tuple<ColumnTypes...>,
+                        reference_wrapper<const tuple<ColumnTypes...>>>
+      TupleResult;
+  /// Whether nodes sketch the keys below them, so that estimatePrefix avoids the leaf chains.
+  static constexpr bool sketchedPrefixes = Policy::prefixSketches;
+  /// Whether a Bloom filter per prefix length rejects lookups of absent prefixes.
+  static constexpr bool filteredPrefixes = Policy::prefixFilters;
+
+  /// Walks the tuples starting with a prefix lazily, one bucket run per level, yielding them in
+  /// prefixLookup order. A cursor holds one run position per level and never allocates.
+  template <typename... PrefixColumns> class PrefixCursor {
+    typedef decltype(childCursorOf<decltype(next_level), PrefixColumns...>()) ChildCursor;
+
+    BasicSonicIndex const* index = nullptr;
+    tuple<PrefixColumns...> prefix;
+    size_t chain = noBucket;
+    size_t slot = 0;
+    bool found = false;
+    ChildCursor child;
+
+    /// Moves to the first slot from match on whose subtree still yields a tuple.
+    void settle(pair<size_t, bool> match) {
+      if constexpr(lastLevel) {
+        tie(slot, found) = match;
+      } else {
+        auto const& layer = index->node_level;
+        for(; match.second;
+            match = layer.nextPrefixMatch(prefix, chain, layer.nextSlot(match.first))) {
+          auto const child_bucket = layer.getChildBucket(match.first);
+          if(!index->isLinked(child_bucket)) {
+            continue;
+          }
+          if constexpr(sizeof...(PrefixColumns) <= ColumnIndex) {
+            child = ChildCursor(index->next_level,
+                                tuple_cat(prefix, make_tuple(layer.getKeyByIndex(match.first))),
+                                child_bucket);
+          } else {
+            child = ChildCursor(index->next_level, prefix, child_bucket);
+          }
+          if(child.valid()) {
+            slot = match.first;
+            found = true;
+            return;
+          }
+        }
+        found = false;
+      }
+    }
+
+  public:
+    PrefixCursor() = default;
+
+    PrefixCursor(BasicSonicIndex const& index_, tuple<PrefixColumns...> const& prefix_,
+                 size_t bucket_number_level_up = noBucket)
+        : index(&index_), prefix(prefix_), chain(bucket_number_level_up) {
+      if constexpr(lastLevel) {
+        auto const& layer = index->leaf_level;
+        settle(layer.nextPrefixMatch(prefix, layer.prefixStart(prefix, chain)));
+      } else {
+        auto const& layer = index->node_level;
+        settle(layer.nextPrefixMatch(prefix, chain, layer.prefixStart(prefix, chain)));
+      }
+    }
+
+    bool valid() const { return found; }
+
+    /// Copies of the current tuple; always one unless the policy keeps multiplicities.
+    size_t multiplicity() const {
+      if constexpr(lastLevel) {
+        return index->leaf_level.multiplicityOf(slot);
+      } else {
+        return child.multiplicity();
+      }
+    }
+
+    /// The current tuple, decoded into a copy when the leaves are compressed.
+    decltype(auto) operator*() const {
+      if constexpr(lastLevel) {
+        return index->leaf_level.getTupleByIndex(slot);
+      } else {
+        return *child;
+      }
+    }
+
+    void next() {
+      if constexpr(lastLevel) {
+        auto const& layer = index->leaf_level;
+        settle(layer.nextPrefixMatch(prefix, layer.nextSlot(slot)));
+      } else {
+        child.next();
+        if(!child.valid()) {
+          auto const& layer = index->node_level;
+          settle(layer.nextPrefixMatch(prefix, chain, layer.nextSlot(slot)));
+        }
+      }
+    }
+  };
+
   /////////////////////////////////////////////// LAST LEVEL /////////////////
   template <typename Tuple = tuple<ColumnTypes...>>
-  inline pair<SonicLeaf<ColumnIndex, Tuple>&, size_t>
-  insert(typename enable_if<lastLevel, Tuple const&>::type input_tuple,
-         size_t bucket_number_level_up = numberOfBuckets, size_t hash_key_level_up = 0) {
+  inline auto insert(typename enable_if<lastLevel, Tuple const&>::type input_tuple,
+                     size_t bucket_number_level_up = noBucket, size_t hash_key_level_up = 0) {
+    if constexpr(filtered) {
+      addToFilters(input_tuple, make_index_sequence<sizeof...(ColumnTypes) - 1>());
+    }
     indexSize++;
     return leaf_level.insert(input_tuple, bucket_number_level_up);
   }
@@ -52,50 +246,51 @@ public:
   template <typename... PrefixColumns>
   inline pair<size_t, size_t> computeMatchedPrefix(
       typename enable_if<lastLevel, tuple<PrefixColumns...> const&>::type input_tuple,
-      size_t bucket_number_level_up = numberOfBuckets) const {
+      size_t bucket_number_level_up = noBucket) const {
     if constexpr(ColumnIndex + 1 <= sizeof...(PrefixColumns)) {
       return leaf_level.template countPrefix<PrefixColumns...>(input_tuple, bucket_number_level_up);
     }
   }
 
   template <typename Tuple = tuple<ColumnTypes...>>
-  inline pair<SonicLeaf<ColumnIndex, Tuple>&, size_t>
-  find(typename enable_if<lastLevel, Tuple const&>::type input_tuple,
-       size_t bucket_number_level_up = numberOfBuckets) {
+  inline auto find(typename enable_if<lastLevel, Tuple const&>::type input_tuple,
+                   size_t bucket_number_level_up = noBucket) {
     return leaf_level.pointLookup(input_tuple, bucket_number_level_up);
   }
 
-  template <typename... PrefixColumns>
-  inline vector<reference_wrapper<const tuple<ColumnTypes...>>>
-  prefixLookup(enable_if_t<lastLevel, tuple<PrefixColumns...> const&> input_tuple,
-               size_t bucket_number_level_up = numberOfBuckets) const {
-    auto resultTupleIndices =
-        leaf_level.template prefixLookup<PrefixColumns...>(input_tuple, bucket_number_level_up);
-
-    vector<reference_wrapper<const tuple<ColumnTypes...>>> resultTuples;
-    resultTuples.reserve(resultTupleIndices.size());
-    for(auto idx : resultTupleIndices) {
-      resultTuples.emplace_back(leaf_level.getTupleByIndex(idx));
-    }
-    return resultTuples;
+  template <typename Tuple = tuple<ColumnTypes...>>
+  inline size_t erase(typename enable_if<lastLevel, Tuple const&>::type input_tuple,
+                      size_t bucket_number_level_up = noBucket) {
+    static_assert(!Policy::concurrentReaders, "Erasing would race with concurrent readers");
+    auto const erased = leaf_level.erase(input_tuple, bucket_number_level_up);
+    indexSize -= erased;
+    return erased;
   }
+
   ////////////////////////////////////////////////////////////////////////
 
   ///////////////////////////////// INNER LEVEL //////////////////////////
   template <typename Tuple = tuple<ColumnTypes...>>
-  inline pair<SonicNode<tuple_element_t<ColumnIndex, Tuple>>&, size_t>
-  insert(enable_if_t<!lastLevel, Tuple const&> input_tuple,
-         size_t bucket_number_level_up = numberOfBuckets) {
+  inline pair<size_t, size_t> insert(enable_if_t<!lastLevel, Tuple const&> input_tuple,
+                                     size_t bucket_number_level_up = noBucket) {
+    if constexpr(filtered) {
+      addToFilters(input_tuple, make_index_sequence<sizeof...(ColumnTypes) - 1>());
+    }
+    indexSize++;
     auto entry = node_level.insert(input_tuple, bucket_number_level_up);
-    entry.first.bucket_number_level_down =
-        (next_level.insert(input_tuple, entry.first.bucket_number_level_down)).second;
+    if constexpr(Policy::prefixSketches) {
+      node_level.sketchKey(entry.first, NextHasher()(get<ColumnIndex + 1>(input_tuple)));
+    }
+    node_level.setChildBucket(
+        entry.first,
+        (next_level.insert(input_tuple, node_level.getChildBucket(entry.first))).second);
     return entry;
   }
 
   template <typename... PrefixColumns>
   inline pair<size_t, size_t>
   computeMatchedPrefix(enable_if_t<!lastLevel, tuple<PrefixColumns...> const&> input_tuple,
-                       size_t bucket_number_level_up = numberOfBuckets) const {
+                       size_t bucket_number_level_up = noBucket) const {
     auto entry =
         node_level.template countPrefix<PrefixColumns...>(input_tuple, bucket_number_level_up);
 
@@ -103,82 +298,952 @@ public:
 
     if(entry.second > 0) {
       if constexpr(ColumnIndex + 1 < sizeof...(PrefixColumns)) {
-        auto node = node_level.getNodeByIndex(entry.first);
-        resultCount = next_level
-                          .template computeMatchedPrefix<PrefixColumns...>(
-                              input_tuple, node.bucket_number_level_down)
-                          .second;
+        auto const child_bucket = node_level.getChildBucket(entry.first);
+        if(!isLinked(child_bucket)) {
+          return {entry.first, 0};
+        }
+        resultCount =
+            next_level.template computeMatchedPrefix<PrefixColumns...>(input_tuple, child_bucket)
+                .second;
       }
     }
     return {entry.first, resultCount};
   }
 
   template <typename Tuple = tuple<ColumnTypes...>>
-  inline pair<SonicNode<tuple_element_t<ColumnIndex, Tuple>>&, size_t>
-  find(enable_if_t<!lastLevel, Tuple const&> input_tuple,
-       size_t bucket_number_level_up = numberOfBuckets) {
+  inline pair<size_t, size_t> find(enable_if_t<!lastLevel, Tuple const&> input_tuple,
+                                   size_t bucket_number_level_up = noBucket) {
     auto entry = node_level.pointLookup(input_tuple, bucket_number_level_up);
-    entry.second =
-        entry.second && next_level.find(input_tuple, entry.first.bucket_number_level_down).second;
+    if(entry.second) {
+      auto const child_bucket = node_level.getChildBucket(entry.first);
+      entry.second = isLinked(child_bucket) && next_level.find(input_tuple, child_bucket).second;
+    }
 
     return entry;
   }
 
+  /// Erases one occurrence of input_tuple and decrements the prefix count of every node on its
+  /// path. Returns the number of erased tuples.
+  template <typename Tuple = tuple<ColumnTypes...>>
+  inline size_t erase(enable_if_t<!lastLevel, Tuple const&> input_tuple,
+                      size_t bucket_number_level_up = noBucket) {
+    static_assert(!Policy::concurrentReaders, "Erasing would race with concurrent readers");
+    auto const entry = node_level.pointLookup(input_tuple, bucket_number_level_up);
+    if(!entry.second ||
+       next_level.erase(input_tuple, node_level.getChildBucket(entry.first)) == 0) {
+      return 0;
+    }
+    node_level.releaseNode(entry.first);
+    indexSize--;
+    return 1;
+  }
+
+  /// One level of countPrefixBatch for a group of prefixes: the start of every live probe is
+  /// prefetched before any of them runs, so their cache misses overlap. A zero result marks a
+  /// finished probe; buckets carries each probe's chain down to the next level.
+  template <typename... PrefixColumns>
+  void computeMatchedPrefixGroup(tuple<PrefixColumns...> const* input_tuples, size_t size,
+                                 size_t* buckets, size_t* results) const {
+    for(auto i = 0; i < size; i++) {
+      if(results[i] > 0) {
+        if constexpr(lastLevel) {
+          leaf_level.prefetchPrefix(input_tuples[i], buckets[i]);
+        } else {
+          node_level.prefetchPrefix(input_tuples[i], buckets[i]);
+        }
+      }
+    }
+
+    for(auto i = 0; i < size; i++) {
+      if(results[i] == 0) {
+        continue;
+      }
+      if constexpr(lastLevel) {
+        results[i] =
+            leaf_level.template countPrefix<PrefixColumns...>(input_tuples[i], buckets[i]).second;
+      } else {
+        auto entry =
+            node_level.template countPrefix<PrefixColumns...>(input_tuples[i], buckets[i]);
+        results[i] = entry.second;
+        if constexpr(ColumnIndex + 1 < sizeof...(PrefixColumns)) {
+          if(entry.second > 0) {
+            buckets[i] = node_level.getChildBucket(entry.first);
+            if(!isLinked(buckets[i])) {
+              results[i] = 0;
+            }
+          }
+        }
+      }
+    }
+
+    if constexpr(!lastLevel && ColumnIndex + 1 < sizeof...(PrefixColumns)) {
+      next_level.computeMatchedPrefixGroup(input_tuples, size, buckets, results);
+    }
+  }
+
+  /// Whether tuples starting with prefix may be stored. Always true without prefix filters or for
+  /// prefixes of fewer than two columns; otherwise false means that none is, at one cache line.
+  template <typename... PrefixColumns>
+  bool mayContainPrefix(tuple<PrefixColumns...> const& prefix) const {
+    if constexpr(filtered && sizeof...(PrefixColumns) > 1) {
+      return prefixFilters[sizeof...(PrefixColumns) - 2].mayContain(
+          prefixFilterHash<Policy, tuple<ColumnTypes...>>(
+              prefix, index_sequence_for<PrefixColumns...>()));
+    } else {
+      return true;
+    }
+  }
+
   template <typename Tuple = tuple<ColumnTypes...>> size_t pointLookup(Tuple input_tuple) {
+    if(!mayContainPrefix(input_tuple)) {
+      return 0;
+    }
     return find(input_tuple).second;
   }
 
   template <typename... PrefixColumns>
   size_t countPrefix(tuple<PrefixColumns...> const& input_tuple) const {
+    if(!mayContainPrefix(input_tuple)) {
+      return 0;
+    }
     return computeMatchedPrefix<PrefixColumns...>(input_tuple).second;
   }
 
+  /// countPrefix of every tuple in input_tuples. The probes advance level by level across small
+  /// groups of prefixes with their next bucket prefetched, instead of one prefix at a time.
   template <typename... PrefixColumns>
-  inline vector<reference_wrapper<const tuple<ColumnTypes...>>>
-  prefixLookup(enable_if_t<!lastLevel, tuple<PrefixColumns...> const&> input_tuple,
-               size_t bucket_number_level_up = numberOfBuckets) const {
-    vector<reference_wrapper<const tuple<ColumnTypes...>>> resultTuples;
+  vector<size_t> countPrefixBatch(vector<tuple<PrefixColumns...>> const& input_tuples) const {
+    vector<size_t> results(input_tuples.size(), 1);
+    if constexpr(filtered) {
+      for(auto i = 0; i < input_tuples.size(); i++) {
+        results[i] = mayContainPrefix(input_tuples[i]);
+      }
+    }
+    array<size_t, prefetchGroupSize> buckets;
 
-    auto resultNodesIndices =
-        node_level.template prefixLookup<PrefixColumns...>(input_tuple, bucket_number_level_up);
+    for(size_t begin = 0; begin < input_tuples.size(); begin += prefetchGroupSize) {
+      buckets.fill(noBucket);
+      computeMatchedPrefixGroup(input_tuples.data() + begin,
+                                min(prefetchGroupSize, input_tuples.size() - begin),
+                                buckets.data(), results.data() + begin);
+    }
+    return results;
+  }
 
-    for(auto node_index : resultNodesIndices) {
-      auto node = node_level.getNodeByIndex(node_index);
+  /// Tuple count and sketch of the node on level Length - 1 that holds the first Length columns
+  /// of prefix, or zeros if there is none.
+  template <size_t Length, typename... PrefixColumns>
+  pair<size_t, SonicSketch> prefixNode(tuple<PrefixColumns...> const& prefix,
+                                       size_t bucket_number_level_up = noBucket) const {
+    auto const entry = node_level.countPrefix(prefix, bucket_number_level_up);
+    if(entry.second == 0) {
+      return {0, 0};
+    }
+    if constexpr(ColumnIndex + 1 < Length) {
+      auto const child_bucket = node_level.getChildBucket(entry.first);
+      if(!isLinked(child_bucket)) {
+        return {0, 0};
+      }
+      return next_level.template prefixNode<Length>(prefix, child_bucket);
+    } else {
+      return {entry.second, node_level.sketchOf(entry.first)};
+    }
+  }
 
-      vector<reference_wrapper<const tuple<ColumnTypes...>>> nextLevelResult;
+  /// countPrefix for planning. Prefixes that end on a node level are counted exactly from their
+  /// node. With a sketching policy, prefixes reaching the leaves are estimated from the node
+  /// above them instead, as its tuples shared evenly among the distinct leaf keys its sketch has
+  /// seen, so no leaf chain is walked; other policies count them exactly.
+  template <typename... PrefixColumns>
+  double estimatePrefix(tuple<PrefixColumns...> const& prefix) const {
+    constexpr size_t columns = sizeof...(ColumnTypes);
+    constexpr size_t length = sizeof...(PrefixColumns);
+    if(!mayContainPrefix(prefix)) {
+      return 0;
+    }
+    if constexpr(!Policy::prefixSketches || columns < 3 || length + 1 < columns) {
+      return countPrefix(prefix);
+    } else {
+      auto const parent = prefixNode<columns - 2>(prefix);
+      if(parent.first == 0) {
+        return 0;
+      }
+      auto const estimate = parent.first / max(sketchEstimate(parent.second), 1.0);
+      if constexpr(length == columns && !Policy::tupleMultiplicities) {
+        return min(estimate, 1.0);
+      }
+      return estimate;
+    }
+  }
 
-      if constexpr(sizeof...(PrefixColumns) <= ColumnIndex) {
-        auto newPrefix = tuple_cat(input_tuple, make_tuple(node.key));
-        nextLevelResult = next_level.template prefixLookup<PrefixColumns..., decltype(node.key)>(
-            newPrefix, node.bucket_number_level_down);
-      } else {
-        nextLevelResult = next_level.template prefixLookup<PrefixColumns...>(
-            input_tuple, node.bucket_number_level_down);
+  /// Estimated number of distinct values of the column after the prefix among the tuples that
+  /// start with it, read from the sketch of the prefix's node. Below the leaf key every tuple of a
+  /// set differs in the last column, so the estimate is that of estimatePrefix.
+  template <typename... PrefixColumns>
+  double estimateDistinct(tuple<PrefixColumns...> const& prefix) const {
+    static_assert(Policy::prefixSketches, "Distinct estimates need a sketching policy");
+    static_assert(sizeof...(PrefixColumns) > 0 && sizeof...(PrefixColumns) < sizeof...(ColumnTypes),
+                  "The prefix must leave a column to count");
+    if constexpr(sizeof...(PrefixColumns) + 1 < sizeof...(ColumnTypes)) {
+      auto const node = prefixNode<sizeof...(PrefixColumns)>(prefix);
+      return node.first == 0 ? 0 : max(sketchEstimate(node.second), 1.0);
+    } else {
+      return estimatePrefix(prefix);
+    }
+  }
+
+  /// Drains a PrefixCursor; prefer the cursor itself for large fan-outs.
+  template <typename... PrefixColumns>
+  inline vector<TupleResult>
+  prefixLookup(enable_if_t<(sizeof...(PrefixColumns) <= sizeof...(ColumnTypes)),
+                           tuple<PrefixColumns...> const&>
+                   input_tuple,
+               size_t bucket_number_level_up = noBucket) const {
+    vector<TupleResult> resultTuples;
+    for(auto cursor = prefixCursor(input_tuple, bucket_number_level_up); cursor.valid();
+        cursor.next()) {
+      resultTuples.emplace_back(*cursor);
+    }
+    return resultTuples;
+  }
+
+  /// Every tuple starting with the prefix once, paired with its number of copies.
+  template <typename... PrefixColumns>
+  vector<pair<TupleResult, size_t>>
+  prefixLookupWithMultiplicities(tuple<PrefixColumns...> const& input_tuple) const {
+    vector<pair<TupleResult, size_t>> resultTuples;
+    for(auto cursor = prefixCursor(input_tuple); cursor.valid(); cursor.next()) {
+      resultTuples.emplace_back(*cursor, cursor.multiplicity());
+    }
+    return resultTuples;
+  }
+
+  template <typename... PrefixColumns>
+  PrefixCursor<decay_t<PrefixColumns>...>
+  prefixCursor(tuple<PrefixColumns...> const& input_tuple,
+               size_t bucket_number_level_up = noBucket) const {
+    if(!mayContainPrefix(input_tuple)) {
+      return PrefixCursor<decay_t<PrefixColumns>...>();
+    }
+    return PrefixCursor<decay_t<PrefixColumns>...>(*this, input_tuple, bucket_number_level_up);
+  }
+
+  /// Counts the tuples that start with prefix and whose next column lies in [low, high], with
+  /// their copies, and appends each of them once to results unless it is null. Levels above the
+  /// range column probe for the prefix; the level keyed by it filters its bucket chain on the
+  /// range, a cache line of keys per compare, and takes node counts or whole subtrees from there.
+  template <typename... PrefixColumns, typename RangeKey>
+  size_t matchPrefixRange(tuple<PrefixColumns...> const& prefix, RangeKey const& low,
+                          RangeKey const& high, vector<TupleResult>* results,
+                          size_t bucket_number_level_up = noBucket) const {
+    constexpr size_t rangeColumn = sizeof...(PrefixColumns);
+    size_t count = 0;
+    if constexpr(lastLevel && rangeColumn == ColumnIndex) {
+      auto const& layer = leaf_level;
+      auto const start = layer.prefixStart(prefix, bucket_number_level_up);
+      auto match = layer.nextRangeMatch(prefix, low, high, start);
+      for(; match.second;
+          match = layer.nextRangeMatch(prefix, low, high, layer.nextSlot(match.first))) {
+        count += layer.multiplicityOf(match.first);
+        if(results) {
+          results->emplace_back(layer.getTupleByIndex(match.first));
+        }
+      }
+    } else if constexpr(lastLevel) {
+      auto const& layer = leaf_level;
+      auto match = layer.nextPrefixMatch(prefix, layer.prefixStart(prefix, bucket_number_level_up));
+      for(; match.second; match = layer.nextPrefixMatch(prefix, layer.nextSlot(match.first))) {
+        auto const& stored = layer.getTupleByIndex(match.first);
+        if(!(get<rangeColumn>(stored) < low) && !(high < get<rangeColumn>(stored))) {
+          count += layer.multiplicityOf(match.first);
+          if(results) {
+            results->emplace_back(stored);
+          }
+        }
       }
+    } else if constexpr(rangeColumn == ColumnIndex) {
+      auto const& layer = node_level;
+      auto const chain = bucket_number_level_up;
+      auto match = layer.nextRangeMatch(chain, low, high, layer.prefixStart(prefix, chain));
+      for(; match.second;
+          match = layer.nextRangeMatch(chain, low, high, layer.nextSlot(match.first))) {
+        auto const child_bucket = layer.getChildBucket(match.first);
+        auto const extended = tuple_cat(prefix, make_tuple(layer.getKeyByIndex(match.first)));
+        if(!isLinked(child_bucket)) {
+          continue;
+        }
+        count += layer.countOf(match.first);
+        if(results) {
+          for(auto cursor = next_level.prefixCursor(extended, child_bucket); cursor.valid();
+              cursor.next()) {
+            results->emplace_back(*cursor);
+          }
+        }
+      }
+    } else {
+      auto const entry = node_level.countPrefix(prefix, bucket_number_level_up);
+      if(entry.second > 0) {
+        auto const child_bucket = node_level.getChildBucket(entry.first);
+        if(isLinked(child_bucket)) {
+          count = next_level.matchPrefixRange(prefix, low, high, results, child_bucket);
+        }
+      }
+    }
+    return count;
+  }
 
-      resultTuples.insert(resultTuples.end(), nextLevelResult.begin(), nextLevelResult.end());
+  /// Tuples that start with the prefix and whose next column lies in [low, high], each once. The
+  /// first column is hashed, so the prefix binds at least that one.
+  template <typename... PrefixColumns>
+  vector<TupleResult> prefixRangeLookup(
+      tuple<PrefixColumns...> const& prefix,
+      tuple_element_t<sizeof...(PrefixColumns), tuple<ColumnTypes...>> const& low,
+      tuple_element_t<sizeof...(PrefixColumns), tuple<ColumnTypes...>> const& high) const {
+    static_assert(sizeof...(PrefixColumns) > 0, "Ranges need an equality prefix");
+    vector<TupleResult> resultTuples;
+    if(mayContainPrefix(prefix)) {
+      matchPrefixRange(prefix, low, high, &resultTuples);
     }
     return resultTuples;
   }
 
+  /// Number of tuples prefixRangeLookup finds, counting every copy. Nodes on the range column
+  /// contribute their counts, so the levels below it are never visited.
+  template <typename... PrefixColumns>
+  size_t prefixRangeCount(
+      tuple<PrefixColumns...> const& prefix,
+      tuple_element_t<sizeof...(PrefixColumns), tuple<ColumnTypes...>> const& low,
+      tuple_element_t<sizeof...(PrefixColumns), tuple<ColumnTypes...>> const& high) const {
+    static_assert(sizeof...(PrefixColumns) > 0, "Ranges need an equality prefix");
+    return mayContainPrefix(prefix) ? matchPrefixRange(prefix, low, high, nullptr) : 0;
+  }
+
   template <typename InputSchema = tuple<ColumnTypes...>>
-  SonicIndex(vector<InputSchema> const& input_data) {
+  BasicSonicIndex(vector<InputSchema> const& input_data, size_t capacity = Capacity)
+      : BasicSonicIndex(capacity) {
     for(auto const& input_tuple : input_data) {
       insert<InputSchema>(input_tuple);
     }
   };
 
-  SonicIndex() { indexSize = 0; };
+  explicit BasicSonicIndex(size_t capacity = Capacity)
+      : indexSize(0), next_level(capacity), node_level(capacity), leaf_level(capacity) {
+    if constexpr(filtered) {
+      prefixFilters.fill(SonicPrefixFilter<Policy>(capacity));
+    }
+  };
+
+  /// Elements make(home, row) for the rows of input_data, radix-partitioned by the top bits of
+  /// their level-0 home slots into at most bulkLoadPartitions ranges and radix-sorted by home slot
+  /// inside each, rows sharing a home slot in input order. offsets receives where each partition
+  /// starts, followed by the number of rows. Rows are hashed, scattered and sorted on threads,
+  /// and each partition is passed to sorted(p, elements) by its thread while still in cache.
+  template <typename Element, typename InputSchema, typename Make, typename Sorted>
+  vector<Element> partitionByHomeSlot(vector<InputSchema> const& input_data, size_t threads,
+                                      vector<size_t>& offsets, Make&& make,
+                                      Sorted&& sorted) const {
+    size_t partitionBits = 0;
+    while((getCapacity() - 1) >> partitionBits >= bulkLoadPartitions) {
+      partitionBits++;
+    }
+    threads = max(threads, (size_t)1);
+    auto const rowCount = input_data.size();
+    vector<Element> homes(rowCount);
+    // Every element is written before it is read, so they are left uninitialised.
+    unique_ptr<size_t[]> rowHomes(new size_t[rowCount]);
+    // Each thread hashes a block of rows and counts them per partition, and later scatters them
+    // to a range of each partition of its own, behind those of the blocks before it.
+    vector<vector<size_t>> cursors(threads, vector<size_t>(bulkLoadPartitions, 0));
+    onThreads(threads, [&](size_t t) {
+      auto const end = rowCount * (t + 1) / threads;
+      hashColumn<ColumnIndex, KeyType, Hasher>(input_data, rowCount * t / threads, end,
+                                               rowHomes.get());
+      for(auto i = rowCount * t / threads; i < end; i++) {
+        rowHomes[i] = homeSlotOfHash(rowHomes[i]);
+        cursors[t][rowHomes[i] >> partitionBits]++;
+      }
+    });
+    offsets.assign(bulkLoadPartitions + 1, 0);
+    for(auto p = 0; p < bulkLoadPartitions; p++) {
+      offsets[p + 1] = offsets[p];
+      for(auto& threadCursors : cursors) {
+        auto const rows = threadCursors[p];
+        threadCursors[p] = offsets[p + 1];
+        offsets[p + 1] += rows;
+      }
+    }
+    onThreads(threads, [&](size_t t) {
+      for(auto i = rowCount * t / threads; i < rowCount * (t + 1) / threads; i++) {
+        homes[cursors[t][rowHomes[i] >> partitionBits]++] = make(rowHomes[i], i);
+      }
+    });
+
+    onThreads(threads, [&](size_t firstPartition) {
+      constexpr size_t radixBits = 9;
+      constexpr size_t radixMask = (1 << radixBits) - 1;
+      vector<Element> scratch;
+      vector<size_t> histogram(radixMask + 2);
+
+      for(auto p = firstPartition; p < bulkLoadPartitions; p += threads) {
+        auto const begin = offsets[p];
+        auto const size = offsets[p + 1] - begin;
+        auto const partitionBase = p << partitionBits;
+        scratch.resize(max(scratch.size(), size));
+
+        auto* from = homes.data() + begin;
+        auto* to = scratch.data();
+        for(size_t shift = 0; shift < partitionBits; shift += radixBits) {
+          fill(histogram.begin(), histogram.end(), 0);
+          for(auto i = 0; i < size; i++) {
+            histogram[((from[i].first - partitionBase) >> shift & radixMask) + 1]++;
+          }
+          for(auto d = 0; d < radixMask + 1; d++) {
+            histogram[d + 1] += histogram[d];
+          }
+          for(auto i = 0; i < size; i++) {
+            to[histogram[(from[i].first - partitionBase) >> shift & radixMask]++] = from[i];
+          }
+          swap(from, to);
+        }
+        if(from != homes.data() + begin) {
+          copy(from, from + size, homes.data() + begin);
+        }
+        sorted(p, homes.data());
+      }
+    });
+    return homes;
+  }
+
+  /// Insertion order for bulkLoad where it cannot lay the levels out directly: sorted by level-0
+  /// home slot as in partitionByHomeSlot, so every level fills its buckets front to back.
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  vector<size_t> bulkLoadOrder(vector<InputSchema> const& input_data, size_t threads = 1) const {
+    vector<size_t> offsets;
+    auto const homes = partitionByHomeSlot<pair<size_t, size_t>>(
+        input_data, threads, offsets, [](size_t home, size_t row) { return make_pair(home, row); },
+        [](size_t, pair<size_t, size_t>*) {});
+    vector<size_t> order;
+    order.reserve(homes.size());
+    for(auto const& home : homes) {
+      order.emplace_back(home.second);
+    }
+    return order;
+  }
+
+  /// Loads input_data into an empty index by writing the layout of every level directly, without
+  /// probing. The rows are partitioned by home slot as in partitionByHomeSlot and sorted by tuple
+  /// inside each home slot, which makes the rows of every prefix adjacent. A first pass over each
+  /// partition sizes its chains as soon as it is sorted, so that partitions get disjoint bucket
+  /// ranges on every level, and a second one writes them; both run in parallel across
+  /// partitions. A chain starts at a bucket of its own and ends in an empty slot, so no two chains
+  /// share a bucket and none needs patch keys. Compressed leaves and indexes that hold tuples
+  /// already are filled by inserting in bulkLoadOrder instead.
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  void bulkLoad(vector<InputSchema> const& input_data, size_t threads = 1) {
+    if constexpr(!Policy::compressedLeaves) {
+      if(getSize() == 0 && tombstoneCount() == 0 && !mapping) {
+        bulkBuild(input_data, max(threads, (size_t)1));
+        return;
+      }
+    }
+    for(auto i : bulkLoadOrder(input_data, threads)) {
+      insert<InputSchema>(input_data[i]);
+    }
+  }
+
+  /// A row of a bulk build, after its level-0 home slot.
+  typedef pair<size_t, tuple<ColumnTypes...>> BulkRow;
+  /// Chain bucket cursors of a bulk build, one per level; level 0 has no chains.
+  typedef array<size_t, sizeof...(ColumnTypes) - 1> BulkCursors;
+
+  /// The direct layout of bulkLoad. Rows holding an empty key cannot be told from empty slots,
+  /// and inputs whose chains outgrow a level do not fit the layout; both are inserted instead.
+  template <typename InputSchema>
+  void bulkBuild(vector<InputSchema> const& input_data, size_t threads) {
+    struct BulkPartition {
+      /// End of the rows that are laid out; they start at the partition's offset.
+      size_t end = 0;
+      /// Groups on level 0.
+      size_t groups = 0;
+      /// Buckets the chains need on each level, then the first bucket they start at.
+      BulkCursors cursors{};
+      vector<tuple<ColumnTypes...>> emptyKeyRows;
+    };
+    // The first row of every level-0 group keeps the group's slot, its home slot until the slots
+    // are placed; the other rows of the group are marked with inGroup.
+    auto constexpr inGroup = numeric_limits<size_t>::max();
+    vector<size_t> offsets;
+    vector<BulkPartition> partitions(bulkLoadPartitions);
+    // Sizing pass: the rows of every home slot are sorted, and their groups on level 0 are walked
+    // without writing, which counts the buckets of the chains below them.
+    auto rows = partitionByHomeSlot<BulkRow>(
+        input_data, threads, offsets,
+        [&](size_t home, size_t row) { return BulkRow(home, input_data[row]); },
+        [&](size_t p, BulkRow* sorted) {
+          auto& partition = partitions[p];
+          partition.end = offsets[p];
+          for(auto i = offsets[p]; i < offsets[p + 1];) {
+            auto const run = partition.end;
+            auto const home = sorted[i].first;
+            for(; i < offsets[p + 1] && sorted[i].first == home; i++) {
+              if(hasEmptyKey(sorted[i].second,
+                             make_index_sequence<sizeof...(ColumnTypes) - 1>())) {
+                partition.emptyKeyRows.emplace_back(sorted[i].second);
+              } else if(partition.end++ != i) {
+                sorted[partition.end - 1] = sorted[i];
+              }
+            }
+            if(partition.end - run > 1) {
+              sort(sorted + run, sorted + partition.end);
+            }
+            for(auto group = run; group < partition.end;) {
+              auto const next = bulkGroupEnd(sorted, group, partition.end);
+              for(auto row = group + 1; row < next; row++) {
+                sorted[row].first = inGroup;
+              }
+              partition.groups++;
+              bulkNode<false>(sorted, group, next, 0, partition.cursors);
+              group = next;
+            }
+          }
+        });
+
+    // On the levels below level 0, the partitions take consecutive bucket ranges. A lookup of an
+    // absent key needs an empty slot to stop at on level 0.
+    auto const slots = getCapacity();
+    BulkCursors used{};
+    size_t groups = 0;
+    for(auto& partition : partitions) {
+      for(auto level = 1; level < used.size(); level++) {
+        auto const buckets = partition.cursors[level];
+        partition.cursors[level] = used[level];
+        used[level] += buckets;
+      }
+      groups += partition.groups;
+    }
+    auto fits = groups < slots;
+    for(auto level = 1; level < used.size(); level++) {
+      fits = fits && used[level] <= slots / BucketSize;
+    }
+    if(!fits) {
+      for(auto p = 0; p < bulkLoadPartitions; p++) {
+        for(auto i = offsets[p]; i < partitions[p].end; i++) {
+          insert(rows[i].second);
+        }
+      }
+    } else {
+      // Level-0 groups take the first slot from their home slot on that no earlier group took.
+      // Groups pushed past the last slot wrap around to the first free slots. A level-0 leaf
+      // marks its occupied buckets here, in slot order.
+      size_t next_slot = 0;
+      vector<size_t*> wrapped;
+      for(auto p = 0; p < bulkLoadPartitions; p++) {
+        for(auto i = offsets[p]; i < partitions[p].end; i++) {
+          auto& slot = rows[i].first;
+          if(slot != inGroup) {
+            slot = max(slot, next_slot);
+            next_slot = slot + 1;
+            if(slot >= slots) {
+              wrapped.emplace_back(&slot);
+            } else if constexpr(lastLevel) {
+              leaf_level.markOccupiedBucket(slot / BucketSize);
+            }
+          }
+        }
+      }
+      if(!wrapped.empty()) {
+        vector<bool> taken(slots);
+        for(auto p = 0; p < bulkLoadPartitions; p++) {
+          for(auto i = offsets[p]; i < partitions[p].end; i++) {
+            if(rows[i].first < slots) {
+              taken[rows[i].first] = true;
+            }
+          }
+        }
+        size_t free_slot = 0;
+        for(auto* slot : wrapped) {
+          while(taken[free_slot]) {
+            free_slot++;
+          }
+          *slot = free_slot++;
+          if constexpr(lastLevel) {
+            leaf_level.markOccupiedBucket(*slot / BucketSize);
+          }
+        }
+      }
+
+      // Writing pass: the same walk as the sizing pass, now from the placed slots and buckets.
+      onThreads(threads, [&](size_t firstPartition) {
+        for(auto p = firstPartition; p < bulkLoadPartitions; p += threads) {
+          auto& partition = partitions[p];
+          for(auto i = offsets[p]; i < partition.end;) {
+            auto const next = bulkGroupEnd(rows.data(), i, partition.end);
+            bulkNode<true>(rows.data(), i, next, rows[i].first, partition.cursors);
+            i = next;
+          }
+        }
+      });
+
+      size_t tuples = 0;
+      for(auto p = 0; p < bulkLoadPartitions; p++) {
+        tuples += partitions[p].end - offsets[p];
+        if constexpr(filtered) {
+          for(auto i = offsets[p]; i < partitions[p].end; i++) {
+            addToFilters(rows[i].second, make_index_sequence<sizeof...(ColumnTypes) - 1>());
+          }
+        }
+      }
+      finishBulkBuild(tuples, used, threads);
+    }
+
+    for(auto const& partition : partitions) {
+      for(auto const& row : partition.emptyKeyRows) {
+        insert(row);
+      }
+    }
+  }
+
+  /// End of the group of sorted rows starting at begin, all of which share the columns above
+  /// this level: the rows sharing this level's key on a node level, and on a leaf level the
+  /// copies of one tuple if the policy counts them, a single row otherwise.
+  size_t bulkGroupEnd(BulkRow const* rows, size_t begin, size_t end) const {
+    auto next = begin + 1;
+    if constexpr(!lastLevel) {
+      while(next < end &&
+            get<ColumnIndex>(rows[next].second) == get<ColumnIndex>(rows[begin].second)) {
+        next++;
+      }
+    } else if constexpr(Policy::tupleMultiplicities) {
+      while(next < end && rows[next].second == rows[begin].second) {
+        next++;
+      }
+    }
+    return next;
+  }
+
+  /// Writes the node or leaf of the group rows[begin, end) to slot, and the subtree below it to
+  /// the chains at the cursors of the levels below. Without write only the cursors move.
+  template <bool write>
+  void bulkNode(BulkRow const* rows, size_t begin, size_t end, size_t slot, BulkCursors& cursors) {
+    if constexpr(lastLevel) {
+      if constexpr(write) {
+        leaf_level.placeTuple(slot, rows[begin].second, end - begin);
+      }
+    } else {
+      auto const child_bucket = cursors[ColumnIndex + 1];
+      auto const placed = next_level.template bulkChain<write>(
+          rows, begin, end, child_bucket * BucketSize, cursors);
+      // One slot past the chain stays empty, so that its probes stop there.
+      cursors[ColumnIndex + 1] = child_bucket + placed / BucketSize + 1;
+      if constexpr(write) {
+        if constexpr(Policy::prefixSketches) {
+          for(auto i = begin; i < end; i++) {
+            node_level.sketchKey(slot, NextHasher()(get<ColumnIndex + 1>(rows[i].second)));
+          }
+        }
+        node_level.placeNode(slot, get<ColumnIndex>(rows[begin].second), end - begin,
+                             child_bucket);
+      }
+    }
+  }
+
+  /// Lays out the groups of rows[begin, end), which share the columns above this level, as one
+  /// chain from slot on. Returns the number of slots it fills.
+  template <bool write>
+  size_t bulkChain(BulkRow const* rows, size_t begin, size_t end, size_t slot,
+                   BulkCursors& cursors) {
+    size_t placed = 0;
+    for(auto i = begin; i < end; placed++) {
+      auto const next = bulkGroupEnd(rows, i, end);
+      bulkNode<write>(rows, i, next, slot + placed, cursors);
+      i = next;
+    }
+    return placed;
+  }
+
+  /// Completes a bulk build of tuples rows whose chains fill the first used buckets of each
+  /// level: sets the sizes, the chain inserts start next and, below level 0, the leaf occupancy
+  /// bits.
+  void finishBulkBuild(size_t tuples, BulkCursors const& used, size_t threads) {
+    indexSize = tuples;
+    if constexpr(lastLevel && ColumnIndex > 0) {
+      auto const buckets = used[ColumnIndex];
+      auto const words = occupancyWords(buckets);
+      // Threads take whole words of the bitmap.
+      onThreads(threads, [&](size_t t) {
+        leaf_level.markOccupiedBuckets(min(words * t / threads * 64, buckets),
+                                       min(words * (t + 1) / threads * 64, buckets));
+      });
+      leaf_level.setNextChain(used[ColumnIndex] % leaf_level.buckets());
+    } else if constexpr(!lastLevel) {
+      if constexpr(ColumnIndex > 0) {
+        node_level.markBulkChains(used[ColumnIndex]);
+        node_level.setNextChain(used[ColumnIndex]);
+      }
+      next_level.finishBulkBuild(tuples, used, threads);
+    }
+  }
+
+  /// Whether one of the key columns, all but the last, holds the empty key. The last column is
+  /// only stored in the leaves, so any value of it can be laid out.
+  template <size_t... Column>
+  static bool hasEmptyKey(tuple<ColumnTypes...> const& row, index_sequence<Column...>) {
+    return ((get<Column>(row) ==
+             DefaultValue<tuple_element_t<Column, tuple<ColumnTypes...>>>()()) ||
+            ...);
+  }
+
+  /// Calls work(t) for every t in [0, threads), each on a thread of its own but the first, which
+  /// runs on the calling one.
+  template <typename Work> static void onThreads(size_t threads, Work&& work) {
+    vector<thread> workers;
+    for(auto t = 1; t < threads; t++) {
+      workers.emplace_back(work, t);
+    }
+    work(0);
+    for(auto& worker : workers) {
+      worker.join();
+    }
+  }
 
   size_t getSize() const { return indexSize; }
 
-  vector<reference_wrapper<const tuple<ColumnTypes...>>> scan() const {
+  /// Slots of this level and all levels below that hold erased tuples or nodes left without
+  /// tuples, and that no insert has reused yet.
+  size_t tombstoneCount() const {
+    if constexpr(lastLevel) {
+      return leaf_level.tombstoneCount();
+    } else {
+      return node_level.deadNodeCount() + next_level.tombstoneCount();
+    }
+  }
+
+  /// Whether tombstones have grown to a quarter of the live tuples, the point at which compact
+  /// pays for itself. Only nodes revived by an insert of the same prefix are ever reused, so an
+  /// index under churn fills up unless it is compacted.
+  bool needsCompaction() const {
+    auto const tombstones = tombstoneCount();
+    return tombstones >= minimumCompaction && tombstones * compactionRatio > getSize();
+  }
+
+  /// Rebuilds the index from its live tuples, dropping every tombstone and every node whose
+  /// tuples were all erased. A multiset scan yields each distinct tuple once, so every tuple is
+  /// loaded again with all of its copies.
+  void compact() {
+    static_assert(!Policy::concurrentReaders, "Compacting would race with concurrent readers");
+    vector<tuple<ColumnTypes...>> live;
+    live.reserve(getSize());
+    for(tuple<ColumnTypes...> const& input_tuple : scan()) {
+      auto const copies = Policy::tupleMultiplicities ? countPrefix(input_tuple) : 1;
+      live.insert(live.end(), copies, input_tuple);
+    }
+    *this = BasicSonicIndex(getCapacity());
+    bulkLoad(live);
+  }
+
+  /// Occupancy, runs, overflow and, with SONIC_PROBE_STATS, probe lengths of this level and all
+  /// levels below it, top to bottom. Costs one pass over every slot.
+  vector<SonicLevelStats> stats() const {
+    if constexpr(lastLevel) {
+      return {leaf_level.stats()};
+    } else {
+      auto levels = next_level.stats();
+      levels.insert(levels.begin(), node_level.stats());
+      return levels;
+    }
+  }
+
+  /// Bytes held by the slot arrays of this level and all levels below it.
+  size_t memoryUsage() const {
+    size_t bytes = 0;
+    if constexpr(filtered) {
+      for(auto const& filter : prefixFilters) {
+        bytes += filter.memoryUsage();
+      }
+    }
+    if constexpr(lastLevel) {
+      return bytes + leaf_level.memoryUsage();
+    } else {
+      return bytes + node_level.memoryUsage() + next_level.memoryUsage();
+    }
+  }
+
+  /// Fill and, with SONIC_PROBE_STATS, rejections of the prefix filter of every prefix length
+  /// from two columns up, shortest first. Empty unless the policy filters prefixes.
+  vector<SonicFilterStats> filterStats() const {
+    vector<SonicFilterStats> filters;
+    if constexpr(filtered) {
+      for(auto length = 2; length <= sizeof...(ColumnTypes); length++) {
+        filters.push_back(prefixFilters[length - 2].stats(length));
+      }
+    }
+    return filters;
+  }
+
+  void writeTo(SonicFileWriter& writer) const {
+    writer.value<uint64_t>(indexSize);
+    if constexpr(filtered) {
+      for(auto const& filter : prefixFilters) {
+        filter.writeTo(writer);
+      }
+    }
+    if constexpr(lastLevel) {
+      leaf_level.writeTo(writer);
+    } else {
+      node_level.writeTo(writer);
+      next_level.writeTo(writer);
+    }
+  }
+
+  bool mapFrom(SonicFileReader& reader) {
+    indexSize = reader.value<uint64_t>();
+    if constexpr(filtered) {
+      for(auto& filter : prefixFilters) {
+        if(!filter.mapFrom(reader)) {
+          return false;
+        }
+      }
+    }
+    if constexpr(lastLevel) {
+      return leaf_level.mapFrom(reader);
+    } else {
+      return node_level.mapFrom(reader) && next_level.mapFrom(reader);
+    }
+  }
+
+  /// Writes the index to path in the versioned layout of sonic_persistence.h.
+  bool save(string const& path) const {
+    static_assert(persistable, "Only single-writer indices of plain columns can be saved");
+    SonicFileWriter writer(path);
+    writer.value(fileHeader());
+    writeTo(writer);
+    return writer.good();
+  }
+
+  /// Replaces the contents of the index with a file written by save, mapping its slot arrays
+  /// instead of reading them. Pages are copy-on-write: inserts after loading stay private to the
+  /// process and never reach the file. A missing, truncated or foreign file leaves an empty
+  /// index and returns false.
+  bool load(string const& path) {
+    static_assert(persistable, "Only single-writer indices of plain columns can be loaded");
+    auto const capacity = getCapacity();
+    auto file = make_shared<MappedSonicFile>(path);
+    SonicFileReader reader(*file);
+    auto const header = reader.value<SonicFileHeader>();
+    auto const expected = fileHeader();
+    if(reader.good() && memcmp(&header, &expected, sizeof(header)) == 0 && mapFrom(reader)) {
+      mapping = move(file);
+      return true;
+    }
+    *this = BasicSonicIndex(capacity);
+    return false;
+  }
+
+  size_t getCapacity() const {
+    if constexpr(lastLevel) {
+      return leaf_level.slots();
+    } else {
+      return node_level.slots();
+    }
+  }
+
+  size_t homeSlotOf(tuple_element_t<ColumnIndex, tuple<ColumnTypes...>> const& key) const {
+    if constexpr(lastLevel) {
+      return leaf_level.homeSlotOf(key);
+    } else {
+      return node_level.homeSlotOf(key);
+    }
+  }
+
+  vector<tuple_element_t<ColumnIndex, tuple<ColumnTypes...>>> keysWithHomeSlot(size_t slot) const {
+    if constexpr(lastLevel) {
+      return leaf_level.keysWithHomeSlot(slot);
+    } else {
+      return node_level.keysWithHomeSlot(slot);
+    }
+  }
+
+  vector<TupleResult> scan() const {
     if constexpr(lastLevel) {
       return leaf_level.scan();
     } else {
       return next_level.scan();
     }
   }
+
+  /// Buckets of the leaf level, which scanBuckets partitions.
+  size_t leafBuckets() const {
+    if constexpr(lastLevel) {
+      return leaf_level.buckets();
+    } else {
+      return next_level.leafBuckets();
+    }
+  }
+
+  /// Calls visit on the live tuples of leaf buckets [firstBucket, lastBucket), in scan order.
+  template <typename Visit>
+  void scanBuckets(size_t firstBucket, size_t lastBucket, Visit&& visit) const {
+    if constexpr(lastLevel) {
+      leaf_level.scanBuckets(firstBucket, lastBucket, visit);
+    } else {
+      next_level.scanBuckets(firstBucket, lastBucket, visit);
+    }
+  }
+
+  /// scan split into one contiguous range of leaf buckets per thread. Each thread appends
+  /// convert(tuple) for the tuples of its range to a buffer of its own; the buffers in order
+  /// hold the tuples in scan order. Indexes too small to give every thread scanSlotsPerThread
+  /// slots use fewer threads, down to just the calling one.
+  template <typename Output, typename Convert>
+  vector<vector<Output>> scanPartitioned(size_t threads, Convert&& convert) const {
+    auto const buckets = leafBuckets();
+    threads = max(min(threads, buckets * BucketSize / scanSlotsPerThread), (size_t)1);
+    vector<vector<Output>> partitions(threads);
+    onThreads(threads, [&](size_t t) {
+      auto& output = partitions[t];
+      output.reserve(getSize() / threads);
+      scanBuckets(buckets * t / threads, buckets * (t + 1) / threads,
+                  [&](auto const& data_tuple) { output.push_back(convert(data_tuple)); });
+    });
+    return partitions;
+  }
+
+  vector<vector<TupleResult>> scanPartitioned(size_t threads) const {
+    return scanPartitioned<TupleResult>(
+        threads, [](tuple<ColumnTypes...> const& data_tuple) -> TupleResult { return data_tuple; });
+  }
 };
+
+/// Sonic index storing each distinct tuple once. Erased tuples leave tombstones that the index
+/// never drops by itself: the caller runs compact() once needsCompaction() holds, or the index
+/// fills up under churn. GrowableSonicIndex compacts on its own.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+using SonicIndex =
+    BasicSonicIndex<DefaultSonicPolicy, Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
+
+/// Sonic index storing each distinct tuple once with a count of its copies. Counts include every
+/// copy, while lookups and scans yield each distinct tuple once.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+using MultisetSonicIndex =
+    BasicSonicIndex<MultisetSonicPolicy, Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
+
+/// Sonic index whose nodes sketch the distinct keys of the column below them, for
+/// estimatePrefix and estimateDistinct.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+using SketchedSonicIndex =
+    BasicSonicIndex<SketchedSonicPolicy<>, Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
+
+/// Sonic index that answers lookups of absent prefixes from a Bloom filter, for workloads such as
+/// semijoin checks where most prefixes miss.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+using FilteredSonicIndex =
+    BasicSonicIndex<FilteredSonicPolicy<>, Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
+
+/// Sonic index that serves lookups from any number of threads while one thread inserts. Slots
+/// are published with release/acquire ordering, so readers never observe a partially written
+/// slot; a prefix count may briefly include a tuple whose leaf is still being written.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+using ConcurrentSonicIndex =
+    BasicSonicIndex<ConcurrentSonicPolicy, Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
 } // namespace
 #endif
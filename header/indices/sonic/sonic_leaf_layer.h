@@ -9,164 +9,437 @@
 #include <vector>
 
 #include "../../helper_functions.h"
+#include "sonic_common.h"
+#include "sonic_persistence.h"
+#include "sonic_probe.h"
+#include "sonic_stats.h"
 
 using namespace std;
 
-template <size_t KeyIndex, typename Tuple> struct SonicLeaf {
-  typedef std::tuple_element_t<KeyIndex, Tuple> KeyType;
+template <typename Tuple> struct SonicLeaf {
+  SonicLeaf() { data_tuple = tupleDefaultValue<Tuple>(); }
 
-  SonicLeaf() {
-    key = DefaultValue<KeyType>()();
-    data_tuple = tupleDefaultValue<Tuple>();
-  }
-
-  KeyType key;
   Tuple data_tuple;
 };
 
-template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename Hash, typename Tuple>
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename Hash, typename Tuple,
+          typename Policy = DefaultSonicPolicy>
 class SonicTuple {
-  vector<SonicLeaf<ColumnIndex, Tuple>> index;
+public:
+  typedef tuple_element_t<ColumnIndex, Tuple> KeyType;
+  typedef SonicLeaf<Tuple> LeafType;
+
+private:
+  class NoMultiplicities {};
+
+  typedef SlotField<KeyType, Policy::concurrentReaders> KeySlot;
+  typedef SlotField<SlotWord<Capacity>, Policy::concurrentReaders> WordSlot;
+  typedef SlotField<uint64_t, Policy::concurrentReaders> OccupancyWord;
+  template <typename T> using Allocator = typename Policy::template Allocator<T>;
+  static size_t constexpr keyPadding = probePadding<KeySlot>();
+  static bool constexpr counted = Policy::tupleMultiplicities;
+
+  SlotArray<KeySlot, Allocator<KeySlot>> keys;
+  SlotArray<LeafType, Allocator<LeafType>> index;
+  /// Copies of the tuple in each slot, kept by multiset policies only.
+  conditional_t<counted, SlotArray<WordSlot, Allocator<WordSlot>>, NoMultiplicities>
+      multiplicities;
+  /// Buckets holding keys, so that scans skip empty regions; see occupancyWords.
+  SlotArray<OccupancyWord, Allocator<OccupancyWord>> occupied;
   static Hash constexpr hasher = Hash();
   size_t bucket_idx;
-  static size_t constexpr numberOfBuckets = (size_t)(Capacity / BucketSize);
+  size_t runtimeSlots;
+  uint64_t runtimeReciprocal;
+  size_t tombstones;
+  SonicProbeCounters probeCounters;
+  static bool constexpr runtimeSized = (Capacity == RuntimeCapacity);
+  static size_t constexpr noBucket = unassignedBucket<Capacity, BucketSize>();
 
   template <size_t... I> auto getSubTuple(Tuple const& input_tuple, index_sequence<I...>) const {
     return make_tuple(get<I>(input_tuple)...);
   }
 
-public:
-  typedef tuple_element_t<ColumnIndex, Tuple> KeyType;
+  inline bool isEmpty(size_t hash_idx) const {
+    return keys[hash_idx] == DefaultValue<KeyType>()();
+  }
+
+  /// An erased tuple leaves its key in place, so the runs through its slot stay intact, and
+  /// resets the tuple to the empty value. The next insert probing past the slot reuses it.
+  inline bool isTombstone(size_t hash_idx) const {
+    return get<ColumnIndex>(index[hash_idx].data_tuple) == DefaultValue<KeyType>()();
+  }
+
+  template <typename Visit>
+  inline pair<size_t, bool> probeRun(size_t hash_idx, KeyType const& key, bool matchKey,
+                                     Visit&& visit) const {
+    auto const probe = ::probeRun(keys, slots(), hash_idx, key, matchKey, visit);
+    if constexpr(sonicProbeStats) {
+      probeCounters.record(probedSlotsOnRing(hash_idx, probe.first, slots()));
+    }
+    return probe;
+  }
 
-  SonicTuple() {
-    index.reserve(Capacity);
-    for(auto i = 0; i < Capacity; i++) {
-      index.emplace_back(SonicLeaf<ColumnIndex, Tuple>());
+  template <typename Visit>
+  inline pair<size_t, bool> rangeRun(size_t hash_idx, KeyType const& low, KeyType const& high,
+                                     Visit&& visit) const {
+    auto const probe = ::rangeRun(keys, slots(), hash_idx, low, high, visit);
+    if constexpr(sonicProbeStats) {
+      probeCounters.record(probedSlotsOnRing(hash_idx, probe.first, slots()));
     }
+    return probe;
+  }
+
+  /// Level-0 leaves keep probing: whenever a run ends, the search restarts at the next bucket
+  /// in order, as long as that bucket is occupied.
+  template <typename Visit>
+  inline pair<size_t, bool> probeChains(size_t hash_idx, KeyType const& key, Visit&& visit) const {
+    auto bucket_counter = 1;
+    if(isEmpty(hash_idx)) {
+      return {hash_idx, false};
+    }
+    while(true) {
+      auto const probe = probeRun(hash_idx, key, true, visit);
+      if(probe.second || ColumnIndex > 0 || bucket_counter >= buckets()) {
+        return probe;
+      }
+      hash_idx = (bucket_counter * BucketSize) % slots();
+      bucket_counter++;
+      if(isEmpty(hash_idx)) {
+        return {hash_idx, false};
+      }
+    }
+  }
+
+public:
+  explicit SonicTuple(size_t capacity = Capacity) {
+    runtimeSlots = runtimeSized ? roundUpToBucket(capacity, BucketSize) : Capacity;
+    runtimeReciprocal = slotReciprocal(runtimeSlots);
+    keys = decltype(keys)(slots() + keyPadding, DefaultValue<KeyType>()());
+    index = decltype(index)(slots(), LeafType());
+    if constexpr(counted) {
+      multiplicities = decltype(multiplicities)(slots(), 0);
+    }
+    occupied = decltype(occupied)(occupancyWords(buckets()), 0);
     bucket_idx = 0;
+    tombstones = 0;
   }
 
-  const Tuple& getTupleByIndex(size_t tupleIndex) const { return index[tupleIndex].data_tuple; }
+  inline size_t slots() const {
+    if constexpr(runtimeSized) {
+      return runtimeSlots;
+    } else {
+      return Capacity;
+    }
+  }
 
-  vector<reference_wrapper<const Tuple>> scan() const {
-    vector<reference_wrapper<const Tuple>> results;
+  inline size_t buckets() const { return slots() / BucketSize; }
+
+  inline size_t homeSlot(size_t hash_key) const {
+    if constexpr(runtimeSized) {
+      return reduceToSlot(hash_key, runtimeSlots, runtimeReciprocal);
+    } else {
+      return hash_key % Capacity;
+    }
+  }
+
+  inline size_t nextSlot(size_t hash_idx) const { return nextOnRing(hash_idx, slots()); }
 
-    for(auto i = 0; i < Capacity; i++) {
-      if(index[i].key != DefaultValue<KeyType>()()) {
-        results.emplace_back(index[i].data_tuple);
+  size_t homeSlotOf(KeyType const& key) const { return homeSlot(hasher(key)); }
+
+  vector<KeyType> keysWithHomeSlot(size_t slot) const {
+    vector<KeyType> result;
+    for(auto hash_idx = slot; !isEmpty(hash_idx); hash_idx = nextSlot(hash_idx)) {
+      if(homeSlotOf(keys[hash_idx]) == slot &&
+         find(result.begin(), result.end(), keys[hash_idx]) == result.end()) {
+        result.emplace_back(keys[hash_idx]);
       }
     }
+    return result;
+  }
+
+  const Tuple& getTupleByIndex(size_t tupleIndex) const { return index[tupleIndex].data_tuple; }
+
+  size_t multiplicityOf(size_t tupleIndex) const {
+    if constexpr(counted) {
+      return multiplicities[tupleIndex];
+    } else {
+      return 1;
+    }
+  }
+
+  size_t memoryUsage() const {
+    if constexpr(counted) {
+      return keys.memoryUsage() + index.memoryUsage() + occupied.memoryUsage() +
+             multiplicities.memoryUsage();
+    } else {
+      return keys.memoryUsage() + index.memoryUsage() + occupied.memoryUsage();
+    }
+  }
+
+  size_t tombstoneCount() const { return tombstones; }
+
+  /// Occupancy, runs and overflow of this layer, from one pass over its slots.
+  SonicLevelStats stats() const {
+    SonicLevelStats stats;
+    stats.column = ColumnIndex;
+    stats.leaf = true;
+    auto const used = [&](size_t slot) { return !isEmpty(slot); };
+    countRuns(stats, slots(), BucketSize, used);
+    stats.deadSlots = tombstones;
+    if constexpr(ColumnIndex == 0) {
+      countDisplacements(stats, slots(), BucketSize, used,
+                         [&](size_t slot) { return homeSlotOf(keys[slot]); });
+    }
+    probeCounters.addTo(stats);
+    return stats;
+  }
+
+  void writeTo(SonicFileWriter& writer) const {
+    writer.value<uint64_t>(slots());
+    writer.value<uint64_t>(bucket_idx);
+    writer.value<uint64_t>(tombstones);
+    writer.array(keys.data(), keys.size());
+    writer.array(index.data(), index.size());
+    writer.array(occupied.data(), occupied.size());
+    if constexpr(counted) {
+      writer.array(multiplicities.data(), multiplicities.size());
+    }
+  }
+
+  /// Points this layer at the arrays a matching writeTo stored in a mapped file.
+  bool mapFrom(SonicFileReader& reader) {
+    auto const fileSlots = reader.value<uint64_t>();
+    if(!reader.good() || fileSlots == 0 || fileSlots % BucketSize != 0 ||
+       (!runtimeSized && fileSlots != Capacity)) {
+      return false;
+    }
+    runtimeSlots = fileSlots;
+    runtimeReciprocal = slotReciprocal(runtimeSlots);
+    bucket_idx = reader.value<uint64_t>();
+    tombstones = reader.value<uint64_t>();
+    mapArray(reader, keys, slots() + keyPadding);
+    mapArray(reader, index, slots());
+    mapArray(reader, occupied, occupancyWords(buckets()));
+    if constexpr(counted) {
+      mapArray(reader, multiplicities, slots());
+    }
+    return reader.good() && bucket_idx < buckets();
+  }
+
+  /// Calls visit on the live tuples of buckets [firstBucket, lastBucket) in slot order.
+  template <typename Visit>
+  void scanBuckets(size_t firstBucket, size_t lastBucket, Visit&& visit) const {
+    forEachOccupiedBucket(occupied, firstBucket, lastBucket, [&](size_t bucket) {
+      for(auto i = bucket * BucketSize; i < (bucket + 1) * BucketSize; i++) {
+        if(!isEmpty(i) && !isTombstone(i)) {
+          visit(index[i].data_tuple);
+        }
+      }
+    });
+  }
+
+  vector<reference_wrapper<const Tuple>> scan() const {
+    vector<reference_wrapper<const Tuple>> results;
+    scanBuckets(0, buckets(), [&](Tuple const& data_tuple) { results.emplace_back(data_tuple); });
     return results;
   }
 
-  pair<SonicLeaf<ColumnIndex, Tuple>&, size_t>
-  insert(Tuple const& input_tuple, size_t bucket_number_level_up = numberOfBuckets) {
-    size_t bucket_counter = 0;
+  pair<LeafType&, size_t> insert(Tuple const& input_tuple,
+                                 size_t bucket_number_level_up = noBucket) {
     auto hash_key = hasher(get<ColumnIndex>(input_tuple));
-    auto hash_idx = hash_key % Capacity;
-    auto current_bucket = bucket_number_level_up; // Later Update
+    auto hash_idx = homeSlot(hash_key);
+
+    // A new chain cannot hold the tuple yet; anywhere else a copy only raises its count.
+    if constexpr(counted) {
+      if(ColumnIndex == 0 || bucket_number_level_up != noBucket) {
+        auto const probe = probeChains(prefixStart(input_tuple, bucket_number_level_up),
+                                       get<ColumnIndex>(input_tuple), [&](size_t slot) {
+                                         return index[slot].data_tuple == input_tuple;
+                                       });
+        if(probe.second) {
+          multiplicities[probe.first]++;
+          return {index[probe.first], bucket_number_level_up == noBucket
+                                          ? (size_t)(probe.first / BucketSize)
+                                          : bucket_number_level_up};
+        }
+      }
+    }
 
     if constexpr(ColumnIndex > 0) {
-      hash_idx = bucket_number_level_up != numberOfBuckets ? bucket_number_level_up * BucketSize
-                                                           : bucket_idx * BucketSize;
-      current_bucket = (size_t)(hash_idx / BucketSize);
+      hash_idx = bucket_number_level_up != noBucket ? bucket_number_level_up * BucketSize
+                                                    : bucket_idx * BucketSize;
     }
 
-    while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-      hash_idx = (hash_idx + 1) % Capacity;
-      bucket_counter++;
+    if(tombstones > 0) {
+      auto const probe = probeRun(hash_idx, get<ColumnIndex>(input_tuple), false,
+                                  [&](size_t slot) { return isTombstone(slot); });
+      hash_idx = probe.first;
+      tombstones -= probe.second;
+    } else {
+      hash_idx = probeRun(hash_idx, get<ColumnIndex>(input_tuple), false, [](size_t) {
+                   return false;
+                 }).first;
     }
 
-    index[hash_idx].key = get<ColumnIndex>(input_tuple);
+    // The key is written last: it publishes the slot to concurrent readers.
     index[hash_idx].data_tuple = input_tuple;
+    if constexpr(counted) {
+      multiplicities[hash_idx] = 1;
+    }
+    keys[hash_idx] = get<ColumnIndex>(input_tuple);
+    markOccupied(occupied, hash_idx / BucketSize);
 
-    if(bucket_number_level_up == numberOfBuckets) {
-      bucket_idx = (bucket_idx + 1) % numberOfBuckets;
+    if(bucket_number_level_up == noBucket) {
+      bucket_idx = nextOnRing(bucket_idx, buckets());
       return {index[hash_idx], (size_t)(hash_idx / BucketSize)};
     } else {
       return {index[hash_idx], bucket_number_level_up};
     }
   }
 
-  pair<SonicLeaf<ColumnIndex, Tuple>&, size_t> pointLookup(Tuple const& input_tuple,
-                                                           size_t bucket_number_level_up) {
-    auto bucket_counter = 1;
+  /// Writes a tuple and its copies to an empty slot without probing, for bulk builds that lay out
+  /// whole runs and chains at once. Neighbouring chains share occupancy words, so the bulk build
+  /// sets the occupancy bits separately: per bucket while it places level-0 slots in order, and
+  /// with markOccupiedBuckets on the levels below.
+  void placeTuple(size_t hash_idx, Tuple const& input_tuple, size_t copies) {
+    index[hash_idx].data_tuple = input_tuple;
+    if constexpr(counted) {
+      multiplicities[hash_idx] = copies;
+    }
+    keys[hash_idx] = get<ColumnIndex>(input_tuple);
+  }
+
+  /// Sets the occupancy bit of every bucket in [firstBucket, lastBucket) that holds a key. Each
+  /// word of the bitmap is written once.
+  void markOccupiedBuckets(size_t firstBucket, size_t lastBucket) {
+    for(auto word = firstBucket / 64; word * 64 < lastBucket; word++) {
+      uint64_t bits = 0;
+      for(auto bucket = max(word * 64, firstBucket); bucket < min(word * 64 + 64, lastBucket);
+          bucket++) {
+        auto used = false;
+        for(auto i = bucket * BucketSize; i < (bucket + 1) * BucketSize; i++) {
+          used |= !isEmpty(i);
+        }
+        bits |= uint64_t(used) << bucket % 64;
+      }
+      occupied[word] = occupied[word] | bits;
+    }
+  }
+
+  void markOccupiedBucket(size_t bucket) { markOccupied(occupied, bucket); }
+
+  /// Moves the bucket that insert starts its next new chain at; bulk builds move it past theirs.
+  void setNextChain(size_t bucket) { bucket_idx = bucket; }
+
+  pair<LeafType&, size_t> pointLookup(Tuple const& input_tuple, size_t bucket_number_level_up) {
     size_t hash_idx;
     if constexpr(ColumnIndex == 0) {
-      hash_idx = hasher(get<ColumnIndex>(input_tuple)) % Capacity;
+      hash_idx = homeSlot(hasher(get<ColumnIndex>(input_tuple)));
     } else {
       hash_idx = bucket_number_level_up * BucketSize;
     }
 
-    while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-      if(index[hash_idx].data_tuple == input_tuple) {
-        return {index[hash_idx], 1};
-      }
-      hash_idx = (hash_idx + 1) % Capacity;
+    auto const probe = probeChains(hash_idx, get<ColumnIndex>(input_tuple), [&](size_t slot) {
+      return index[slot].data_tuple == input_tuple;
+    });
+    return {index[probe.first], probe.second ? 1 : 0};
+  }
 
-      if constexpr(ColumnIndex == 0) {
-        if((index[hash_idx].key == DefaultValue<KeyType>()()) &&
-           (bucket_counter < numberOfBuckets)) {
-          hash_idx = (bucket_counter * BucketSize) % Capacity;
-          bucket_counter++;
-        }
+  /// Drops one copy of input_tuple, turning its slot into a tombstone once no copy is left.
+  /// Returns the number of erased tuples.
+  size_t erase(Tuple const& input_tuple, size_t bucket_number_level_up) {
+    auto const probe =
+        probeChains(prefixStart(input_tuple, bucket_number_level_up), get<ColumnIndex>(input_tuple),
+                    [&](size_t slot) { return index[slot].data_tuple == input_tuple; });
+    if(!probe.second) {
+      return 0;
+    }
+    if constexpr(counted) {
+      multiplicities[probe.first] = multiplicities[probe.first] - 1;
+      if(multiplicities[probe.first] > 0) {
+        return 1;
       }
     }
-    return {index[hash_idx], 0};
+    index[probe.first] = LeafType();
+    tombstones++;
+    return 1;
   }
 
   template <typename... PrefixColumns>
   pair<size_t, size_t> countPrefix(tuple<PrefixColumns...> const& input_tuple,
                                    size_t bucket_number_level_up) const {
     auto hash_key = hasher(get<ColumnIndex>(input_tuple));
-    auto result = 0;
-    auto bucket_counter = 1;
+    size_t result = 0;
     size_t hash_idx;
     if constexpr(ColumnIndex == 0) {
-      hash_idx = hash_key % Capacity;
+      hash_idx = homeSlot(hash_key);
     } else {
       hash_idx = bucket_number_level_up * BucketSize;
     }
 
-    while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-      if(getSubTuple(index[hash_idx].data_tuple, make_index_sequence<sizeof...(PrefixColumns)>()) ==
+    auto const probe = probeChains(hash_idx, get<ColumnIndex>(input_tuple), [&](size_t slot) {
+      if(getSubTuple(index[slot].data_tuple, make_index_sequence<sizeof...(PrefixColumns)>()) ==
          input_tuple) {
-        result++;
-      }
-      hash_idx = (hash_idx + 1) % Capacity;
-
-      if constexpr(ColumnIndex == 0) {
-        if((index[hash_idx].key == DefaultValue<KeyType>()()) &&
-           (bucket_counter < numberOfBuckets)) {
-          hash_idx = (bucket_counter * BucketSize) % Capacity;
-          bucket_counter++;
-        }
+        result += multiplicityOf(slot);
       }
-    }
-    return {hash_idx, result};
+      return false;
+    });
+    return {probe.first, result};
   }
 
+  /// Slot at which a prefix lookup starts walking this layer.
   template <typename... PrefixColumns>
-  vector<size_t> prefixLookup(tuple<PrefixColumns...> const& input_tuple,
-                              size_t bucket_number_level_up) const {
-    vector<size_t> results;
-    size_t hash_idx;
-    auto bucket_counter = 1;
+  size_t prefixStart(tuple<PrefixColumns...> const& input_tuple,
+                     size_t bucket_number_level_up) const {
     if constexpr(ColumnIndex == 0) {
-      hash_idx = hasher(get<ColumnIndex>(input_tuple)) % Capacity;
+      return homeSlot(hasher(get<ColumnIndex>(input_tuple)));
     } else {
-      hash_idx = bucket_number_level_up * BucketSize;
+      return bucket_number_level_up * BucketSize;
     }
+  }
 
-    while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-      if(getSubTuple(index[hash_idx].data_tuple, make_index_sequence<sizeof...(PrefixColumns)>()) ==
-         input_tuple) {
-        results.emplace_back(hash_idx);
-      }
-      hash_idx = (hash_idx + 1) % Capacity;
+  /// Prefetches the slot a prefix probe starts at and the tuple compared when it hits there.
+  template <typename... PrefixColumns>
+  void prefetchPrefix(tuple<PrefixColumns...> const& input_tuple,
+                      size_t bucket_number_level_up) const {
+    auto const slot = prefixStart(input_tuple, bucket_number_level_up);
+    prefetchSlot(keys[slot]);
+    prefetchSlot(index[slot]);
+  }
+
+  /// First slot from hash_idx on, within the same run, whose tuple starts with the prefix. The
+  /// flag is false once the run ends.
+  template <typename... PrefixColumns>
+  pair<size_t, bool> nextPrefixMatch(tuple<PrefixColumns...> const& input_tuple,
+                                     size_t hash_idx) const {
+    constexpr bool matchKey = sizeof...(PrefixColumns) > ColumnIndex;
+    KeyType key = DefaultValue<KeyType>()();
+    if constexpr(matchKey) {
+      key = get<ColumnIndex>(input_tuple);
     }
-    return results;
+
+    return probeRun(hash_idx, key, matchKey, [&](size_t slot) {
+      if constexpr(sizeof...(PrefixColumns) == 0) {
+        return !isTombstone(slot);
+      } else {
+        return getSubTuple(index[slot].data_tuple,
+                           make_index_sequence<sizeof...(PrefixColumns)>()) == input_tuple;
+      }
+    });
+  }
+
+  /// First slot from hash_idx on, within the same run, whose live tuple starts with the prefix
+  /// and whose key lies in [low, high]. The prefix binds the columns before this one only.
+  template <typename... PrefixColumns>
+  pair<size_t, bool> nextRangeMatch(tuple<PrefixColumns...> const& input_tuple,
+                                    KeyType const& low, KeyType const& high,
+                                    size_t hash_idx) const {
+    return rangeRun(hash_idx, low, high, [&](size_t slot) {
+      return !isTombstone(slot) &&
+             getSubTuple(index[slot].data_tuple,
+                         make_index_sequence<sizeof...(PrefixColumns)>()) == input_tuple;
+    });
   }
 };
 
-#endif
\ No newline at end of file
+#endif
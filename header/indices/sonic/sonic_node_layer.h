@@ -1,6 +1,7 @@
 #ifndef _SONIC_NODE_H_
 #define _SONIC_NODE_H_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <functional>
@@ -10,266 +11,516 @@
 #include <vector>
 
 #include "../../helper_functions.h"
+#include "sonic_common.h"
+#include "sonic_persistence.h"
+#include "sonic_probe.h"
+#include "sonic_sketch.h"
+#include "sonic_stats.h"
 
 using namespace std;
 
-template <typename KeyType> struct SonicNode {
-  SonicNode() {
-    key = DefaultValue<KeyType>()();
-    bucket_number_level_down = 0;
-    prefix_count = 0;
+/// Keys patched onto the slots of a layer that need one. Slots are grouped into pages that are
+/// only allocated once one of their slots is patched; every other slot reads as the default
+/// value. A page is filled before it is published, so concurrent readers need no further
+/// synchronisation.
+template <typename PatchKey, bool Published = false> class SparsePatchKeys {
+  static constexpr size_t pageSlots = 64;
+
+  vector<SlotField<PatchKey*, Published>> pages;
+  vector<unique_ptr<PatchKey[]>> ownedPages;
+
+public:
+  explicit SparsePatchKeys(size_t slots = 0) : pages((slots + pageSlots - 1) / pageSlots) {
+    for(auto& page : pages) {
+      page = nullptr;
+    }
+  }
+
+  PatchKey get(size_t slot) const {
+    PatchKey const* page = pages[slot / pageSlots];
+    return page ? page[slot % pageSlots] : DefaultValue<PatchKey>()();
+  }
+
+  void set(size_t slot, PatchKey const& key) {
+    PatchKey* page = pages[slot / pageSlots];
+    if(!page) {
+      ownedPages.emplace_back(make_unique<PatchKey[]>(pageSlots));
+      page = ownedPages.back().get();
+      fill(page, page + pageSlots, DefaultValue<PatchKey>()());
+      page[slot % pageSlots] = key;
+      pages[slot / pageSlots] = page;
+      return;
+    }
+    page[slot % pageSlots] = key;
   }
 
-  KeyType key;
-  size_t bucket_number_level_down;
-  size_t prefix_count;
+  size_t memoryUsage() const {
+    return pages.capacity() * sizeof(pages[0]) +
+           ownedPages.capacity() * sizeof(ownedPages[0]) +
+           ownedPages.size() * pageSlots * sizeof(PatchKey);
+  }
+
+  /// Writes the allocated pages only, each preceded by its page number.
+  void writeTo(SonicFileWriter& writer) const {
+    uint64_t used = 0;
+    for(auto const& page : pages) {
+      used += (PatchKey const*)page != nullptr;
+    }
+    writer.value(used);
+    for(auto p = 0; p < pages.size(); p++) {
+      PatchKey const* page = pages[p];
+      if(page) {
+        writer.value<uint64_t>(p);
+        writer.array(page, pageSlots);
+      }
+    }
+  }
+
+  bool mapFrom(SonicFileReader& reader) {
+    auto const used = reader.value<uint64_t>();
+    for(auto i = 0; reader.good() && i < used; i++) {
+      auto const p = reader.value<uint64_t>();
+      auto* page = reader.template array<PatchKey>(pageSlots);
+      if(p >= pages.size() || !page) {
+        return false;
+      }
+      pages[p] = page;
+    }
+    return reader.good();
+  }
 };
 
-template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename Hash, typename Tuple>
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename Hash, typename Tuple,
+          typename Policy = DefaultSonicPolicy>
 class SonicLayer {
   class FirstColumn {};
+  class NoSketches {};
+
+public:
+  typedef tuple_element_t<ColumnIndex, Tuple> KeyType;
 
+private:
   static bool constexpr firstLevel = (ColumnIndex == 0);
-  static size_t constexpr numberOfBuckets = (size_t)(Capacity / BucketSize);
+  static bool constexpr runtimeSized = (Capacity == RuntimeCapacity);
+  typedef SlotField<KeyType, Policy::concurrentReaders> KeySlot;
+  typedef SlotField<SlotWord<Capacity>, Policy::concurrentReaders> WordSlot;
+  typedef SlotField<SonicSketch, Policy::concurrentReaders> SketchSlot;
+  template <typename T> using Allocator = typename Policy::template Allocator<T>;
+  static size_t constexpr keyPadding = probePadding<KeySlot>();
+  static size_t constexpr noBucket = unassignedBucket<Capacity, BucketSize>();
+  static bool constexpr sketched = Policy::prefixSketches;
   static Hash constexpr hasher = Hash();
 
-  vector<SonicNode<tuple_element_t<ColumnIndex, Tuple>>> index;
+  /// Keys, child bucket numbers and prefix counts live in separate arrays, so probing a run
+  /// only touches keys and a hit touches one more word.
+  SlotArray<KeySlot, Allocator<KeySlot>> keys;
+  SlotArray<WordSlot, Allocator<WordSlot>> children;
+  SlotArray<WordSlot, Allocator<WordSlot>> counts;
+  /// Distinct keys of the next column below each node, kept by sketching policies only.
+  conditional_t<sketched, SlotArray<SketchSlot, Allocator<SketchSlot>>, NoSketches> sketches;
   size_t bucket_idx;
+  size_t runtimeSlots;
+  uint64_t runtimeReciprocal;
+  size_t deadNodes;
+  SonicProbeCounters probeCounters;
+
+  /// Chains below the first level are named by ids, which parents keep as their child bucket.
+  /// Chain id c starts probing at bucket c % buckets(); ids count up from 0, skipping noBucket.
+  /// A node outside the first bucket of its chain, or of a chain whose id wrapped past the last
+  /// bucket, is patched with its chain id plus one. Any other node belongs to the chain that
+  /// starts closest before it, among those flagged in chain_starts.
+  typedef SlotField<size_t, Policy::concurrentReaders> PatchWord;
+  typename conditional<(ColumnIndex > 0), SlotArray<PatchWord, Allocator<PatchWord>>,
+                       FirstColumn>::type patch_bits;
+  typename conditional<(ColumnIndex > 0),
+                       SparsePatchKeys<SlotWord<Capacity>, Policy::concurrentReaders>,
+                       FirstColumn>::type patch_keys;
+  typename conditional<(ColumnIndex > 0), SlotArray<PatchWord, Allocator<PatchWord>>,
+                       FirstColumn>::type chain_starts;
+
+  inline bool isEmpty(size_t hash_idx) const {
+    return keys[hash_idx] == DefaultValue<KeyType>()();
+  }
 
-  typename conditional<(ColumnIndex > 0), unique_ptr<size_t[]>, FirstColumn>::type patch_bits;
-  typename conditional<
-      (ColumnIndex > 0),
-      unique_ptr<tuple_element_t<std::min(ColumnIndex - 1, tuple_size_v<Tuple> - 1), Tuple>[]>,
-      FirstColumn>::type patch_keys;
+  /// Patch bit of a bucket, set once a slot of it is patched.
+  inline size_t patchBitOf(size_t bucket) const {
+    return size_t(1) << (sizeof(size_t) - bucket % sizeof(size_t));
+  }
 
-public:
-  typedef tuple_element_t<ColumnIndex, Tuple> KeyType;
+  /// Whether a chain of the first round starts at a bucket in [first, last).
+  inline bool chainStartsIn(size_t first, size_t last) const {
+    for(auto bucket = first; bucket < last;) {
+      auto const span = min(64 - bucket % 64, last - bucket);
+      if((size_t)chain_starts[bucket / 64] >> bucket % 64 & lowBits(span)) {
+        return true;
+      }
+      bucket += span;
+    }
+    return false;
+  }
 
-  SonicLayer() {
-    index.reserve(Capacity);
-    for(auto i = 0; i < Capacity; i++) {
-      index.emplace_back(SonicNode<tuple_element_t<ColumnIndex, Tuple>>());
+  /// Whether the node at hash_idx belongs to the chain with the given id.
+  inline bool inChain(size_t hash_idx, size_t chain) const {
+    if constexpr(firstLevel) {
+      return true;
+    } else {
+      auto const bucket = hash_idx / BucketSize;
+      if(patch_bits[bucket / sizeof(size_t)] & patchBitOf(bucket)) {
+        size_t const patch = patch_keys.get(hash_idx);
+        if(patch != 0) {
+          return patch == chain + 1;
+        }
+      }
+      if(chain >= buckets()) {
+        return false;
+      }
+      // No other chain may start between the first bucket of this one and the node's.
+      if(bucket >= chain) {
+        return !chainStartsIn(chain + 1, bucket + 1);
+      }
+      return !chainStartsIn(chain + 1, buckets()) && !chainStartsIn(0, bucket + 1);
+    }
+  }
+
+  /// Slot the chain with the given id starts probing at.
+  inline size_t chainStart(size_t chain) const { return chain % buckets() * BucketSize; }
+
+  /// Id after chain, skipping the one that marks a missing child.
+  inline size_t nextChain(size_t chain) const {
+    return chain + 1 == noBucket ? chain + 2 : chain + 1;
+  }
+
+  template <typename Visit>
+  inline pair<size_t, bool> probeRun(size_t hash_idx, KeyType const& key, bool matchKey,
+                                     Visit&& visit) const {
+    auto const probe = ::probeRun(keys, slots(), hash_idx, key, matchKey, visit);
+    if constexpr(sonicProbeStats) {
+      probeCounters.record(probedSlotsOnRing(hash_idx, probe.first, slots()));
+    }
+    return probe;
+  }
+
+  template <typename Visit>
+  inline pair<size_t, bool> rangeRun(size_t hash_idx, KeyType const& low, KeyType const& high,
+                                     Visit&& visit) const {
+    auto const probe = ::rangeRun(keys, slots(), hash_idx, low, high, visit);
+    if constexpr(sonicProbeStats) {
+      probeCounters.record(probedSlotsOnRing(hash_idx, probe.first, slots()));
+    }
+    return probe;
+  }
+
+  /// Adds a tuple to an existing node, reviving it if all of its tuples had been erased.
+  inline void countTuple(size_t hash_idx) {
+    if(counts[hash_idx]++ == 0) {
+      deadNodes--;
+    }
+  }
+
+public:
+  explicit SonicLayer(size_t capacity = Capacity) {
+    runtimeSlots = runtimeSized ? roundUpToBucket(capacity, BucketSize) : Capacity;
+    runtimeReciprocal = slotReciprocal(runtimeSlots);
+    keys = decltype(keys)(slots() + keyPadding, DefaultValue<KeyType>()());
+    children = decltype(children)(slots(), 0);
+    counts = decltype(counts)(slots(), 0);
+    if constexpr(sketched) {
+      sketches = decltype(sketches)(slots(), 0);
     }
     bucket_idx = 0;
+    deadNodes = 0;
 
     if constexpr(!firstLevel) {
-      typedef tuple_element_t<ColumnIndex - 1, Tuple> PreviousColumnType;
-      auto defaultValueOfPreviousKey = DefaultValue<PreviousColumnType>()();
+      patch_bits = decltype(patch_bits)(ceil(buckets() / (double)sizeof(size_t)), 0);
+      patch_keys = decltype(patch_keys)(slots());
+      chain_starts = decltype(chain_starts)(occupancyWords(buckets()), 0);
+    }
+  }
 
-      size_t patch_bits_size = ceil(numberOfBuckets / (double)sizeof(size_t));
-      patch_bits = make_unique<size_t[]>(patch_bits_size);
-      for(auto i = 0; i < patch_bits_size; i++) {
-        patch_bits[i] = 0;
-      }
+  inline size_t slots() const {
+    if constexpr(runtimeSized) {
+      return runtimeSlots;
+    } else {
+      return Capacity;
+    }
+  }
+
+  inline size_t buckets() const { return slots() / BucketSize; }
+
+  inline size_t homeSlot(size_t hash_key) const {
+    if constexpr(runtimeSized) {
+      return reduceToSlot(hash_key, runtimeSlots, runtimeReciprocal);
+    } else {
+      return hash_key % Capacity;
+    }
+  }
+
+  inline size_t nextSlot(size_t hash_idx) const { return nextOnRing(hash_idx, slots()); }
 
-      patch_keys = make_unique<PreviousColumnType[]>(Capacity);
-      for(auto i = 0; i < Capacity; i++) {
-        patch_keys[i] = defaultValueOfPreviousKey;
+  size_t homeSlotOf(KeyType const& key) const { return homeSlot(hasher(key)); }
+
+  vector<KeyType> keysWithHomeSlot(size_t slot) const {
+    vector<KeyType> result;
+    for(auto hash_idx = slot; !isEmpty(hash_idx); hash_idx = nextSlot(hash_idx)) {
+      if(homeSlotOf(keys[hash_idx]) == slot &&
+         find(result.begin(), result.end(), keys[hash_idx]) == result.end()) {
+        result.emplace_back(keys[hash_idx]);
       }
     }
+    return result;
   }
 
-  const SonicNode<KeyType>& getNodeByIndex(size_t nodeIndex) const { return index[nodeIndex]; }
+  KeyType getKeyByIndex(size_t nodeIndex) const { return keys[nodeIndex]; }
 
-  pair<SonicNode<KeyType>&, size_t> insert(Tuple const& input_tuple,
-                                           size_t bucket_number_level_up = numberOfBuckets) {
-    size_t bucket_counter = 0;
-    auto hash_key = hasher(get<ColumnIndex>(input_tuple));
-    auto hash_idx = hash_key % Capacity;
-    auto current_bucket = bucket_number_level_up;
+  size_t getChildBucket(size_t nodeIndex) const { return children[nodeIndex]; }
 
-    if constexpr(firstLevel) {
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-          index[hash_idx].prefix_count++;
-          return {index[hash_idx], current_bucket};
+  /// Tuples below a node, counting every copy.
+  size_t countOf(size_t nodeIndex) const { return counts[nodeIndex]; }
+
+  /// Adds the hash of a next-column key of a tuple below a node to the node's sketch.
+  void sketchKey(size_t nodeIndex, size_t hash) {
+    if constexpr(sketched) {
+      sketches[nodeIndex] = addToSketch(sketches[nodeIndex], hash);
+    }
+  }
+
+  SonicSketch sketchOf(size_t nodeIndex) const {
+    if constexpr(sketched) {
+      return sketches[nodeIndex];
+    } else {
+      return 0;
+    }
+  }
+
+  void setChildBucket(size_t nodeIndex, size_t bucket) { children[nodeIndex] = bucket; }
+
+  /// Writes a node to an empty slot without probing, for bulk builds that lay out whole runs and
+  /// chains at once. The key is written last, as in insert.
+  void placeNode(size_t hash_idx, KeyType const& key, size_t count, size_t child_bucket) {
+    children[hash_idx] = child_bucket;
+    counts[hash_idx] = count;
+    keys[hash_idx] = key;
+  }
+
+  /// Sets the id insert gives its next new chain; bulk builds move it past theirs.
+  void setNextChain(size_t chain) { bucket_idx = chain == noBucket ? nextChain(chain) : chain; }
+
+  /// Flags the first bucket of every chain a bulk build laid out in the first chains buckets:
+  /// each chain starts right after the empty slot that ends the one before.
+  void markBulkChains(size_t chains) {
+    if constexpr(!firstLevel) {
+      for(size_t bucket = 0; bucket < chains;) {
+        markOccupied(chain_starts, bucket);
+        auto end = bucket * BucketSize;
+        while(!isEmpty(end)) {
+          end++;
         }
-        hash_idx = (hash_idx + 1) % Capacity;
+        bucket = end / BucketSize + 1;
       }
+    }
+  }
+
+  /// Drops one tuple from the prefix count of a node. A node whose count reaches zero stays in its
+  /// run and keeps its child chain; inserting its key again revives it.
+  void releaseNode(size_t nodeIndex) {
+    counts[nodeIndex] = counts[nodeIndex] - 1;
+    if(counts[nodeIndex] == 0) {
+      deadNodes++;
+    }
+  }
+
+  /// Nodes all of whose tuples were erased.
+  size_t deadNodeCount() const { return deadNodes; }
+
+  /// Occupancy, runs and overflow of this layer, from one pass over its slots.
+  SonicLevelStats stats() const {
+    SonicLevelStats stats;
+    stats.column = ColumnIndex;
+    auto const used = [&](size_t slot) { return !isEmpty(slot); };
+    countRuns(stats, slots(), BucketSize, used);
+    stats.deadSlots = deadNodes;
+    if constexpr(firstLevel) {
+      countDisplacements(stats, slots(), BucketSize, used,
+                         [&](size_t slot) { return homeSlotOf(keys[slot]); });
     } else {
-      typedef tuple_element_t<ColumnIndex - 1, Tuple> PreviousColumnType;
-      hash_idx = bucket_number_level_up != numberOfBuckets ? bucket_number_level_up * BucketSize
-                                                           : bucket_idx * BucketSize;
-      current_bucket = (size_t)(hash_idx / BucketSize);
-
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-          auto patch_bucket = (size_t)(hash_idx / BucketSize);
-          auto patch_idx = (size_t)(patch_bucket / (double)sizeof(size_t));
-          auto patch_bit_idx = sizeof(size_t) - patch_bucket % sizeof(size_t);
-
-          if((patch_bits[patch_idx] == 0) ||
-             ((patch_bits[patch_idx] >> patch_bit_idx == 1) &&
-              ((patch_keys[hash_idx] == get<ColumnIndex - 1>(input_tuple)) ||
-               (patch_keys[hash_idx] ==
-                DefaultValue<tuple_element_t<ColumnIndex - 1, Tuple>>()())))) {
-            index[hash_idx].prefix_count++;
-            return {index[hash_idx], current_bucket};
-          }
-        }
-        hash_idx = (hash_idx + 1) % Capacity;
-        bucket_counter++;
+      // A patch word flags a group of buckets; probes of all of them check patch keys.
+      for(auto bucket = 0; bucket < buckets(); bucket++) {
+        stats.patchedBuckets += (size_t)patch_bits[bucket / sizeof(size_t)] != 0;
       }
-      if(bucket_counter > BucketSize) {
-        auto patch_bucket = (size_t)(hash_idx / BucketSize);
-        auto patch_idx = (size_t)(patch_bucket / (double)sizeof(size_t));
-        auto patch_bit_idx = sizeof(size_t) - patch_bucket % sizeof(size_t);
-        auto old_value = patch_bits[patch_idx];
-        patch_bits[patch_idx] =
-            old_value | (((patch_bits[patch_idx] >> patch_bit_idx) | 1) << patch_bit_idx);
-        patch_keys[hash_idx] = get<ColumnIndex - 1>(input_tuple);
+      for(auto slot = 0; slot < slots(); slot++) {
+        stats.patchedSlots += patch_keys.get(slot) != 0;
       }
+    }
+    probeCounters.addTo(stats);
+    return stats;
+  }
 
-      if(bucket_number_level_up == numberOfBuckets) {
-        bucket_idx = (bucket_idx + 1) % numberOfBuckets;
-      }
+  size_t memoryUsage() const {
+    auto bytes = keys.memoryUsage() + children.memoryUsage() + counts.memoryUsage();
+    if constexpr(!firstLevel) {
+      bytes += patch_bits.memoryUsage() + patch_keys.memoryUsage() + chain_starts.memoryUsage();
     }
+    if constexpr(sketched) {
+      bytes += sketches.memoryUsage();
+    }
+    return bytes;
+  }
 
-    index[hash_idx].key = get<ColumnIndex>(input_tuple);
-    index[hash_idx].bucket_number_level_down = numberOfBuckets;
-    index[hash_idx].prefix_count = 1;
+  void writeTo(SonicFileWriter& writer) const {
+    writer.value<uint64_t>(slots());
+    writer.value<uint64_t>(bucket_idx);
+    writer.value<uint64_t>(deadNodes);
+    writer.array(keys.data(), keys.size());
+    writer.array(children.data(), children.size());
+    writer.array(counts.data(), counts.size());
+    if constexpr(sketched) {
+      writer.array(sketches.data(), sketches.size());
+    }
+    if constexpr(!firstLevel) {
+      writer.array(patch_bits.data(), patch_bits.size());
+      patch_keys.writeTo(writer);
+      writer.array(chain_starts.data(), chain_starts.size());
+    }
+  }
 
-    return {index[hash_idx], current_bucket};
+  /// Points this layer at the arrays a matching writeTo stored in a mapped file.
+  bool mapFrom(SonicFileReader& reader) {
+    auto const fileSlots = reader.value<uint64_t>();
+    if(!reader.good() || fileSlots == 0 || fileSlots % BucketSize != 0 ||
+       (!runtimeSized && fileSlots != Capacity)) {
+      return false;
+    }
+    runtimeSlots = fileSlots;
+    runtimeReciprocal = slotReciprocal(runtimeSlots);
+    bucket_idx = reader.value<uint64_t>();
+    deadNodes = reader.value<uint64_t>();
+    mapArray(reader, keys, slots() + keyPadding);
+    mapArray(reader, children, slots());
+    mapArray(reader, counts, slots());
+    if constexpr(sketched) {
+      mapArray(reader, sketches, slots());
+    }
+    if constexpr(!firstLevel) {
+      mapArray(reader, patch_bits, ceil(buckets() / (double)sizeof(size_t)));
+      patch_keys = decltype(patch_keys)(slots());
+      if(!patch_keys.mapFrom(reader)) {
+        return false;
+      }
+      mapArray(reader, chain_starts, occupancyWords(buckets()));
+    }
+    return reader.good() && (firstLevel ? bucket_idx < buckets() : bucket_idx <= slots() + 1);
   }
 
-  pair<SonicNode<KeyType>&, size_t> pointLookup(Tuple input_tuple, size_t bucket_number_level_up) {
-    auto hash_key = hasher(get<ColumnIndex>(input_tuple));
-    auto hash_idx = hash_key % Capacity;
+  pair<size_t, size_t> insert(Tuple const& input_tuple,
+                                 size_t bucket_number_level_up = noBucket) {
+    auto const& key = get<ColumnIndex>(input_tuple);
+    auto hash_idx = homeSlot(hasher(key));
+    auto current_bucket = bucket_number_level_up;
 
     if constexpr(firstLevel) {
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-          return {index[hash_idx], 1};
-        }
-        hash_idx = (hash_idx + 1) % Capacity;
+      auto const probe = probeRun(hash_idx, key, true, [](size_t) { return true; });
+      hash_idx = probe.first;
+      if(probe.second) {
+        countTuple(hash_idx);
+        return {hash_idx, current_bucket};
       }
     } else {
-      typedef tuple_element_t<ColumnIndex - 1, Tuple> PreviousColumnType;
-      hash_idx = bucket_number_level_up * BucketSize;
-
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-          auto patch_bucket = (size_t)(hash_idx / BucketSize);
-          auto patch_idx = (size_t)(patch_bucket / (double)sizeof(size_t));
-          auto patch_bit_idx = sizeof(size_t) - patch_bucket % sizeof(size_t);
-
-          if((patch_bits[patch_idx] == 0) ||
-             ((patch_bits[patch_idx] >> patch_bit_idx == 1) &&
-              ((patch_keys[hash_idx] == get<ColumnIndex - 1>(input_tuple)) ||
-               (patch_keys[hash_idx] ==
-                DefaultValue<tuple_element_t<ColumnIndex - 1, Tuple>>()())))) {
-            return {index[hash_idx], 1};
-          }
+      auto const chain = bucket_number_level_up != noBucket ? bucket_number_level_up : bucket_idx;
+      current_bucket = chain;
+
+      auto const probe = probeRun(chainStart(chain), key, true,
+                                  [&](size_t slot) { return inChain(slot, chain); });
+      hash_idx = probe.first;
+      if(probe.second) {
+        countTuple(hash_idx);
+        return {hash_idx, current_bucket};
+      }
+
+      // Chains started later may claim the buckets after this chain's first one, so nodes there
+      // are patched; so are all nodes of chains that share their first bucket.
+      auto const bucket = hash_idx / BucketSize;
+      if(chain >= buckets() || bucket != chain) {
+        auto& word = patch_bits[bucket / sizeof(size_t)];
+        word = word | patchBitOf(bucket);
+        patch_keys.set(hash_idx, chain + 1);
+      }
+
+      if(bucket_number_level_up == noBucket) {
+        if(chain < buckets()) {
+          markOccupied(chain_starts, chain);
         }
-        hash_idx = (hash_idx + 1) % Capacity;
+        bucket_idx = nextChain(bucket_idx);
       }
     }
 
-    return {index[hash_idx], 0};
+    // The key is written last: it publishes the slot to concurrent readers.
+    children[hash_idx] = noBucket;
+    counts[hash_idx] = 1;
+    keys[hash_idx] = key;
+
+    return {hash_idx, current_bucket};
+  }
+
+  pair<size_t, size_t> pointLookup(Tuple input_tuple, size_t bucket_number_level_up) {
+    auto const probe = probeRun(prefixStart(input_tuple, bucket_number_level_up),
+                                get<ColumnIndex>(input_tuple), true,
+                                [&](size_t slot) { return inChain(slot, bucket_number_level_up); });
+    return {probe.first, probe.second ? 1 : 0};
   }
 
   template <typename... PrefixColumns>
   pair<size_t, size_t> countPrefix(tuple<PrefixColumns...> input_tuple,
                                    size_t bucket_number_level_up) const {
-    auto hash_key = hasher(get<ColumnIndex>(input_tuple));
-    auto hash_idx = hash_key % Capacity;
+    auto const probe = probeRun(firstLevel ? homeSlot(hasher(get<ColumnIndex>(input_tuple)))
+                                           : chainStart(bucket_number_level_up),
+                                get<ColumnIndex>(input_tuple), true,
+                                [&](size_t slot) { return inChain(slot, bucket_number_level_up); });
+    return {probe.first, probe.second ? (size_t)counts[probe.first] : 0};
+  }
 
-    if constexpr(firstLevel) {
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-          return {hash_idx, index[hash_idx].prefix_count};
-        }
-        hash_idx = (hash_idx + 1) % Capacity;
-      }
+  /// Slot at which a prefix lookup starts walking this layer.
+  template <typename... PrefixColumns>
+  size_t prefixStart(tuple<PrefixColumns...> const& input_tuple,
+                     size_t bucket_number_level_up) const {
+    if constexpr(firstLevel && sizeof...(PrefixColumns) > ColumnIndex) {
+      return homeSlot(hasher(get<ColumnIndex>(input_tuple)));
+    } else if constexpr(firstLevel) {
+      return bucket_number_level_up * BucketSize;
     } else {
-      typedef tuple_element_t<ColumnIndex - 1, Tuple> PreviousColumnType;
-      hash_idx = bucket_number_level_up * BucketSize;
-
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-          auto patch_bucket = (size_t)(hash_idx / BucketSize);
-          auto patch_idx = (size_t)(patch_bucket / (double)sizeof(size_t));
-          auto patch_bit_idx = sizeof(size_t) - patch_bucket % sizeof(size_t);
-
-          if((patch_bits[patch_idx] == 0) ||
-             ((patch_bits[patch_idx] >> patch_bit_idx == 1) &&
-              ((patch_keys[hash_idx] == get<ColumnIndex - 1>(input_tuple)) ||
-               (patch_keys[hash_idx] ==
-                DefaultValue<tuple_element_t<ColumnIndex - 1, Tuple>>()())))) {
-            return {hash_idx, index[hash_idx].prefix_count};
-          }
-        }
-        hash_idx = (hash_idx + 1) % Capacity;
-      }
+      return chainStart(bucket_number_level_up);
     }
-
-    return {hash_idx, 0};
   }
 
+  /// Prefetches the slot a prefix probe starts at and the words read when it hits there.
   template <typename... PrefixColumns>
-  std::vector<size_t> prefixLookup(std::tuple<PrefixColumns...> input_tuple,
-                                   size_t bucket_number_level_up) const {
-    std::vector<size_t> results;
-    size_t hash_key;
-    size_t hash_idx;
+  void prefetchPrefix(tuple<PrefixColumns...> const& input_tuple,
+                      size_t bucket_number_level_up) const {
+    auto const slot = prefixStart(input_tuple, bucket_number_level_up);
+    prefetchSlot(keys[slot]);
+    prefetchSlot(counts[slot]);
+    prefetchSlot(children[slot]);
+  }
 
-    if constexpr(sizeof...(PrefixColumns) > ColumnIndex) {
-      hash_key = hasher(get<ColumnIndex>(input_tuple));
-      hash_idx = hash_key % Capacity;
-    } else {
-      hash_idx = bucket_number_level_up * BucketSize;
+  /// First slot from hash_idx on, within the same run, whose node belongs to the prefix and to
+  /// the chain with the given id. The flag is false once the run ends.
+  template <typename... PrefixColumns>
+  pair<size_t, bool> nextPrefixMatch(tuple<PrefixColumns...> const& input_tuple, size_t chain,
+                                     size_t hash_idx) const {
+    constexpr bool matchKey = sizeof...(PrefixColumns) > ColumnIndex;
+    KeyType key = DefaultValue<KeyType>()();
+    if constexpr(matchKey) {
+      key = get<ColumnIndex>(input_tuple);
     }
 
-    if constexpr(firstLevel) {
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if constexpr(sizeof...(PrefixColumns) > ColumnIndex) {
-          if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-            results.emplace_back(hash_idx);
-          }
-        } else {
-          results.emplace_back(hash_idx);
-        }
-        hash_idx = (hash_idx + 1) % Capacity;
-      }
-      return results;
-    } else {
-      typedef tuple_element_t<ColumnIndex - 1, Tuple> PreviousColumnType;
-      hash_idx = bucket_number_level_up * BucketSize;
-
-      while(index[hash_idx].key != DefaultValue<KeyType>()()) {
-        if constexpr(sizeof...(PrefixColumns) > ColumnIndex) {
-          if(index[hash_idx].key == get<ColumnIndex>(input_tuple)) {
-            auto patch_bucket = (size_t)(hash_idx / BucketSize);
-            auto patch_idx = (size_t)(patch_bucket / (double)sizeof(size_t));
-            auto patch_bit_idx = sizeof(size_t) - patch_bucket % sizeof(size_t);
-
-            if((patch_bits[patch_idx] == 0) ||
-               ((patch_bits[patch_idx] >> patch_bit_idx == 1) &&
-                ((patch_keys[hash_idx] == get<ColumnIndex - 1>(input_tuple)) ||
-                 (patch_keys[hash_idx] ==
-                  DefaultValue<tuple_element_t<ColumnIndex - 1, Tuple>>()())))) {
-              results.emplace_back(hash_idx);
-            }
-          }
-        } else {
-          auto patch_bucket = (size_t)(hash_idx / BucketSize);
-          auto patch_idx = (size_t)(patch_bucket / (double)sizeof(size_t));
-          auto patch_bit_idx = sizeof(size_t) - patch_bucket % sizeof(size_t);
-
-          if((patch_bits[patch_idx] == 0) ||
-             ((patch_bits[patch_idx] >> patch_bit_idx == 1) &&
-              ((patch_keys[hash_idx] == get<ColumnIndex - 1>(input_tuple)) ||
-               (patch_keys[hash_idx] ==
-                DefaultValue<tuple_element_t<ColumnIndex - 1, Tuple>>()())))) {
-            results.emplace_back(hash_idx);
-          }
-        }
-        hash_idx = (hash_idx + 1) % Capacity;
-      }
-      return results;
-    }
-    return results;
+    return probeRun(hash_idx, key, matchKey, [&](size_t slot) { return inChain(slot, chain); });
+  }
+
+  /// First slot from hash_idx on, within the same run, whose node belongs to the chain and whose
+  /// key lies in [low, high].
+  pair<size_t, bool> nextRangeMatch(size_t chain, KeyType const& low, KeyType const& high,
+                                    size_t hash_idx) const {
+    return rangeRun(hash_idx, low, high, [&](size_t slot) { return inChain(slot, chain); });
   }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,248 @@
+#ifndef _SONIC_NUMA_INDEX_H_
+#define _SONIC_NUMA_INDEX_H_
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "sonic_index.h"
+
+using namespace std;
+
+/// CPUs of a sysfs cpu list such as "0-3,8,10-11".
+inline vector<int> parseCpuList(string const& list) {
+  vector<int> cpus;
+  stringstream ranges(list);
+  string range;
+  while(getline(ranges, range, ',')) {
+    if(range.empty() || range == "\n") {
+      continue;
+    }
+    auto const dash = range.find('-');
+    auto const first = stoi(range.substr(0, dash));
+    auto const last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+    for(auto cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+/// CPUs of every online NUMA node, read from sysfs once. Machines without the node directory are
+/// treated as a single node holding every CPU.
+inline vector<vector<int>> const& numaNodeCpus() {
+  static vector<vector<int>> const nodes = [] {
+    vector<vector<int>> result;
+    string online;
+    getline(ifstream("/sys/devices/system/node/online"), online);
+    for(auto node : parseCpuList(online)) {
+      string cpus;
+      getline(ifstream("/sys/devices/system/node/node" + to_string(node) + "/cpulist"), cpus);
+      auto nodeCpus = parseCpuList(cpus);
+      if(!nodeCpus.empty()) {
+        result.push_back(move(nodeCpus));
+      }
+    }
+    if(result.empty()) {
+      result.emplace_back();
+      for(auto cpu = 0; cpu < max(thread::hardware_concurrency(), 1u); cpu++) {
+        result.back().push_back(cpu);
+      }
+    }
+    return result;
+  }();
+  return nodes;
+}
+
+/// Restricts the calling thread to the CPUs of a node, so that the pages it touches first are
+/// allocated from the node's memory. Returns false if the kernel refused the mask.
+inline bool pinToNumaNode(size_t node) {
+  auto const& nodes = numaNodeCpus();
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for(auto cpu : nodes[node % nodes.size()]) {
+    CPU_SET(cpu, &cpus);
+  }
+  return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+/// Starts a thread that pins itself to node before running task.
+template <typename Task> thread threadOnNumaNode(size_t node, Task task) {
+  return thread([node, task] {
+    pinToNumaNode(node);
+    task();
+  });
+}
+
+namespace {
+/// Sonic index with one shard of the level-0 hash range per NUMA node. Each shard is built by a
+/// thread pinned to its node, so first-touch places all of its levels in node-local memory, and
+/// the batch lookups hand every probe to threads running on the node that owns its key.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+class NumaSonicIndex {
+  static_assert(ColumnIndex == 0, "NumaSonicIndex is only defined for the whole tuple");
+
+  typedef SonicIndex<RuntimeCapacity, BucketSize, ColumnIndex, ColumnTypes...> Partition;
+  typedef tuple_element_t<0, tuple<ColumnTypes...>> FirstColumnType;
+  static constexpr DefaultSonicPolicy::Hash<FirstColumnType> hasher =
+      DefaultSonicPolicy::Hash<FirstColumnType>();
+
+  size_t partitionCapacity;
+  vector<unique_ptr<Partition>> partitions;
+
+  /// Groups positions in queries by the node owning their first column.
+  template <typename Query> vector<vector<size_t>> byNode(vector<Query> const& queries) const {
+    vector<vector<size_t>> positions(partitions.size());
+    for(auto i = 0; i < queries.size(); i++) {
+      positions[nodeOf(get<0>(queries[i]))].push_back(i);
+    }
+    return positions;
+  }
+
+  /// Answers every query with probe(partition, chunk of queries) on threadsPerNode threads pinned
+  /// to the node owning the partition, all nodes at once.
+  template <typename Query, typename Probe>
+  vector<size_t> routed(vector<Query> const& queries, size_t threadsPerNode, Probe&& probe) const {
+    vector<size_t> results(queries.size());
+    auto const positions = byNode(queries);
+    threadsPerNode = max(threadsPerNode, (size_t)1);
+    vector<thread> workers;
+    for(auto node = 0; node < partitions.size(); node++) {
+      auto const& owned = positions[node];
+      auto const chunkSize = (owned.size() + threadsPerNode - 1) / threadsPerNode;
+      for(auto t = 0; t < threadsPerNode; t++) {
+        workers.push_back(threadOnNumaNode(node, [&, &owned = owned, node, chunkSize, t] {
+          vector<Query> chunk;
+          for(auto i = t * chunkSize; i < min((t + 1) * chunkSize, owned.size()); i++) {
+            chunk.push_back(queries[owned[i]]);
+          }
+          auto const answers = probe(*partitions[node], chunk);
+          for(auto i = 0; i < answers.size(); i++) {
+            results[owned[t * chunkSize + i]] = answers[i];
+          }
+        }));
+      }
+    }
+    for(auto& worker : workers) {
+      worker.join();
+    }
+    return results;
+  }
+
+public:
+  explicit NumaSonicIndex(size_t numberOfNodes = numaNodeCpus().size()) {
+    numberOfNodes = max(numberOfNodes, (size_t)1);
+    partitionCapacity = roundUpToBucket(max(Capacity / numberOfNodes, BucketSize), BucketSize);
+    partitions.resize(numberOfNodes);
+    vector<thread> workers;
+    for(auto node = 0; node < numberOfNodes; node++) {
+      workers.push_back(threadOnNumaNode(
+          node, [this, node] { partitions[node] = make_unique<Partition>(partitionCapacity); }));
+    }
+    for(auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  NumaSonicIndex(vector<InputSchema> const& input_data,
+                 size_t numberOfNodes = numaNodeCpus().size())
+      : NumaSonicIndex(numberOfNodes) {
+    bulkLoad(input_data);
+  }
+
+  /// Inserts every tuple from a thread pinned to the node owning it, all nodes in parallel.
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  void bulkLoad(vector<InputSchema> const& input_data) {
+    auto const positions = byNode(input_data);
+    vector<thread> workers;
+    for(auto node = 0; node < partitions.size(); node++) {
+      workers.push_back(threadOnNumaNode(node, [&, node] {
+        for(auto i : positions[node]) {
+          partitions[node]->insert(input_data[i]);
+        }
+      }));
+    }
+    for(auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  size_t nodeOf(FirstColumnType const& key) const {
+    return hasher(key) % (partitionCapacity * partitions.size()) / partitionCapacity;
+  }
+
+  size_t getNumberOfNodes() const { return partitions.size(); }
+
+  void insert(tuple<ColumnTypes...> const& input_tuple) {
+    partitions[nodeOf(get<0>(input_tuple))]->insert(input_tuple);
+  }
+
+  size_t pointLookup(tuple<ColumnTypes...> const& input_tuple) {
+    return partitions[nodeOf(get<0>(input_tuple))]->pointLookup(input_tuple);
+  }
+
+  template <typename... PrefixColumns>
+  size_t countPrefix(tuple<PrefixColumns...> const& input_tuple) const {
+    return partitions[nodeOf(get<0>(input_tuple))]->template countPrefix<PrefixColumns...>(
+        input_tuple);
+  }
+
+  template <typename... PrefixColumns>
+  vector<reference_wrapper<const tuple<ColumnTypes...>>>
+  prefixLookup(tuple<PrefixColumns...> const& input_tuple) const {
+    return partitions[nodeOf(get<0>(input_tuple))]->template prefixLookup<PrefixColumns...>(
+        input_tuple);
+  }
+
+  /// countPrefix of every tuple in input_tuples, computed by threadsPerNode threads on the node
+  /// owning each prefix.
+  template <typename... PrefixColumns>
+  vector<size_t> countPrefixBatch(vector<tuple<PrefixColumns...>> const& input_tuples,
+                                  size_t threadsPerNode = 1) const {
+    return routed(input_tuples, threadsPerNode,
+                  [](Partition const& partition, vector<tuple<PrefixColumns...>> const& chunk) {
+                    return partition.countPrefixBatch(chunk);
+                  });
+  }
+
+  /// pointLookup of every tuple in input_tuples, routed like countPrefixBatch.
+  vector<size_t> pointLookupBatch(vector<tuple<ColumnTypes...>> const& input_tuples,
+                                  size_t threadsPerNode = 1) const {
+    return routed(input_tuples, threadsPerNode,
+                  [](Partition& partition, vector<tuple<ColumnTypes...>> const& chunk) {
+                    vector<size_t> results;
+                    results.reserve(chunk.size());
+                    for(auto const& input_tuple : chunk) {
+                      results.push_back(partition.pointLookup(input_tuple));
+                    }
+                    return results;
+                  });
+  }
+
+  vector<reference_wrapper<const tuple<ColumnTypes...>>> scan() const {
+    vector<reference_wrapper<const tuple<ColumnTypes...>>> results;
+    for(auto const& partition : partitions) {
+      auto partitionResults = partition->scan();
+      results.insert(results.end(), partitionResults.begin(), partitionResults.end());
+    }
+    return results;
+  }
+
+  size_t getSize() const {
+    size_t size = 0;
+    for(auto const& partition : partitions) {
+      size += partition->getSize();
+    }
+    return size;
+  }
+};
+} // namespace
+#endif
@@ -0,0 +1,151 @@
+#ifndef _SONIC_PARTITIONED_INDEX_H_
+#define _SONIC_PARTITIONED_INDEX_H_
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "sonic_index.h"
+
+using namespace std;
+
+namespace {
+/// Sonic index whose level-0 hash range is split into equally sized shards. Every shard is a
+/// runtime-sized SonicIndex with its own layers, so a build thread owning a shard writes to
+/// disjoint buckets on every level without synchronisation.
+template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+class PartitionedSonicIndex {
+  static_assert(ColumnIndex == 0, "PartitionedSonicIndex is only defined for the whole tuple");
+
+  typedef SonicIndex<RuntimeCapacity, BucketSize, ColumnIndex, ColumnTypes...> Partition;
+  typedef tuple_element_t<0, tuple<ColumnTypes...>> FirstColumnType;
+  static constexpr DefaultSonicPolicy::Hash<FirstColumnType> hasher =
+      DefaultSonicPolicy::Hash<FirstColumnType>();
+
+  size_t partitionCapacity;
+  vector<Partition> partitions;
+
+  template <typename InputSchema>
+  void parallelInsert(vector<InputSchema> const& input_data, size_t threads) {
+    threads = max(min(threads, partitions.size()), (size_t)1);
+    auto const chunkSize = (input_data.size() + threads - 1) / threads;
+    vector<vector<size_t>> histograms(threads, vector<size_t>(partitions.size() + 1, 0));
+    vector<size_t> tuplePartitions(input_data.size());
+
+    auto runOnWorkers = [threads](auto&& task) {
+      vector<thread> workers;
+      for(auto t = 1; t < threads; t++) {
+        workers.emplace_back(task, t);
+      }
+      task(0);
+      for(auto& worker : workers) {
+        worker.join();
+      }
+    };
+
+    runOnWorkers([&](size_t t) {
+      for(auto i = t * chunkSize; i < min((t + 1) * chunkSize, input_data.size()); i++) {
+        tuplePartitions[i] = partitionOf(get<0>(input_data[i]));
+        histograms[t][tuplePartitions[i] + 1]++;
+      }
+    });
+
+    vector<size_t> order(input_data.size());
+    vector<size_t> partitionOffsets(partitions.size() + 1, 0);
+    size_t offset = 0;
+    for(auto p = 0; p < partitions.size(); p++) {
+      partitionOffsets[p] = offset;
+      for(auto t = 0; t < threads; t++) {
+        auto const count = histograms[t][p + 1];
+        histograms[t][p] = offset;
+        offset += count;
+      }
+    }
+    partitionOffsets[partitions.size()] = offset;
+
+    runOnWorkers([&](size_t t) {
+      for(auto i = t * chunkSize; i < min((t + 1) * chunkSize, input_data.size()); i++) {
+        order[histograms[t][tuplePartitions[i]]++] = i;
+      }
+    });
+
+    runOnWorkers([&](size_t t) {
+      for(auto p = t; p < partitions.size(); p += threads) {
+        for(auto i = partitionOffsets[p]; i < partitionOffsets[p + 1]; i++) {
+          partitions[p].insert(input_data[order[i]]);
+        }
+      }
+    });
+  }
+
+public:
+  explicit PartitionedSonicIndex(size_t numberOfPartitions = thread::hardware_concurrency()) {
+    numberOfPartitions = max(numberOfPartitions, (size_t)1);
+    partitionCapacity = roundUpToBucket(max(Capacity / numberOfPartitions, BucketSize), BucketSize);
+    partitions.reserve(numberOfPartitions);
+    for(auto p = 0; p < numberOfPartitions; p++) {
+      partitions.emplace_back(partitionCapacity);
+    }
+  }
+
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  PartitionedSonicIndex(vector<InputSchema> const& input_data,
+                        size_t threads = thread::hardware_concurrency())
+      : PartitionedSonicIndex(threads) {
+    parallelInsert(input_data, threads);
+  }
+
+  template <typename InputSchema = tuple<ColumnTypes...>>
+  void bulkLoad(vector<InputSchema> const& input_data,
+                size_t threads = thread::hardware_concurrency()) {
+    parallelInsert(input_data, threads);
+  }
+
+  size_t partitionOf(FirstColumnType const& key) const {
+    return hasher(key) % (partitionCapacity * partitions.size()) / partitionCapacity;
+  }
+
+  size_t getNumberOfPartitions() const { return partitions.size(); }
+
+  void insert(tuple<ColumnTypes...> const& input_tuple) {
+    partitions[partitionOf(get<0>(input_tuple))].insert(input_tuple);
+  }
+
+  size_t pointLookup(tuple<ColumnTypes...> const& input_tuple) {
+    return partitions[partitionOf(get<0>(input_tuple))].pointLookup(input_tuple);
+  }
+
+  template <typename... PrefixColumns>
+  size_t countPrefix(tuple<PrefixColumns...> const& input_tuple) const {
+    return partitions[partitionOf(get<0>(input_tuple))].template countPrefix<PrefixColumns...>(
+        input_tuple);
+  }
+
+  template <typename... PrefixColumns>
+  vector<reference_wrapper<const tuple<ColumnTypes...>>>
+  prefixLookup(tuple<PrefixColumns...> const& input_tuple) const {
+    return partitions[partitionOf(get<0>(input_tuple))].template prefixLookup<PrefixColumns...>(
+        input_tuple);
+  }
+
+  vector<reference_wrapper<const tuple<ColumnTypes...>>> scan() const {
+    vector<reference_wrapper<const tuple<ColumnTypes...>>> results;
+    for(auto const& partition : partitions) {
+      auto partitionResults = partition.scan();
+      results.insert(results.end(), partitionResults.begin(), partitionResults.end());
+    }
+    return results;
+  }
+
+  size_t getSize() const {
+    size_t size = 0;
+    for(auto const& partition : partitions) {
+      size += partition.getSize();
+    }
+    return size;
+  }
+};
+} // namespace
+#endif
@@ -0,0 +1,153 @@
+#ifndef _SONIC_PERSISTENCE_H_
+#define _SONIC_PERSISTENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+using namespace std;
+
+/// On-disk layout of a Sonic index: a SonicFileHeader followed by the arrays of every level, top
+/// to bottom. Each array is stored as its element count followed by its raw slots, starting on a
+/// cache-line boundary so that a mapped file can be probed in place.
+constexpr char sonicFileMagic[8] = {'S', 'O', 'N', 'I', 'C', 'I', 'D', 'X'};
+constexpr uint32_t sonicFileVersion = 5;
+constexpr size_t sonicFileAlignment = 64;
+
+struct SonicFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t columns;
+  uint64_t capacity;
+  uint64_t bucketSize;
+  /// Policy options that change the stored arrays, one bit each.
+  uint64_t flags;
+  /// Size of every column type, in column order; files only load into identical schemas.
+  uint32_t columnSizes[16];
+};
+
+class SonicFileWriter {
+  ofstream out;
+  size_t offset = 0;
+
+  void pad() {
+    static char const zeros[sonicFileAlignment] = {};
+    auto const padding = (sonicFileAlignment - offset % sonicFileAlignment) % sonicFileAlignment;
+    out.write(zeros, padding);
+    offset += padding;
+  }
+
+public:
+  explicit SonicFileWriter(string const& path) : out(path, ios::binary | ios::trunc) {}
+
+  bool good() const { return out.good(); }
+
+  template <typename T> void value(T const& v) {
+    static_assert(is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<char const*>(&v), sizeof(T));
+    offset += sizeof(T);
+  }
+
+  template <typename T> void array(T const* slots, size_t count) {
+    value<uint64_t>(count);
+    pad();
+    out.write(reinterpret_cast<char const*>(slots), count * sizeof(T));
+    offset += count * sizeof(T);
+  }
+};
+
+/// Private, copy-on-write mapping of a whole index file. Unmodified pages stay shared with the
+/// page cache and every other process mapping the same file.
+class MappedSonicFile {
+  char* base = nullptr;
+  size_t length = 0;
+
+public:
+  explicit MappedSonicFile(string const& path) {
+    auto const fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+      return;
+    }
+    struct stat status;
+    if(fstat(fd, &status) == 0 && status.st_size > 0) {
+      auto* mapping = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if(mapping != MAP_FAILED) {
+        base = static_cast<char*>(mapping);
+        length = status.st_size;
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedSonicFile() {
+    if(base) {
+      munmap(base, length);
+    }
+  }
+
+  MappedSonicFile(MappedSonicFile const&) = delete;
+  MappedSonicFile& operator=(MappedSonicFile const&) = delete;
+
+  char* data() const { return base; }
+  size_t size() const { return length; }
+};
+
+/// Walks a mapped index file. Every accessor checks the remaining length; once a read fails the
+/// reader stays failed and hands out nothing.
+class SonicFileReader {
+  char* base;
+  size_t length;
+  size_t offset = 0;
+  bool failed = false;
+
+public:
+  explicit SonicFileReader(MappedSonicFile const& file) : base(file.data()), length(file.size()) {
+    failed = (base == nullptr);
+  }
+
+  bool good() const { return !failed; }
+
+  template <typename T> T value() {
+    static_assert(is_trivially_copyable_v<T>);
+    T v{};
+    if(failed || length - offset < sizeof(T)) {
+      failed = true;
+      return v;
+    }
+    memcpy(&v, base + offset, sizeof(T));
+    offset += sizeof(T);
+    return v;
+  }
+
+  /// Slots of the next array, which must hold exactly expectedCount elements.
+  template <typename T> T* array(size_t expectedCount) {
+    auto const count = value<uint64_t>();
+    offset += (sonicFileAlignment - offset % sonicFileAlignment) % sonicFileAlignment;
+    if(failed || count != expectedCount || offset > length ||
+       (length - offset) / sizeof(T) < count) {
+      failed = true;
+      return nullptr;
+    }
+    auto* slots = reinterpret_cast<T*>(base + offset);
+    offset += count * sizeof(T);
+    return slots;
+  }
+};
+
+/// Points array at the next array of the file. A failed read leaves the array untouched.
+template <typename Array> void mapArray(SonicFileReader& reader, Array& array, size_t count) {
+  auto* slots = reader.template array<typename Array::value_type>(count);
+  if(slots) {
+    array.borrow(slots, count);
+  }
+}
+
+#endif
@@ -0,0 +1,372 @@
+#ifndef _SONIC_PROBE_H_
+#define _SONIC_PROBE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <type_traits>
+#include <utility>
+
+#include "../../helper_functions.h"
+#include "sonic_common.h"
+
+using namespace std;
+
+/// Probe kernels comparing one cache line of contiguous slot keys against a search key and the
+/// empty marker at once. Bit i of a mask refers to the i-th key of the group.
+struct ProbeMasks {
+  uint64_t matches;
+  uint64_t empties;
+};
+
+enum class ProbeIsa { Scalar, SSE42, AVX2, AVX512 };
+
+template <typename KeyType>
+constexpr bool vectorisedProbe =
+    is_integral_v<KeyType> && (sizeof(KeyType) == 4 || sizeof(KeyType) == 8);
+
+template <typename KeyType> constexpr size_t probeGroupSize() { return 64 / sizeof(KeyType); }
+
+/// Slots appended to a key array so that the last probe group can be loaded in one piece.
+template <typename SlotType> constexpr size_t probePadding() {
+  return vectorisedProbe<SlotType> ? probeGroupSize<SlotType>() - 1 : 0;
+}
+
+template <typename KeyType> using ProbeKernel = ProbeMasks (*)(KeyType const*, KeyType, KeyType);
+
+inline uint64_t lowBits(size_t count) { return count >= 64 ? ~0ull : (1ull << count) - 1; }
+
+template <typename KeyType>
+ProbeMasks probeGroupScalar(KeyType const* keys, KeyType key, KeyType empty) {
+  ProbeMasks masks{0, 0};
+  for(auto i = 0; i < probeGroupSize<KeyType>(); i++) {
+    masks.matches |= (uint64_t)(keys[i] == key) << i;
+    masks.empties |= (uint64_t)(keys[i] == empty) << i;
+  }
+  return masks;
+}
+
+template <typename KeyType>
+__attribute__((target("sse4.2"))) ProbeMasks probeGroupSSE42(KeyType const* keys, KeyType key,
+                                                               KeyType empty) {
+  ProbeMasks masks{0, 0};
+  for(auto i = 0; i < probeGroupSize<KeyType>(); i += 16 / sizeof(KeyType)) {
+    auto const block = _mm_loadu_si128((__m128i const*)(keys + i));
+    if constexpr(sizeof(KeyType) == 4) {
+      masks.matches |= (uint64_t)_mm_movemask_ps(
+                           _mm_castsi128_ps(_mm_cmpeq_epi32(block, _mm_set1_epi32(key))))
+                       << i;
+      masks.empties |= (uint64_t)_mm_movemask_ps(
+                           _mm_castsi128_ps(_mm_cmpeq_epi32(block, _mm_set1_epi32(empty))))
+                       << i;
+    } else {
+      masks.matches |= (uint64_t)_mm_movemask_pd(
+                           _mm_castsi128_pd(_mm_cmpeq_epi64(block, _mm_set1_epi64x(key))))
+                       << i;
+      masks.empties |= (uint64_t)_mm_movemask_pd(
+                           _mm_castsi128_pd(_mm_cmpeq_epi64(block, _mm_set1_epi64x(empty))))
+                       << i;
+    }
+  }
+  return masks;
+}
+
+template <typename KeyType>
+__attribute__((target("avx2"))) ProbeMasks probeGroupAVX2(KeyType const* keys, KeyType key,
+                                                            KeyType empty) {
+  ProbeMasks masks{0, 0};
+  for(auto i = 0; i < probeGroupSize<KeyType>(); i += 32 / sizeof(KeyType)) {
+    auto const block = _mm256_loadu_si256((__m256i const*)(keys + i));
+    if constexpr(sizeof(KeyType) == 4) {
+      masks.matches |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+                           _mm256_cmpeq_epi32(block, _mm256_set1_epi32(key))))
+                       << i;
+      masks.empties |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+                           _mm256_cmpeq_epi32(block, _mm256_set1_epi32(empty))))
+                       << i;
+    } else {
+      masks.matches |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+                           _mm256_cmpeq_epi64(block, _mm256_set1_epi64x(key))))
+                       << i;
+      masks.empties |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+                           _mm256_cmpeq_epi64(block, _mm256_set1_epi64x(empty))))
+                       << i;
+    }
+  }
+  return masks;
+}
+
+template <typename KeyType>
+__attribute__((target("avx512f"))) ProbeMasks probeGroupAVX512(KeyType const* keys, KeyType key,
+                                                                 KeyType empty) {
+  auto const block = _mm512_loadu_si512((void const*)keys);
+  if constexpr(sizeof(KeyType) == 4) {
+    return {_mm512_cmpeq_epi32_mask(block, _mm512_set1_epi32(key)),
+            _mm512_cmpeq_epi32_mask(block, _mm512_set1_epi32(empty))};
+  } else {
+    return {_mm512_cmpeq_epi64_mask(block, _mm512_set1_epi64(key)),
+            _mm512_cmpeq_epi64_mask(block, _mm512_set1_epi64(empty))};
+  }
+}
+
+/// Range kernels compare a group of keys against [low, high] instead of a single key; matches
+/// then flags the keys inside the range. The SIMD compares are signed, so unsigned keys are
+/// shifted by their sign bit first, which keeps their order.
+template <typename KeyType>
+using RangeKernel = ProbeMasks (*)(KeyType const*, KeyType, KeyType, KeyType);
+
+template <typename KeyType> constexpr KeyType signBias() {
+  return is_signed_v<KeyType> ? KeyType(0) : KeyType(KeyType(1) << (8 * sizeof(KeyType) - 1));
+}
+
+template <typename KeyType>
+ProbeMasks rangeGroupScalar(KeyType const* keys, KeyType low, KeyType high, KeyType empty) {
+  ProbeMasks masks{0, 0};
+  for(auto i = 0; i < probeGroupSize<KeyType>(); i++) {
+    masks.matches |= (uint64_t)(!(keys[i] < low) && !(high < keys[i])) << i;
+    masks.empties |= (uint64_t)(keys[i] == empty) << i;
+  }
+  return masks;
+}
+
+template <typename KeyType>
+__attribute__((target("sse4.2"))) ProbeMasks rangeGroupSSE42(KeyType const* keys, KeyType low,
+                                                               KeyType high, KeyType empty) {
+  constexpr auto bias = signBias<KeyType>();
+  uint64_t outside = 0;
+  ProbeMasks masks{0, 0};
+  for(auto i = 0; i < probeGroupSize<KeyType>(); i += 16 / sizeof(KeyType)) {
+    auto const block = _mm_loadu_si128((__m128i const*)(keys + i));
+    if constexpr(sizeof(KeyType) == 4) {
+      auto const shifted = _mm_xor_si128(block, _mm_set1_epi32(bias));
+      auto const out = _mm_or_si128(_mm_cmpgt_epi32(_mm_set1_epi32(low ^ bias), shifted),
+                                    _mm_cmpgt_epi32(shifted, _mm_set1_epi32(high ^ bias)));
+      outside |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(out)) << i;
+      masks.empties |= (uint64_t)_mm_movemask_ps(
+                           _mm_castsi128_ps(_mm_cmpeq_epi32(block, _mm_set1_epi32(empty))))
+                       << i;
+    } else {
+      auto const shifted = _mm_xor_si128(block, _mm_set1_epi64x(bias));
+      auto const out = _mm_or_si128(_mm_cmpgt_epi64(_mm_set1_epi64x(low ^ bias), shifted),
+                                    _mm_cmpgt_epi64(shifted, _mm_set1_epi64x(high ^ bias)));
+      outside |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(out)) << i;
+      masks.empties |= (uint64_t)_mm_movemask_pd(
+                           _mm_castsi128_pd(_mm_cmpeq_epi64(block, _mm_set1_epi64x(empty))))
+                       << i;
+    }
+  }
+  masks.matches = ~outside & lowBits(probeGroupSize<KeyType>());
+  return masks;
+}
+
+template <typename KeyType>
+__attribute__((target("avx2"))) ProbeMasks rangeGroupAVX2(KeyType const* keys, KeyType low,
+                                                            KeyType high, KeyType empty) {
+  constexpr auto bias = signBias<KeyType>();
+  uint64_t outside = 0;
+  ProbeMasks masks{0, 0};
+  for(auto i = 0; i < probeGroupSize<KeyType>(); i += 32 / sizeof(KeyType)) {
+    auto const block = _mm256_loadu_si256((__m256i const*)(keys + i));
+    if constexpr(sizeof(KeyType) == 4) {
+      auto const shifted = _mm256_xor_si256(block, _mm256_set1_epi32(bias));
+      auto const out =
+          _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(low ^ bias), shifted),
+                          _mm256_cmpgt_epi32(shifted, _mm256_set1_epi32(high ^ bias)));
+      outside |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(out)) << i;
+      masks.empties |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+                           _mm256_cmpeq_epi32(block, _mm256_set1_epi32(empty))))
+                       << i;
+    } else {
+      auto const shifted = _mm256_xor_si256(block, _mm256_set1_epi64x(bias));
+      auto const out =
+          _mm256_or_si256(_mm256_cmpgt_epi64(_mm256_set1_epi64x(low ^ bias), shifted),
+                          _mm256_cmpgt_epi64(shifted, _mm256_set1_epi64x(high ^ bias)));
+      outside |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(out)) << i;
+      masks.empties |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+                           _mm256_cmpeq_epi64(block, _mm256_set1_epi64x(empty))))
+                       << i;
+    }
+  }
+  masks.matches = ~outside & lowBits(probeGroupSize<KeyType>());
+  return masks;
+}
+
+template <typename KeyType>
+__attribute__((target("avx512f"))) ProbeMasks rangeGroupAVX512(KeyType const* keys, KeyType low,
+                                                                 KeyType high, KeyType empty) {
+  auto const block = _mm512_loadu_si512((void const*)keys);
+  if constexpr(sizeof(KeyType) == 4 && is_signed_v<KeyType>) {
+    return {_mm512_mask_cmple_epi32_mask(
+                _mm512_cmpge_epi32_mask(block, _mm512_set1_epi32(low)), block,
+                _mm512_set1_epi32(high)),
+            _mm512_cmpeq_epi32_mask(block, _mm512_set1_epi32(empty))};
+  } else if constexpr(sizeof(KeyType) == 4) {
+    return {_mm512_mask_cmple_epu32_mask(
+                _mm512_cmpge_epu32_mask(block, _mm512_set1_epi32(low)), block,
+                _mm512_set1_epi32(high)),
+            _mm512_cmpeq_epi32_mask(block, _mm512_set1_epi32(empty))};
+  } else if constexpr(is_signed_v<KeyType>) {
+    return {_mm512_mask_cmple_epi64_mask(
+                _mm512_cmpge_epi64_mask(block, _mm512_set1_epi64(low)), block,
+                _mm512_set1_epi64(high)),
+            _mm512_cmpeq_epi64_mask(block, _mm512_set1_epi64(empty))};
+  } else {
+    return {_mm512_mask_cmple_epu64_mask(
+                _mm512_cmpge_epu64_mask(block, _mm512_set1_epi64(low)), block,
+                _mm512_set1_epi64(high)),
+            _mm512_cmpeq_epi64_mask(block, _mm512_set1_epi64(empty))};
+  }
+}
+
+inline bool supportsProbeIsa(ProbeIsa isa) {
+  __builtin_cpu_init();
+  switch(isa) {
+  case ProbeIsa::AVX512:
+    return __builtin_cpu_supports("avx512f");
+  case ProbeIsa::AVX2:
+    return __builtin_cpu_supports("avx2");
+  case ProbeIsa::SSE42:
+    return __builtin_cpu_supports("sse4.2");
+  default:
+    return true;
+  }
+}
+
+inline ProbeIsa bestProbeIsa() {
+  for(auto isa : {ProbeIsa::AVX512, ProbeIsa::AVX2, ProbeIsa::SSE42}) {
+    if(supportsProbeIsa(isa)) {
+      return isa;
+    }
+  }
+  return ProbeIsa::Scalar;
+}
+
+template <typename KeyType> ProbeKernel<KeyType> probeKernel(ProbeIsa isa) {
+  switch(isa) {
+  case ProbeIsa::AVX512:
+    return probeGroupAVX512<KeyType>;
+  case ProbeIsa::AVX2:
+    return probeGroupAVX2<KeyType>;
+  case ProbeIsa::SSE42:
+    return probeGroupSSE42<KeyType>;
+  default:
+    return probeGroupScalar<KeyType>;
+  }
+}
+
+/// The widest kernel the CPU runs, selected once at startup.
+template <typename KeyType>
+inline ProbeKernel<KeyType> const probeGroup = probeKernel<KeyType>(bestProbeIsa());
+
+template <typename KeyType> RangeKernel<KeyType> rangeKernel(ProbeIsa isa) {
+  switch(isa) {
+  case ProbeIsa::AVX512:
+    return rangeGroupAVX512<KeyType>;
+  case ProbeIsa::AVX2:
+    return rangeGroupAVX2<KeyType>;
+  case ProbeIsa::SSE42:
+    return rangeGroupSSE42<KeyType>;
+  default:
+    return rangeGroupScalar<KeyType>;
+  }
+}
+
+template <typename KeyType>
+inline RangeKernel<KeyType> const rangeGroup = rangeKernel<KeyType>(bestProbeIsa());
+
+/// Asks for the cache line holding slot to be loaded ahead of a probe.
+template <typename Slot> inline void prefetchSlot(Slot const& slot) {
+  _mm_prefetch((char const*)&slot, _MM_HINT_T0);
+}
+
+/// Walks the run of occupied slots of keys starting at hash_idx and calls visit on every slot
+/// holding key (on every occupied slot if !matchKey) until visit returns true. Returns that slot,
+/// or the empty slot ending the run, and whether visit accepted a slot. Plain integral keys are
+/// compared an aligned cache line at a time; keys needs probePadding() slots past slots.
+template <typename Keys, typename KeyType, typename Visit>
+__attribute__((always_inline)) inline pair<size_t, bool>
+probeRun(Keys const& keys, size_t slots, size_t hash_idx, KeyType const& key, bool matchKey,
+         Visit&& visit) {
+  auto const empty = DefaultValue<KeyType>()();
+
+  if constexpr(is_same_v<typename Keys::value_type, KeyType> && vectorisedProbe<KeyType>) {
+    constexpr size_t groupSize = probeGroupSize<KeyType>();
+    // Most runs end at their home slot, which a single compare settles.
+    if(keys[hash_idx] == empty) {
+      return {hash_idx, false};
+    }
+    if((!matchKey || keys[hash_idx] == key) && visit(hash_idx)) {
+      return {hash_idx, true};
+    }
+    hash_idx = nextOnRing(hash_idx, slots);
+
+    while(true) {
+      auto const groupStart = hash_idx & ~(groupSize - 1);
+      auto const groupSlots = min(groupSize, slots - groupStart);
+      auto const masks = probeGroup<KeyType>(keys.data() + groupStart, key, empty);
+      auto const inRun = lowBits(groupSlots) & ~lowBits(hash_idx - groupStart);
+      auto const empties = masks.empties & inRun;
+      auto const runEnd = empties ? (size_t)__builtin_ctzll(empties) : groupSlots;
+      auto candidates = (matchKey ? masks.matches : ~masks.empties) & inRun & lowBits(runEnd);
+      for(; candidates; candidates &= candidates - 1) {
+        auto const slot = groupStart + __builtin_ctzll(candidates);
+        if(visit(slot)) {
+          return {slot, true};
+        }
+      }
+      if(empties) {
+        return {groupStart + runEnd, false};
+      }
+      hash_idx = groupStart + groupSlots == slots ? 0 : groupStart + groupSlots;
+    }
+  } else {
+    for(; keys[hash_idx] != empty; hash_idx = nextOnRing(hash_idx, slots)) {
+      if((!matchKey || keys[hash_idx] == key) && visit(hash_idx)) {
+        return {hash_idx, true};
+      }
+    }
+    return {hash_idx, false};
+  }
+}
+
+/// Walks the run of occupied slots of keys starting at hash_idx like probeRun, but calls visit on
+/// every slot whose key lies in [low, high] until visit returns true.
+template <typename Keys, typename KeyType, typename Visit>
+__attribute__((always_inline)) inline pair<size_t, bool>
+rangeRun(Keys const& keys, size_t slots, size_t hash_idx, KeyType const& low,
+         KeyType const& high, Visit&& visit) {
+  auto const empty = DefaultValue<KeyType>()();
+
+  if constexpr(is_same_v<typename Keys::value_type, KeyType> && vectorisedProbe<KeyType>) {
+    constexpr size_t groupSize = probeGroupSize<KeyType>();
+    while(true) {
+      auto const groupStart = hash_idx & ~(groupSize - 1);
+      auto const groupSlots = min(groupSize, slots - groupStart);
+      auto const masks = rangeGroup<KeyType>(keys.data() + groupStart, low, high, empty);
+      auto const inRun = lowBits(groupSlots) & ~lowBits(hash_idx - groupStart);
+      auto const empties = masks.empties & inRun;
+      auto const runEnd = empties ? (size_t)__builtin_ctzll(empties) : groupSlots;
+      for(auto candidates = masks.matches & inRun & lowBits(runEnd); candidates;
+          candidates &= candidates - 1) {
+        auto const slot = groupStart + __builtin_ctzll(candidates);
+        if(visit(slot)) {
+          return {slot, true};
+        }
+      }
+      if(empties) {
+        return {groupStart + runEnd, false};
+      }
+      hash_idx = groupStart + groupSlots == slots ? 0 : groupStart + groupSlots;
+    }
+  } else {
+    for(; keys[hash_idx] != empty; hash_idx = nextOnRing(hash_idx, slots)) {
+      KeyType const key = keys[hash_idx];
+      if(!(key < low) && !(high < key) && visit(hash_idx)) {
+        return {hash_idx, true};
+      }
+    }
+    return {hash_idx, false};
+  }
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _SONIC_SKETCH_H_
+#define _SONIC_SKETCH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+/// HyperLogLog sketch of the distinct keys seen below a node, packed into one word of 16
+/// registers of 4 bits. A register keeps the highest rank of the hashes routed to it, so adding
+/// a key twice changes nothing and a sketch never shrinks, not even when tuples are erased.
+/// Estimates are off by about a quarter on average, which is enough to weigh join plans.
+typedef uint64_t SonicSketch;
+
+constexpr size_t sketchRegisters = 16;
+constexpr uint64_t sketchRankMask = 0xF;
+
+inline SonicSketch addToSketch(SonicSketch sketch, size_t hash) {
+  // Key hashes such as CRCHash fill 32 bits at most; the multiplication spreads them over 64.
+  auto const mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+  auto const shift = (mixed >> 60) * 4;
+  auto const rest = mixed << 4;
+  uint64_t const rank = min<uint64_t>(rest ? __builtin_clzll(rest) + 1 : 61, sketchRankMask);
+  if(rank <= (sketch >> shift & sketchRankMask)) {
+    return sketch;
+  }
+  return (sketch & ~(sketchRankMask << shift)) | rank << shift;
+}
+
+/// Distinct keys added to sketch, estimated by linear counting while registers are still empty.
+inline double sketchEstimate(SonicSketch sketch) {
+  double sum = 0;
+  size_t zeros = 0;
+  for(size_t r = 0; r < sketchRegisters; r++) {
+    auto const rank = sketch >> (4 * r) & sketchRankMask;
+    sum += ldexp(1.0, -(int)rank);
+    zeros += rank == 0;
+  }
+  double const m = sketchRegisters;
+  auto const estimate = 0.673 * m * m / sum;
+  if(estimate <= 2.5 * m && zeros > 0) {
+    return m * log(m / zeros);
+  }
+  return estimate;
+}
+
+#endif
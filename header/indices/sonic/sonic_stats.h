@@ -0,0 +1,170 @@
+#ifndef _SONIC_STATS_H_
+#define _SONIC_STATS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/// Compiling with SONIC_PROBE_STATS makes every layer count the probes it runs and the slots they
+/// visit. Without it the counters are empty and cost nothing.
+#ifdef SONIC_PROBE_STATS
+constexpr bool sonicProbeStats = true;
+#else
+constexpr bool sonicProbeStats = false;
+#endif
+
+inline size_t bitWidth(uint64_t value) { return value ? 64 - __builtin_clzll(value) : 0; }
+
+/// Shape of one level of a Sonic index. Histograms are logarithmic: entry k counts the values
+/// that need k bits, so entry 0 counts zeros, entry 1 ones, entry 2 twos and threes and so on.
+struct SonicLevelStats {
+  size_t column = 0;
+  bool leaf = false;
+  size_t slots = 0;
+  size_t buckets = 0;
+  /// Slots holding a key, including erased tuples and nodes left without tuples.
+  size_t usedSlots = 0;
+  /// Used slots whose tuple was erased or whose node has no tuple left.
+  size_t deadSlots = 0;
+  /// Buckets with every slot used, so that a probe reaching them continues into the next one.
+  size_t fullBuckets = 0;
+  /// Maximal runs of used slots by length. A probe that misses walks to the end of its run.
+  vector<size_t> runLengths;
+  size_t longestRun = 0;
+  /// Level 0 only: used slots by distance from the home slot of their key, and those of them
+  /// that overflowed out of the home bucket.
+  vector<size_t> displacements;
+  size_t overflowedSlots = 0;
+  /// Node levels below the first only: buckets flagged in the patch bits, and slots that
+  /// overflowed out of their chain's first bucket and so carry a patch key.
+  size_t patchedBuckets = 0;
+  size_t patchedSlots = 0;
+  /// Probe runs and the slots they visited, counted with SONIC_PROBE_STATS only.
+  size_t probes = 0;
+  size_t probedSlots = 0;
+  size_t longestProbe = 0;
+
+  double loadFactor() const { return slots ? usedSlots / (double)slots : 0; }
+
+  double averageRunLength() const {
+    size_t runs = 0;
+    for(auto count : runLengths) {
+      runs += count;
+    }
+    return runs ? usedSlots / (double)runs : 0;
+  }
+
+  double averageProbeLength() const { return probes ? probedSlots / (double)probes : 0; }
+};
+
+/// Slots a probe from slot from visits until it stops at slot to, on a ring of slots.
+inline size_t probedSlotsOnRing(size_t from, size_t to, size_t slots) {
+  return (to >= from ? to - from : to + slots - from) + 1;
+}
+
+inline void addToHistogram(vector<size_t>& histogram, size_t value) {
+  auto const bucket = bitWidth(value);
+  if(histogram.size() <= bucket) {
+    histogram.resize(bucket + 1, 0);
+  }
+  histogram[bucket]++;
+}
+
+/// Fills in the slot, bucket and run counts of a level whose slot i holds a key iff used(i).
+/// Runs may wrap around the end of the slots, so the walk starts behind an unused slot.
+template <typename Used>
+void countRuns(SonicLevelStats& stats, size_t slots, size_t bucketSize, Used&& used) {
+  stats.slots = slots;
+  stats.buckets = slots / bucketSize;
+  size_t bucketUsed = 0;
+  for(size_t i = 0; i < slots; i++) {
+    auto const isUsed = used(i);
+    stats.usedSlots += isUsed;
+    bucketUsed += isUsed;
+    if(i % bucketSize == bucketSize - 1) {
+      stats.fullBuckets += bucketUsed == bucketSize;
+      bucketUsed = 0;
+    }
+  }
+  if(stats.usedSlots == slots) {
+    addToHistogram(stats.runLengths, slots);
+    stats.longestRun = slots;
+    return;
+  }
+
+  size_t start = 0;
+  while(used(start)) {
+    start++;
+  }
+  size_t run = 0;
+  for(size_t n = 1; n <= slots; n++) {
+    auto const i = (start + n) % slots;
+    if(used(i)) {
+      run++;
+    } else if(run > 0) {
+      addToHistogram(stats.runLengths, run);
+      stats.longestRun = max(stats.longestRun, run);
+      run = 0;
+    }
+  }
+}
+
+/// Fills in the displacements of a level-0 layer whose slot i holds a key with home slot home(i)
+/// iff used(i).
+template <typename Used, typename Home>
+void countDisplacements(SonicLevelStats& stats, size_t slots, size_t bucketSize, Used&& used,
+                        Home&& home) {
+  for(size_t i = 0; i < slots; i++) {
+    if(used(i)) {
+      auto const homeSlot = home(i);
+      addToHistogram(stats.displacements, probedSlotsOnRing(homeSlot, i, slots) - 1);
+      stats.overflowedSlots += homeSlot / bucketSize != i / bucketSize;
+    }
+  }
+}
+
+/// Probe counters of one layer. They are atomic so that concurrent readers can count too, and
+/// relaxed, since they are only ever read as a whole by stats.
+class SonicProbeCounters {
+#ifdef SONIC_PROBE_STATS
+  mutable atomic<size_t> probes{0};
+  mutable atomic<size_t> probedSlots{0};
+  mutable atomic<size_t> longestProbe{0};
+
+public:
+  SonicProbeCounters() = default;
+  SonicProbeCounters(SonicProbeCounters const& other) noexcept { *this = other; }
+
+  SonicProbeCounters& operator=(SonicProbeCounters const& other) noexcept {
+    probes.store(other.probes.load(memory_order_relaxed), memory_order_relaxed);
+    probedSlots.store(other.probedSlots.load(memory_order_relaxed), memory_order_relaxed);
+    longestProbe.store(other.longestProbe.load(memory_order_relaxed), memory_order_relaxed);
+    return *this;
+  }
+
+  void record(size_t visitedSlots) const {
+    probes.fetch_add(1, memory_order_relaxed);
+    probedSlots.fetch_add(visitedSlots, memory_order_relaxed);
+    auto longest = longestProbe.load(memory_order_relaxed);
+    while(visitedSlots > longest &&
+          !longestProbe.compare_exchange_weak(longest, visitedSlots, memory_order_relaxed)) {
+    }
+  }
+
+  void addTo(SonicLevelStats& stats) const {
+    stats.probes = probes.load(memory_order_relaxed);
+    stats.probedSlots = probedSlots.load(memory_order_relaxed);
+    stats.longestProbe = longestProbe.load(memory_order_relaxed);
+  }
+#else
+public:
+  void record(size_t) const {}
+  void addTo(SonicLevelStats&) const {}
+#endif
+};
+
+#endif
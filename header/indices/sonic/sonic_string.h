@@ -0,0 +1,140 @@
+#ifndef _SONIC_STRING_H_
+#define _SONIC_STRING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <nmmintrin.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../../helper_functions.h"
+
+using namespace std;
+
+/// String column value of 16 bytes in the layout of German strings: the length, then either the
+/// whole string if it has at most 12 characters, or its first four characters followed by the
+/// offset of the string in the SonicStringArena that interned it. Every distinct string is stored
+/// once per arena, so two keys of one arena are equal exactly when their 16 bytes are, and a
+/// Sonic slot compares and hashes them without leaving the slot.
+struct SonicString {
+  static constexpr size_t inlineLength = 12;
+  static constexpr size_t prefixLength = 4;
+
+  uint32_t length = 0;
+  char chars[inlineLength] = {};
+
+  bool isInline() const { return length <= inlineLength; }
+
+  uint64_t arenaOffset() const {
+    uint64_t offset;
+    memcpy(&offset, chars + prefixLength, sizeof(offset));
+    return offset;
+  }
+
+  bool operator==(SonicString const& other) const {
+    return memcmp(this, &other, sizeof(SonicString)) == 0;
+  }
+  bool operator!=(SonicString const& other) const { return !(*this == other); }
+};
+
+static_assert(sizeof(SonicString) == 16, "SonicString must fill exactly two words");
+
+template <> inline SonicString DefaultValue<SonicString>::operator()() const {
+  return SonicString();
+}
+
+template <> inline size_t CRCHash<SonicString>::operator()(SonicString const& key) const {
+  uint64_t words[2];
+  memcpy(words, &key, sizeof(words));
+  return _mm_crc32_u64(_mm_crc32_u64(0, words[0]), words[1]);
+}
+
+/// Append-only storage of the strings longer than SonicString::inlineLength, each kept once.
+class SonicStringArena {
+  vector<char> bytes;
+  /// Offsets of the stored strings by the hash of their characters.
+  unordered_multimap<size_t, uint64_t> offsets;
+
+  static SonicString longKey(string_view value, uint64_t offset) {
+    SonicString key;
+    key.length = value.size();
+    memcpy(key.chars, value.data(), SonicString::prefixLength);
+    memcpy(key.chars + SonicString::prefixLength, &offset, sizeof(offset));
+    return key;
+  }
+
+  /// Offset of value if it is stored, or the end of the arena otherwise.
+  uint64_t offsetOf(string_view value, size_t hash) const {
+    auto const matches = offsets.equal_range(hash);
+    for(auto match = matches.first; match != matches.second; match++) {
+      if(match->second + value.size() <= bytes.size() &&
+         string_view(bytes.data() + match->second, value.size()) == value) {
+        return match->second;
+      }
+    }
+    return bytes.size();
+  }
+
+public:
+  static SonicString inlineKey(string_view value) {
+    SonicString key;
+    key.length = value.size();
+    memcpy(key.chars, value.data(), value.size());
+    return key;
+  }
+
+  /// Key of value, storing its characters first if they are new to the arena.
+  SonicString intern(string_view value) {
+    if(value.size() <= SonicString::inlineLength) {
+      return inlineKey(value);
+    }
+    auto const hash = std::hash<string_view>()(value);
+    auto offset = offsetOf(value, hash);
+    if(offset == bytes.size()) {
+      bytes.insert(bytes.end(), value.begin(), value.end());
+      offsets.emplace(hash, offset);
+    }
+    return longKey(value, offset);
+  }
+
+  /// Key of value for lookups, which never stores anything. A string the arena has not seen
+  /// gets a key that equals no interned one, so probing for it finds nothing.
+  SonicString find(string_view value) const {
+    if(value.size() <= SonicString::inlineLength) {
+      return inlineKey(value);
+    }
+    auto const offset = offsetOf(value, std::hash<string_view>()(value));
+    return longKey(value, offset == bytes.size() ? numeric_limits<uint64_t>::max() : offset);
+  }
+
+  /// Characters of key, valid as long as key and the arena are neither changed nor destroyed.
+  string_view view(SonicString const& key) const {
+    if(key.isInline()) {
+      return string_view(key.chars, key.length);
+    }
+    return string_view(bytes.data() + key.arenaOffset(), key.length);
+  }
+
+  /// Orders keys like their strings. Keys whose first four characters differ are ordered by
+  /// their slots alone; only ties on the prefix read the arena.
+  int compare(SonicString const& left, SonicString const& right) const {
+    auto const prefix = min<size_t>(SonicString::prefixLength, min(left.length, right.length));
+    auto const order = memcmp(left.chars, right.chars, prefix);
+    if(order != 0) {
+      return order;
+    }
+    return view(left).compare(view(right));
+  }
+
+  size_t memoryUsage() const {
+    return bytes.capacity() + offsets.bucket_count() * sizeof(void*) +
+           offsets.size() * (sizeof(size_t) + sizeof(uint64_t) + sizeof(void*));
+  }
+};
+
+#endif
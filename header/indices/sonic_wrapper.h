@@ -1,6 +1,7 @@
 #ifndef _SONIC_WRAPPER_H_
 #define _SONIC_WRAPPER_H_
 
+#include <thread>
 #include <utility>
 
 #include "sonic/sonic_index.h"
@@ -69,12 +70,56 @@ public:
                                                        ViablePrefixLengthValuesSequence{});
   }
 
+  template <typename Visit, size_t... PrefixIndices>
+  void forEachByPrefixWithIndices(TupleOfTypesInTotalOrder const& t, Visit& visit,
+                                  index_sequence<PrefixIndices...> const) const {
+    TupleOfTypesInTotalOrder result = t;
+    for(auto cursor = index.prefixCursor(
+            tuple{get<get<PrefixIndices>(tuple{OffsetsOfStoredTuplesInTotalOrder...})>(t)...});
+        cursor.valid(); cursor.next()) {
+      tie(get<OffsetsOfStoredTuplesInTotalOrder>(result)...) = *cursor;
+      visit(as_const(result));
+    }
+  }
+
+  template <size_t PrefixLength, typename Visit,
+            typename Indices = make_index_sequence<PrefixLength>>
+  void forEachByPrefixWithLength(TupleOfTypesInTotalOrder const& t, Visit& visit) const {
+    forEachByPrefixWithIndices(t, visit, Indices{});
+  }
+
+  template <typename Visit, size_t... ViablePrefixLengthValues>
+  void forEachByPrefixGivenViablePrefixLengthValues(
+      TupleOfTypesInTotalOrder const& t, size_t const prefixLength, Visit& visit,
+      index_sequence<ViablePrefixLengthValues...> const&) const {
+    ((ViablePrefixLengthValues + 1 == prefixLength
+          ? forEachByPrefixWithLength<ViablePrefixLengthValues + 1>(t, visit)
+          : void()),
+     ...);
+  }
+
+  /// Streaming counterpart of lookupByPrefixAndScatterIntoTuple: calls visit on every scattered
+  /// tuple while the index cursor walks the buckets, without building a result vector.
+  template <typename Visit, typename ViablePrefixLengthValuesSequence = make_index_sequence<
+                                sizeof...(OffsetsOfStoredTuplesInTotalOrder)>>
+  void forEachByPrefixAndScatterIntoTuple(TupleOfTypesInTotalOrder const& t,
+                                          size_t const prefixLength, Visit&& visit) const {
+    forEachByPrefixGivenViablePrefixLengthValues(t, prefixLength, visit,
+                                                 ViablePrefixLengthValuesSequence{});
+  }
+
   size_t getIndexSize() const { return index.getSize(); }
 
   template <typename TupleSchema> void insertIntoIndex(TupleSchema const& input_tuple) {
     index.insert(input_tuple);
   }
 
+  template <typename TupleSchema, typename BulkLoadedIndex = Index>
+  auto bulkLoadIntoIndex(vector<TupleSchema> const& input_tuples)
+      -> decltype(declval<BulkLoadedIndex&>().bulkLoad(input_tuples, size_t())) {
+    return index.bulkLoad(input_tuples, thread::hardware_concurrency());
+  }
+
   template <size_t... PrefixIndices>
   size_t countByPrefixWithIndices(TupleOfTypesInTotalOrder const& t,
                                   index_sequence<PrefixIndices...> const) const {
@@ -110,17 +155,62 @@ public:
                                                       ViablePrefixLengthValuesSequence{});
   }
 
+  template <size_t... PrefixIndices>
+  double estimateByPrefixWithIndices(TupleOfTypesInTotalOrder const& t,
+                                     index_sequence<PrefixIndices...> const) const {
+    return index.estimatePrefix(
+        tuple{(get<get<PrefixIndices>(tuple{OffsetsOfStoredTuplesInTotalOrder...})>(t))...});
+  }
+
+  template <size_t... ViablePrefixLengthValues>
+  double estimateByPrefixGivenViablePrefixLengthValues(
+      TupleOfTypesInTotalOrder const& t, size_t const prefixLength,
+      index_sequence<ViablePrefixLengthValues...> const&) const {
+    double r = 0;
+    ((r = ((ViablePrefixLengthValues + 1 == prefixLength)
+               ? estimateByPrefixWithIndices(t, make_index_sequence<ViablePrefixLengthValues + 1>{})
+               : r)),
+     ...);
+    return r;
+  }
+
+  /// countPrefix from the node sketches of the index, for join planning. Only sketched indices
+  /// offer it; the join counts exactly on the others.
+  template <typename EstimatingIndex = Index,
+            typename ViablePrefixLengthValuesSequence =
+                make_index_sequence<sizeof...(OffsetsOfStoredTuplesInTotalOrder)>>
+  auto estimatePrefix(TupleOfTypesInTotalOrder const& t, size_t const prefixLength) const
+      -> enable_if_t<EstimatingIndex::sketchedPrefixes, double> {
+    return estimateByPrefixGivenViablePrefixLengthValues(t, prefixLength,
+                                                         ViablePrefixLengthValuesSequence{});
+  }
+
+  /// Every tuple of the index scattered into t, in one buffer per scanning thread. The threads
+  /// scatter straight from the leaf slots, without a vector of references in between.
+  vector<vector<TupleOfTypesInTotalOrder>>
+  scanIndexPartitioned(TupleOfTypesInTotalOrder const& t) const {
+    return index.template scanPartitioned<TupleOfTypesInTotalOrder>(
+        thread::hardware_concurrency(), [&](auto const& tupleFromIndex) {
+          TupleOfTypesInTotalOrder result = t;
+          tie(get<OffsetsOfStoredTuplesInTotalOrder>(result)...) = tupleFromIndex;
+          return result;
+        });
+  }
+
   vector<TupleOfTypesInTotalOrder> scanIndex(TupleOfTypesInTotalOrder const& t) const {
-    auto resultFromIndex = index.scan();
+    auto partitions = scanIndexPartitioned(t);
+    if(partitions.size() == 1) {
+      return move(partitions[0]);
+    }
+    size_t size = 0;
+    for(auto const& partition : partitions) {
+      size += partition.size();
+    }
     vector<TupleOfTypesInTotalOrder> resultTuples;
-    resultTuples.reserve(resultFromIndex.size());
-
-    for(auto tupleFromIndexRef : resultFromIndex) {
-      TupleOfTypesInTotalOrder result = t;
-      tie(get<OffsetsOfStoredTuplesInTotalOrder>(result)...) = tupleFromIndexRef.get();
-      resultTuples.emplace_back(result);
+    resultTuples.reserve(size);
+    for(auto const& partition : partitions) {
+      resultTuples.insert(resultTuples.end(), partition.begin(), partition.end());
     }
-
     return resultTuples;
   }
 };
@@ -2,10 +2,43 @@
 #define _RELATION_H_
 
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 template <size_t... I> using AttributeIndex = std::index_sequence<I...>;
 
+template <typename Index, typename TupleSchema, typename = void>
+struct SupportsBulkLoad : std::false_type {};
+template <typename Index, typename TupleSchema>
+struct SupportsBulkLoad<Index, TupleSchema,
+                        std::void_t<decltype(std::declval<Index&>().bulkLoadIntoIndex(
+                            std::declval<std::vector<TupleSchema> const&>()))>> : std::true_type {};
+
+template <typename Index, typename Tuple, typename = void>
+struct SupportsPrefixStreaming : std::false_type {};
+template <typename Index, typename Tuple>
+struct SupportsPrefixStreaming<
+    Index, Tuple,
+    std::void_t<decltype(std::declval<Index const&>().forEachByPrefixAndScatterIntoTuple(
+        std::declval<Tuple const&>(), size_t(), std::declval<void (*)(Tuple const&)>()))>>
+    : std::true_type {};
+
+template <typename Index, typename Tuple, typename = void>
+struct SupportsPartitionedScan : std::false_type {};
+template <typename Index, typename Tuple>
+struct SupportsPartitionedScan<
+    Index, Tuple,
+    std::void_t<decltype(std::declval<Index const&>().scanIndexPartitioned(
+        std::declval<Tuple const&>()))>> : std::true_type {};
+
+template <typename Index, typename Tuple, typename = void>
+struct SupportsPrefixEstimates : std::false_type {};
+template <typename Index, typename Tuple>
+struct SupportsPrefixEstimates<Index, Tuple,
+                               std::void_t<decltype(std::declval<Index const&>().estimatePrefix(
+                                   std::declval<Tuple const&>(), size_t()))>> : std::true_type {};
+
 template <typename... T> class Relation;
 
 template <typename Index, typename InputTupleSchema, size_t... IndexInTotalOrder,
@@ -20,8 +53,19 @@ public:
       std::tuple{IndexInTotalOrder...};
 
   Relation(size_t const label_, std::vector<InputTupleSchema> const& input_tuples) : label(label_) {
-    for(auto i = 0; i < input_tuples.size(); i++) {
-      wrappedIndex.insertIntoIndex(std::tuple{std::get<OrderedIndex>(input_tuples[i])...});
+    using OrderedTupleSchema = std::tuple<std::tuple_element_t<OrderedIndex, InputTupleSchema>...>;
+
+    if constexpr(SupportsBulkLoad<Index, OrderedTupleSchema>::value) {
+      std::vector<OrderedTupleSchema> ordered_tuples;
+      ordered_tuples.reserve(input_tuples.size());
+      for(auto i = 0; i < input_tuples.size(); i++) {
+        ordered_tuples.emplace_back(std::get<OrderedIndex>(input_tuples[i])...);
+      }
+      wrappedIndex.bulkLoadIntoIndex(ordered_tuples);
+    } else {
+      for(auto i = 0; i < input_tuples.size(); i++) {
+        wrappedIndex.insertIntoIndex(std::tuple{std::get<OrderedIndex>(input_tuples[i])...});
+      }
     }
   }
 
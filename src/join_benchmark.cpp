@@ -58,11 +58,55 @@ template <typename HTrieIndex, typename TupleOfTypesInTotalOrder,
 using HTrieIndexAdapter = IndexToTotalOrderAdapter<HTrieIndex, TupleOfTypesInTotalOrder,
                                                    OffsetsOfStoredTuplesInTotalOrder...>;
 
+template <typename Relation, typename = void> struct ReportsFilterStats : false_type {};
+
+template <typename Relation>
+struct ReportsFilterStats<
+    Relation,
+    enable_if_t<decay_t<decltype(declval<Relation const&>().wrappedIndex.index)>::filteredPrefixes>>
+    : true_type {};
+
+/// Exports the prefix filters of the relations of a join, outside the timing: the share of their
+/// bits that is set and, in builds with SONIC_PROBE_STATS, how many lookups they rejected as
+/// definite misses.
+template <typename... Relations>
+void reportFilterStats(benchmark::State& state, tuple<Relations&...> const& relationSet) {
+  if constexpr(!(ReportsFilterStats<Relations>::value || ...)) {
+    return;
+  }
+  state.PauseTiming();
+  size_t filters = 0, probes = 0, rejections = 0;
+  double fill = 0;
+  apply(
+      [&](auto const&... relations) {
+        (
+            [&](auto const& relation) {
+              if constexpr(ReportsFilterStats<decay_t<decltype(relation)>>::value) {
+                for(auto const& filter : relation.wrappedIndex.index.filterStats()) {
+                  filters++;
+                  fill += filter.fillRatio;
+                  probes += filter.probes;
+                  rejections += filter.rejections;
+                }
+              }
+            }(relations),
+            ...);
+      },
+      relationSet);
+  state.counters["FilterFill"] = fill / filters;
+  if constexpr(sonicProbeStats) {
+    state.counters["FilterProbes"] = probes;
+    state.counters["FilterRejectionRate"] = probes ? rejections / (double)probes : 0;
+  }
+  state.ResumeTiming();
+}
+
 static const char BINARY_JOIN[] = "BinaryJoin";
 static const char ART_GENERIC_JOIN[] = "ARTJoin";
 static const char BTREE_GENERIC_JOIN[] = "BTreeJoin";
 static const char HTRIE_GENERIC_JOIN[] = "HTrieJoin";
 static const char SONIC_GENERIC_JOIN[] = "SonicGenericJoin";
+static const char FILTERED_SONIC_GENERIC_JOIN[] = "FilteredSonicGenericJoin";
 static const char HIERARCHICAL_MAP_GENERIC_JOIN[] = "HierarchicalMapGenericJoin";
 
 template <size_t RowSize, size_t BucketSize,
@@ -116,6 +160,7 @@ static void ThreeTableJoin(benchmark::State& state) {
         relationSet = {*R, *S, *T};
     join3<totalOrderSchema>(relationSet);
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -180,6 +225,7 @@ static void FourTableJoin(benchmark::State& state) {
         relationSet = {*A, *B, *C, *D};
     join4<totalOrderSchema>(relationSet);
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -256,6 +302,7 @@ static void FiveTableJoin(benchmark::State& state) {
     join5<totalOrderSchema>(relationSet);
     ;
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -345,6 +392,7 @@ static void SixTableJoin(benchmark::State& state) {
     join6<totalOrderSchema>(relationSet);
     ;
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -435,6 +483,7 @@ static void SixTableJoin2(benchmark::State& state) {
     join6_2<totalOrderSchema>(relationSet);
     ;
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -499,6 +548,7 @@ static void RectangleJoin(benchmark::State& state) {
         relationSet = {*A, *B, *C, *D};
     joinRec<totalOrderSchema>(relationSet);
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -581,6 +631,7 @@ static void PentagonJoin(benchmark::State& state) {
     joinPen<totalOrderSchema>(relationSet);
     ;
     vtune.stopSampling();
+    reportFilterStats(state, relationSet);
   }
 }
 
@@ -607,6 +658,8 @@ static void Join(benchmark::State& state) {
        {"HTrieJoin", JoinBenchmark<RowSize, BucketSize, BTreeIndex, BTreeIndexAdapter>},
        {"SonicGenericJoin",
         JoinBenchmark<RowSize, BucketSize, SonicIndex, SonicToTotalOrderLookupAdapter>},
+       {"FilteredSonicGenericJoin",
+        JoinBenchmark<RowSize, BucketSize, FilteredSonicIndex, SonicToTotalOrderLookupAdapter>},
        {"HierarchicalMapGenericJoin",
         JoinBenchmark<RowSize, BucketSize, HierarchicalAbseilHashIndex,
                       HierarchicalAbseilHashIndexAdapter>}})
@@ -641,6 +694,13 @@ BENCHMARK_TEMPLATE(Join, 1048576, 4, SONIC_GENERIC_JOIN)
     ->Arg(62)
     ->Unit(benchmark::kMillisecond);
 
+BENCHMARK_TEMPLATE(Join, 1048576, 4, FILTERED_SONIC_GENERIC_JOIN)
+    ->Arg(4)
+    ->Arg(5)
+    ->Arg(61)
+    ->Arg(62)
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK_TEMPLATE(Join, 1048576, 4, HIERARCHICAL_MAP_GENERIC_JOIN)
     ->Arg(4)
     ->Arg(5)
@@ -672,6 +732,9 @@ static void TwoColumn_Counting(benchmark::State& state) {
         TwoColumnCountingBenchmark<RowSize, BucketSize, BTreeIndex, BTreeIndexAdapter>},
        {"SonicGenericJoin", TwoColumnCountingBenchmark<RowSize, BucketSize, SonicIndex,
                                                        SonicToTotalOrderLookupAdapter>},
+       {"FilteredSonicGenericJoin",
+        TwoColumnCountingBenchmark<RowSize, BucketSize, FilteredSonicIndex,
+                                   SonicToTotalOrderLookupAdapter>},
        {"HierarchicalMapGenericJoin",
         TwoColumnCountingBenchmark<RowSize, BucketSize, HierarchicalAbseilHashIndex,
                                    HierarchicalAbseilHashIndexAdapter>}})
@@ -693,9 +756,108 @@ BENCHMARK_TEMPLATE(TwoColumn_Counting, 16777216, 4, SONIC_GENERIC_JOIN)
     ->Ranges({{3, 5}})
     ->Unit(benchmark::kMillisecond);
 
+BENCHMARK_TEMPLATE(TwoColumn_Counting, 16777216, 4, FILTERED_SONIC_GENERIC_JOIN)
+    ->RangeMultiplier(2)
+    ->Ranges({{3, 5}})
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK_TEMPLATE(TwoColumn_Counting, 16777216, 4, HIERARCHICAL_MAP_GENERIC_JOIN)
     ->RangeMultiplier(2)
     ->Ranges({{3, 5}})
     ->Unit(benchmark::kMillisecond);
 
+////////////////////////////////////// DICTIONARY ENCODING //////////////////////////////
+
+/// Triangle query of ThreeTableJoin over columns of ColumnType.
+template <typename ColumnType, size_t RowSize, size_t BucketSize,
+          template <size_t, size_t, size_t, typename...> typename Index,
+          template <typename, typename, size_t...> typename IndexAdapter>
+static vector<tuple<ColumnType, ColumnType, ColumnType>>
+triangleJoin(vector<tuple<ColumnType, ColumnType>> const& tableR,
+             vector<tuple<ColumnType, ColumnType>> const& tableS,
+             vector<tuple<ColumnType, ColumnType>> const& tableT) {
+  size_t constexpr Capacity = RowSize << 1;
+
+  using totalOrderSchema = tuple<ColumnType, ColumnType, ColumnType>;
+  using inputSchema = tuple<ColumnType, ColumnType>;
+  using IndexType = Index<Capacity, BucketSize, 0, ColumnType, ColumnType>;
+
+  using IndexAdapterR = IndexAdapter<IndexType, totalOrderSchema, 0, 1>;
+  using RelationR =
+      Relation<IndexAdapterR, inputSchema, AttributeIndex<1, 0>, AttributeIndex<1, 0>>;
+  using IndexAdapterS = IndexAdapter<IndexType, totalOrderSchema, 0, 2>;
+  using RelationS =
+      Relation<IndexAdapterS, inputSchema, AttributeIndex<0, 2>, AttributeIndex<0, 1>>;
+  using IndexAdapterT = IndexAdapter<IndexType, totalOrderSchema, 1, 2>;
+  using RelationT =
+      Relation<IndexAdapterT, inputSchema, AttributeIndex<1, 2>, AttributeIndex<0, 1>>;
+
+  auto R = make_unique<RelationR>(1, tableR);
+  auto S = make_unique<RelationS>(2, tableS);
+  auto T = make_unique<RelationT>(3, tableT);
+  tuple<RelationR&, RelationS&, RelationT&> relationSet = {*R, *S, *T};
+  return join3<totalOrderSchema>(relationSet);
+}
+
+/// Triangle join on the "join" tables with every value spelled out as a string too long for the
+/// small string buffer. Arg 0 joins the strings, Arg 1 encodes the three tables with one shared
+/// dictionary per attribute, joins the codes and decodes the result, all inside the timing.
+template <size_t RowSize, size_t BucketSize,
+          template <size_t, size_t, size_t, typename...> typename Index,
+          template <typename, typename, size_t...> typename IndexAdapter>
+static void DictionaryEncodedJoinBenchmark(benchmark::State& state) {
+  auto stringTable = [] {
+    vector<tuple<string, string>> table;
+    for(auto const& row : datagenerator::Table<int, int>::generateIntegerTuples("join", RowSize)) {
+      table.emplace_back("attribute value " + to_string(get<0>(row)),
+                         "attribute value " + to_string(get<1>(row)));
+    }
+    return table;
+  };
+  auto const tableR = stringTable();
+  auto const tableS = stringTable();
+  auto const tableT = stringTable();
+
+  size_t outputTuples = 0;
+  for(auto _ : state) {
+    if(state.range(0) == 0) {
+      auto result = triangleJoin<string, RowSize, BucketSize, Index, IndexAdapter>(tableR, tableS,
+                                                                                 tableT);
+      outputTuples = result.size();
+      benchmark::DoNotOptimize(result.data());
+    } else {
+      Dictionary<string> first, second, third;
+      auto result = decodeRows(
+          triangleJoin<int, RowSize, BucketSize, Index, IndexAdapter>(
+              encodeRows(tableR, second, first), encodeRows(tableS, first, third),
+              encodeRows(tableT, second, third)),
+          first, second, third);
+      outputTuples = result.size();
+      benchmark::DoNotOptimize(result.data());
+    }
+  }
+  state.counters["OutputTuples"] = outputTuples;
+}
+
+template <size_t RowSize, size_t BucketSize, const char* JoinType>
+static void Dictionary_Encoded_Join(benchmark::State& state) {
+  map<string, function<void(benchmark::State&)>>(
+      {{"SonicGenericJoin", DictionaryEncodedJoinBenchmark<RowSize, BucketSize, SonicIndex,
+                                                           SonicToTotalOrderLookupAdapter>},
+       {"HierarchicalMapGenericJoin",
+        DictionaryEncodedJoinBenchmark<RowSize, BucketSize, HierarchicalAbseilHashIndex,
+                                       HierarchicalAbseilHashIndexAdapter>}})
+      .at(JoinType)(state);
+}
+
+BENCHMARK_TEMPLATE(Dictionary_Encoded_Join, 262144, 4, SONIC_GENERIC_JOIN)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(Dictionary_Encoded_Join, 262144, 4, HIERARCHICAL_MAP_GENERIC_JOIN)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK_MAIN();
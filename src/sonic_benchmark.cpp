@@ -11,12 +11,22 @@
 #include "../header/indices/hierarchical_hashtable.hpp"
 #include "../header/indices/htrie_wrapper.h"
 #include "../header/indices/robin_wrapper.h"
+#include "../header/indices/sonic/sonic_adaptive_index.h"
+#include "../header/indices/sonic/sonic_growable_index.h"
 #include "../header/indices/sonic/sonic_index.h"
+#include "../header/indices/sonic/sonic_numa_index.h"
+#include "../header/indices/sonic/sonic_partitioned_index.h"
+#include "../header/indices/sonic/sonic_string.h"
 #include "../header/indices/surf_wrapper.h"
 
 #include <absl/container/flat_hash_map.h>
 
+#include <fstream>
 #include <iostream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #define NUMBER_OF_ROWS 8192 << 5
 #define SONIC_BUCKET_SIZE 8
@@ -30,10 +40,26 @@ template <typename K, typename V> using AbseilHashAdapter = absl::flat_hash_map<
 template <typename... ColumnTypes>
 using HierarchicalAbseilHashAdapter = HierarchicalMap<AbseilHashAdapter, ColumnTypes...>;
 
+template <template <typename> typename HashFunction, size_t Capacity, size_t BucketSize,
+          typename... ColumnTypes>
+using HashedSonicIndex =
+    BasicSonicIndex<HashedSonicPolicy<HashFunction>, Capacity, BucketSize, 0, ColumnTypes...>;
+
+template <size_t Capacity, size_t BucketSize, typename... ColumnTypes>
+using HugePageSonicIndex =
+    BasicSonicIndex<HugePageSonicPolicy<>, Capacity, BucketSize, 0, ColumnTypes...>;
+
 template <size_t N> constexpr size_t Log2() { return ((N < 2) ? 1 : 1 + Log2<N / 2>()); }
 
 template <size_t R, size_t B> constexpr size_t Capacity() { return (R << (Log2<B>())); }
 
+/// SonicIndex whose levels are sized at construction, to a slot count that is not a power of two.
+template <size_t SlotCount, size_t BucketSize, typename... ColumnTypes>
+struct RuntimeSizedSonicIndex : SonicIndex<RuntimeCapacity, BucketSize, 0, ColumnTypes...> {
+  RuntimeSizedSonicIndex(vector<tuple<ColumnTypes...>> const& table)
+      : SonicIndex<RuntimeCapacity, BucketSize, 0, ColumnTypes...>(table, SlotCount) {}
+};
+
 template <typename Index, typename LookupTable, typename ColumnTuple, size_t... I>
 size_t lookup(Index& index, LookupTable& lookupTable, size_t rowSize, ColumnTuple tuple,
               index_sequence<I...>) {
@@ -48,12 +74,159 @@ size_t countPrefix(Index& index, LookupTable& lookupTable, size_t rowSize, Colum
   return index.template countPrefix<tuple_element_t<I, ColumnTuple>...>(lookupTuple);
 }
 
+template <typename Row, size_t... I> auto prefixOf(Row const& row, index_sequence<I...>) {
+  return make_tuple(get<I>(row)...);
+}
+
+template <typename Index, typename = void> struct ReportsMemory : false_type {};
+
+template <typename Index>
+struct ReportsMemory<Index, void_t<decltype(declval<Index const&>().memoryUsage())>>
+    : true_type {};
+
+template <typename Index, typename = void> struct CompactsExplicitly : false_type {};
+
+template <typename Index>
+struct CompactsExplicitly<Index, void_t<decltype(declval<Index&>().compact())>> : true_type {};
+
+/// Reports the footprint of indices that can tell it next to the measured latency.
+template <typename Index>
+void reportMemoryPerTuple(benchmark::State& state, Index const& index, size_t rows) {
+  if constexpr(ReportsMemory<Index>::value) {
+    state.counters["BytesPerTuple"] = index.memoryUsage() / (double)rows;
+  }
+}
+
+template <typename Index, typename = void> struct ReportsLevelStats : false_type {};
+
+template <typename Index>
+struct ReportsLevelStats<Index, void_t<decltype(declval<Index const&>().stats())>> : true_type {};
+
+template <typename Index, typename = void> struct ChoosesBucketSize : false_type {};
+
+template <typename Index>
+struct ChoosesBucketSize<Index, void_t<decltype(declval<Index const&>().bucketSize())>>
+    : true_type {};
+
+/// Exports the shape of every level of indices that report one as counters named after the
+/// level, e.g. L0Load, and the bucket width of indices that choose their own. Probe lengths are
+/// only counted in builds with SONIC_PROBE_STATS.
+template <typename Index> void reportLevelStats(benchmark::State& state, Index const& index) {
+  if constexpr(ChoosesBucketSize<Index>::value) {
+    state.counters["BucketSize"] = index.bucketSize();
+  }
+  if constexpr(ReportsLevelStats<Index>::value) {
+    auto const levels = index.stats();
+    for(auto l = 0; l < levels.size(); l++) {
+      auto const& level = levels[l];
+      auto const name = "L" + to_string(l);
+      state.counters[name + "Load"] = level.loadFactor();
+      state.counters[name + "FullBuckets"] = level.fullBuckets / (double)level.buckets;
+      state.counters[name + "AvgRun"] = level.averageRunLength();
+      state.counters[name + "MaxRun"] = level.longestRun;
+      if(l == 0) {
+        state.counters[name + "Overflowed"] = level.overflowedSlots / (double)level.usedSlots;
+      } else if(!level.leaf) {
+        state.counters[name + "PatchedBuckets"] = level.patchedBuckets / (double)level.buckets;
+      }
+      if constexpr(sonicProbeStats) {
+        state.counters[name + "AvgProbe"] = level.averageProbeLength();
+        state.counters[name + "MaxProbe"] = level.longestProbe;
+      }
+    }
+  }
+}
+
+/// Resident memory of the process, or 0 where /proc is unavailable.
+size_t residentBytes() {
+  ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+/// Data-TLB load misses of the calling thread between start() and stop(). Where perf events are
+/// not permitted, available() is false and nothing is counted.
+class DataTlbMisses {
+  int fd;
+
+public:
+  DataTlbMisses() {
+    perf_event_attr attributes{};
+    attributes.type = PERF_TYPE_HW_CACHE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                        PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+  }
+
+  ~DataTlbMisses() {
+    if(fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool available() const { return fd >= 0; }
+  void start() { ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); }
+  void stop() { ioctl(fd, PERF_EVENT_IOC_DISABLE, 0); }
+
+  uint64_t count() const {
+    uint64_t misses = 0;
+    return read(fd, &misses, sizeof(misses)) == sizeof(misses) ? misses : 0;
+  }
+};
+
 template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
 static void BuildIndexBenchmark(benchmark::State& state) {
   auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
 
   for(auto _ : state) {
     IndexWrapper index(table);
+    reportMemoryPerTuple(state, index, RowsNumber);
+  }
+}
+
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void ParallelBuildIndexBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  for(auto _ : state) {
+    IndexWrapper index(table, state.range(1));
+  }
+}
+
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void BulkBuildIndexBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  for(auto _ : state) {
+    IndexWrapper index;
+    index.bulkLoad(table, thread::hardware_concurrency());
+  }
+}
+
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void ParallelBulkBuildIndexBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  for(auto _ : state) {
+    IndexWrapper index;
+    index.bulkLoad(table, state.range(1));
+  }
+}
+
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void BuildIncrementallyBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  for(auto _ : state) {
+    IndexWrapper index;
+    for(auto const& input_tuple : table) {
+      index.insert(input_tuple);
+    }
   }
 }
 
@@ -92,6 +265,8 @@ static void PointLookupBenchmark(benchmark::State& state) {
   for(auto _ : state) {
     benchmark::DoNotOptimize(sum += index.pointLookup(lookupTable[rand() % RowsNumber]));
   }
+  reportMemoryPerTuple(state, index, RowsNumber);
+  reportLevelStats(state, index);
 }
 
 template <size_t RowsNumber, size_t PrefixLength, typename IndexWrapper, typename... Columns>
@@ -121,6 +296,8 @@ static void PrefixLookupBenchmark(benchmark::State& state) {
     benchmark::DoNotOptimize(sum += lookup(index, lookupTable, RowsNumber, tuple<Columns...>(),
                                            make_index_sequence<PrefixLength>()));
   }
+  reportMemoryPerTuple(state, index, RowsNumber);
+  reportLevelStats(state, index);
 }
 
 template <size_t RowsNumber, size_t PrefixLength, typename IndexWrapper, typename... Columns>
@@ -179,6 +356,404 @@ static void CountPrefixBenchmark(benchmark::State& state) {
     benchmark::DoNotOptimize(sum += countPrefix(index, lookupTable, RowsNumber, tuple<Columns...>(),
                                                 make_index_sequence<PrefixLength>()));
   }
+  reportMemoryPerTuple(state, index, RowsNumber);
+}
+
+/// countPrefix throughput for batches of state.range(1) prefixes. Batches of one prefix take the
+/// single-probe path, larger ones countPrefixBatch.
+template <size_t RowsNumber, size_t PrefixLength, typename IndexWrapper, typename... Columns>
+static void CountPrefixBatchBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  IndexWrapper index(table);
+
+  typedef decltype(prefixOf(table[0], make_index_sequence<PrefixLength>())) PrefixTuple;
+
+  auto const batchSize = (size_t)state.range(1);
+  vector<vector<PrefixTuple>> batches(RowsNumber / batchSize);
+  for(auto& batch : batches) {
+    for(auto i = 0; i < batchSize; i++) {
+      batch.emplace_back(prefixOf(table[rand() % RowsNumber], make_index_sequence<PrefixLength>()));
+    }
+  }
+
+  size_t sum = 0;
+  size_t next = 0;
+  for(auto _ : state) {
+    auto const& batch = batches[next++ % batches.size()];
+    if(batchSize == 1) {
+      benchmark::DoNotOptimize(sum += index.countPrefix(batch[0]));
+    } else {
+      for(auto count : index.countPrefixBatch(batch)) {
+        benchmark::DoNotOptimize(sum += count);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+
+/// Prefix lookups against an index filled with the first half of the table while, if
+/// state.range(1) is set, a writer thread keeps inserting the second half.
+template <size_t RowsNumber, size_t PrefixLength, typename IndexWrapper, typename... Columns>
+static void ConcurrentPrefixLookupBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  IndexWrapper index;
+  for(auto i = 0; i < RowsNumber / 2; i++) {
+    index.insert(table[i]);
+  }
+
+  atomic<bool> stop(false);
+  atomic<size_t> inserted(0);
+  thread writer;
+  if(state.range(1)) {
+    writer = thread([&]() {
+      for(auto i = RowsNumber / 2; i < RowsNumber && !stop.load(memory_order_relaxed); i++) {
+        index.insert(table[i]);
+        inserted.fetch_add(1, memory_order_relaxed);
+      }
+    });
+  }
+
+  size_t sum = 0;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(sum += lookup(index, table, RowsNumber / 2, tuple<Columns...>(),
+                                           make_index_sequence<PrefixLength>()));
+  }
+
+  stop = true;
+  if(writer.joinable()) {
+    writer.join();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["Inserted"] = inserted.load();
+}
+
+/// The "join" table with every value spelled out as a string too long to be inlined in a
+/// SonicString.
+template <size_t RowsNumber> vector<tuple<string, string, string, string>> longStringTable() {
+  vector<tuple<string, string, string, string>> table;
+  for(auto const& row :
+      datagenerator::Table<int, int, int, int>::generateIntegerTuples("join", RowsNumber)) {
+    table.push_back(apply(
+        [](auto... values) { return make_tuple(("long string key " + to_string(values))...); },
+        row));
+  }
+  return table;
+}
+
+template <typename Row> auto internRow(SonicStringArena& arena, Row const& row) {
+  return apply([&arena](auto const&... values) { return make_tuple(arena.intern(values)...); },
+               row);
+}
+
+/// Builds an index of long string keys, stored as std::string (state.range(0) == 0) or interned
+/// into a SonicStringArena on the way in (1).
+template <size_t RowsNumber, typename StringIndex, typename InternedIndex>
+static void LongStringBuildBenchmark(benchmark::State& state) {
+  auto const table = longStringTable<RowsNumber>();
+  for(auto _ : state) {
+    if(state.range(0)) {
+      SonicStringArena arena;
+      InternedIndex index;
+      for(auto const& row : table) {
+        index.insert(internRow(arena, row));
+      }
+      reportMemoryPerTuple(state, index, RowsNumber);
+      state.counters["ArenaBytesPerTuple"] = arena.memoryUsage() / (double)RowsNumber;
+    } else {
+      StringIndex index(table);
+      reportMemoryPerTuple(state, index, RowsNumber);
+    }
+  }
+}
+
+/// Prefix counts over two long string columns; interned indices look their keys up in the arena
+/// first.
+template <size_t RowsNumber, typename StringIndex, typename InternedIndex>
+static void LongStringCountBenchmark(benchmark::State& state) {
+  auto const table = longStringTable<RowsNumber>();
+  SonicStringArena arena;
+  StringIndex stringIndex;
+  InternedIndex internedIndex;
+  if(state.range(0)) {
+    for(auto const& row : table) {
+      internedIndex.insert(internRow(arena, row));
+    }
+  } else {
+    stringIndex = StringIndex(table);
+  }
+
+  size_t sum = 0;
+  for(auto _ : state) {
+    auto const& row = table[rand() % RowsNumber];
+    if(state.range(0)) {
+      benchmark::DoNotOptimize(sum += internedIndex.countPrefix(
+                                   make_tuple(arena.find(get<0>(row)), arena.find(get<1>(row)))));
+    } else {
+      benchmark::DoNotOptimize(
+          sum += stringIndex.countPrefix(make_tuple(get<0>(row), get<1>(row))));
+    }
+  }
+}
+
+/// Prefix counts on a NUMA-partitioned index. With state.range(0) == 0 one thread per node probes
+/// the keys its own node owns; with 1 it probes those of the next node, so every probe crosses
+/// the interconnect; with 2 the caller hands all probes to countPrefixBatch, which routes them to
+/// the owning nodes. On a single-node machine all three only differ in their threading.
+template <size_t RowsNumber, size_t PrefixLength, typename IndexWrapper, typename... Columns>
+static void NumaProbeBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+  constexpr size_t probesPerNode = 1 << 16;
+
+  IndexWrapper index(table);
+  auto const nodes = index.getNumberOfNodes();
+  typedef decltype(prefixOf(table[0], make_index_sequence<PrefixLength>())) Prefix;
+  vector<vector<Prefix>> prefixesByNode(nodes);
+  vector<Prefix> probes;
+  for(auto node = 0; node < nodes; node++) {
+    for(auto i = 0; i < RowsNumber && prefixesByNode[node].size() < probesPerNode; i++) {
+      auto const& row = table[rand() % RowsNumber];
+      if(index.nodeOf(get<0>(row)) == node) {
+        prefixesByNode[node].push_back(prefixOf(row, make_index_sequence<PrefixLength>()));
+      }
+    }
+    probes.insert(probes.end(), prefixesByNode[node].begin(), prefixesByNode[node].end());
+  }
+
+  vector<size_t> sums(nodes);
+  for(auto _ : state) {
+    if(state.range(0) == 2) {
+      benchmark::DoNotOptimize(index.countPrefixBatch(probes));
+      continue;
+    }
+    vector<thread> workers;
+    for(auto node = 0; node < nodes; node++) {
+      workers.push_back(threadOnNumaNode((node + state.range(0)) % nodes, [&, node] {
+        for(auto const& prefix : prefixesByNode[node]) {
+          sums[node] += index.countPrefix(prefix);
+        }
+      }));
+    }
+    for(auto& worker : workers) {
+      worker.join();
+    }
+  }
+  benchmark::DoNotOptimize(sums);
+  state.SetItemsProcessed(state.iterations() * probes.size());
+  state.counters["Nodes"] = nodes;
+}
+
+/// Time until an index answers its first lookup: rebuilt from the table by insertion, or, if
+/// state.range(1) is set, mapped from a file saved beforehand. The file stays in the page cache
+/// between iterations, so this measures a warm start.
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void StartupBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+  auto const path = "sonic_startup_benchmark.idx";
+  if(state.range(1)) {
+    IndexWrapper(table).save(path);
+  }
+
+  size_t sum = 0;
+  for(auto _ : state) {
+    IndexWrapper index;
+    if(state.range(1)) {
+      index.load(path);
+    } else {
+      for(auto const& row : table) {
+        index.insert(row);
+      }
+    }
+    benchmark::DoNotOptimize(sum += index.countPrefix(prefixOf(table[rand() % RowsNumber],
+                                                                make_index_sequence<1>())));
+  }
+  remove(path);
+  state.SetItemsProcessed(state.iterations() * RowsNumber);
+}
+
+/// Full scans of the "join" table, reporting the index footprint next to them.
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void ScanBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  IndexWrapper index(table);
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(index.scan().size());
+  }
+  state.SetItemsProcessed(state.iterations() * RowsNumber);
+  reportMemoryPerTuple(state, index, RowsNumber);
+}
+
+/// Full scans split over state.range(0) threads with scanPartitioned.
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void ParallelScanBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+
+  IndexWrapper index(table);
+
+  for(auto _ : state) {
+    size_t tuples = 0;
+    for(auto const& partition : index.scanPartitioned(state.range(0))) {
+      tuples += partition.size();
+    }
+    benchmark::DoNotOptimize(tuples);
+  }
+  state.SetItemsProcessed(state.iterations() * RowsNumber);
+}
+
+/// Predicates a = x AND b BETWEEN low AND high on a table with RowsNumber / 1024 values of a,
+/// each paired with 4096 values of b. state.range(0) picks prefixRangeLookup (0) or
+/// prefixRangeCount (1), state.range(1) the number of values of b a range spans.
+template <size_t RowsNumber, typename IndexWrapper>
+static void PrefixRangeBenchmark(benchmark::State& state) {
+  constexpr int groups = RowsNumber / 1024;
+  constexpr int values = 4096;
+  vector<tuple<int, int, int>> table;
+  table.reserve(RowsNumber);
+  for(auto i = 0; i < RowsNumber; i++) {
+    table.emplace_back(rand() % groups + 1, rand() % values + 1, rand() % RowsNumber + 1);
+  }
+
+  IndexWrapper index(table);
+
+  int const width = state.range(1);
+  size_t sum = 0;
+  for(auto _ : state) {
+    auto const prefix = tuple<int>{rand() % groups + 1};
+    auto const low = rand() % (values - width + 1) + 1;
+    if(state.range(0)) {
+      sum += index.prefixRangeCount(prefix, low, low + width - 1);
+    } else {
+      sum += index.prefixRangeLookup(prefix, low, low + width - 1).size();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.counters["TuplesPerRange"] = sum / (double)state.iterations();
+}
+
+/// Two-column prefix counts as a join plan asks for them, on a table with RowsNumber / 1024 values
+/// of a, each paired with 4096 values of b. state.range(0) picks countPrefix (0) or
+/// estimatePrefix (1); RelativeError reports how far the estimates are off on average.
+template <size_t RowsNumber, typename IndexWrapper>
+static void PrefixEstimateBenchmark(benchmark::State& state) {
+  constexpr int groups = RowsNumber / 1024;
+  constexpr int values = 4096;
+  vector<tuple<int, int, int>> table;
+  table.reserve(RowsNumber);
+  for(auto i = 0; i < RowsNumber; i++) {
+    table.emplace_back(rand() % groups + 1, rand() % values + 1, rand() % RowsNumber + 1);
+  }
+
+  IndexWrapper index(table);
+
+  double sum = 0;
+  for(auto _ : state) {
+    auto const prefix = tuple<int, int>{rand() % groups + 1, rand() % values + 1};
+    if(state.range(0)) {
+      sum += index.estimatePrefix(prefix);
+    } else {
+      sum += index.countPrefix(prefix);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  double error = 0;
+  for(auto i = 0; i < 1024; i++) {
+    auto const prefix = tuple<int, int>{rand() % groups + 1, rand() % values + 1};
+    auto const count = index.countPrefix(prefix);
+    error += abs(index.estimatePrefix(prefix) - count) / max<double>(count, 1);
+  }
+  state.counters["RelativeError"] = error / 1024;
+}
+
+/// Prefix lookups on the duplicate-heavy "join" (state.range(1) == 0) or "worst-case" tables.
+/// SlotsPerTuple reports the leaf slots taken per input row.
+template <size_t RowsNumber, size_t PrefixLength, typename IndexWrapper, typename... Columns>
+static void DuplicateLookupBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples(
+      state.range(1) ? "worst-case" : "join", RowsNumber);
+
+  IndexWrapper index(table);
+
+  size_t sum = 0;
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(sum += lookup(index, table, RowsNumber, tuple<Columns...>(),
+                                           make_index_sequence<PrefixLength>()));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["SlotsPerTuple"] = index.scan().size() / (double)RowsNumber;
+}
+
+/// Churn on a sliding window of half the table: every iteration inserts the next row, erases the
+/// row inserted RowsNumber / 2 iterations before it and looks up a random live row. Indices that
+/// leave compaction to the caller are compacted as soon as they ask for it. An erase that misses
+/// its row fails the run; the rows are shifted off 0, the empty key, so that all of them are
+/// stored.
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void MixedWorkloadBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+  for(auto& row : table) {
+    row = apply([](auto... column) { return tuple<Columns...>((column + 1)...); }, row);
+  }
+  constexpr size_t window = RowsNumber / 2;
+
+  IndexWrapper index;
+  for(auto i = 0; i < window; i++) {
+    index.insert(table[i]);
+  }
+
+  size_t next = window;
+  size_t sum = 0;
+  for(auto _ : state) {
+    index.insert(table[next % RowsNumber]);
+    if(index.erase(table[(next - window) % RowsNumber]) != 1) {
+      state.SkipWithError("erase missed a live row");
+      break;
+    }
+    if constexpr(CompactsExplicitly<IndexWrapper>::value) {
+      if(index.needsCompaction()) {
+        index.compact();
+      }
+    }
+    next++;
+    benchmark::DoNotOptimize(sum += index.pointLookup(table[(next - 1 - rand() % window) %
+                                                            RowsNumber]));
+  }
+  state.SetItemsProcessed(state.iterations() * 3);
+}
+
+/// Builds the index in every iteration, then looks up every row once, reporting the memory the
+/// build made resident and the data-TLB misses of both phases per tuple.
+template <size_t RowsNumber, typename IndexWrapper, typename... Columns>
+static void PageFootprintBenchmark(benchmark::State& state) {
+  auto table = datagenerator::Table<Columns...>::generateIntegerTuples("join", RowsNumber);
+  DataTlbMisses buildMisses, lookupMisses;
+
+  size_t sum = 0;
+  size_t resident = 0;
+  for(auto _ : state) {
+    auto const residentBefore = residentBytes();
+    buildMisses.start();
+    IndexWrapper index(table);
+    buildMisses.stop();
+    resident += residentBytes() - residentBefore;
+
+    state.PauseTiming();
+    lookupMisses.start();
+    for(auto i = 0; i < RowsNumber; i++) {
+      benchmark::DoNotOptimize(sum += index.pointLookup(table[rand() % RowsNumber]));
+    }
+    lookupMisses.stop();
+    state.ResumeTiming();
+  }
+  auto const tuples = (double)state.iterations() * RowsNumber;
+  state.counters["ResidentBytesPerTuple"] = resident / tuples;
+  if(buildMisses.available()) {
+    state.counters["BuildTlbMissesPerTuple"] = buildMisses.count() / tuples;
+    state.counters["LookupTlbMissesPerTuple"] = lookupMisses.count() / tuples;
+  }
 }
 
 static const char ABSEIL[] = "abseil";
@@ -213,19 +788,71 @@ template <size_t RowsNumber, const char* IndexName> static void Build(benchmark:
 }
 
 template <size_t RowsNumber, size_t BucketSize> static void Build_SONIC(benchmark::State& state) {
+  auto const sequential = (state.range(1) == 1);
   map<int, function<void(benchmark::State&)>>(
-      {{2,
-        BuildIndexBenchmark<
-            RowsNumber, SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int>,
-            int, int>},
-       {4, BuildIndexBenchmark<
+      {{2, sequential
+               ? BuildIndexBenchmark<
+                     RowsNumber,
+                     SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int>,
+                     int, int>
+               : ParallelBuildIndexBenchmark<
+                     RowsNumber,
+                     PartitionedSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int,
+                                           int>,
+                     int, int>},
+       {4, sequential ? BuildIndexBenchmark<RowsNumber,
+                                            SonicIndex<(Capacity<RowsNumber, BucketSize>()),
+                                                       BucketSize, 0, int, int, int, int>,
+                                            int, int, int, int>
+                      : ParallelBuildIndexBenchmark<
+                            RowsNumber,
+                            PartitionedSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize,
+                                                  0, int, int, int, int>,
+                            int, int, int, int>},
+       {8, sequential
+               ? BuildIndexBenchmark<RowsNumber,
+                                     SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0,
+                                                int, int, int, int, int, int, int, int>,
+                                     int, int, int, int, int, int, int, int>
+               : ParallelBuildIndexBenchmark<
+                     RowsNumber,
+                     PartitionedSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int,
+                                           int, int, int, int, int, int, int>,
+                     int, int, int, int, int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Bulk_Build_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{2, ParallelBulkBuildIndexBenchmark<
+               RowsNumber,
+               SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int>, int,
+               int>},
+       {4, ParallelBulkBuildIndexBenchmark<
                RowsNumber,
                SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int, int, int>,
                int, int, int, int>},
-       {8, BuildIndexBenchmark<RowsNumber,
-                               SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int,
-                                          int, int, int, int, int, int, int>,
-                               int, int, int, int, int, int, int, int>}})
+       {8, ParallelBulkBuildIndexBenchmark<
+               RowsNumber,
+               SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int, int, int,
+                          int, int, int, int>,
+               int, int, int, int, int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Build_Growable_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{2, BuildIncrementallyBenchmark<
+               RowsNumber, GrowableSonicIndex<1024, BucketSize, 0, int, int>, int, int>},
+       {4, BuildIncrementallyBenchmark<
+               RowsNumber, GrowableSonicIndex<1024, BucketSize, 0, int, int, int, int>, int, int,
+               int, int>},
+       {8, BuildIncrementallyBenchmark<RowsNumber,
+                                       GrowableSonicIndex<1024, BucketSize, 0, int, int, int, int,
+                                                          int, int, int, int>,
+                                       int, int, int, int, int, int, int, int>}})
       .at(state.range(0))(state);
 }
 
@@ -255,6 +882,20 @@ BENCHMARK_TEMPLATE(Build, 8388608, ROBIN_FASTMAP)
     ->Unit(benchmark::kMillisecond);
 
 BENCHMARK_TEMPLATE(Build_SONIC, 8388608, 4)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}, {1, 64}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Registered like Build_SONIC, so that every run pairs with a build of the same columns and
+// threads.
+BENCHMARK_TEMPLATE(Bulk_Build_SONIC, 8388608, 4)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}, {1, 64}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(Build_Growable_SONIC, 8388608, 4)
     ->RangeMultiplier(2)
     ->Ranges({{2, 8}})
     ->Unit(benchmark::kMillisecond);
@@ -414,11 +1055,251 @@ BENCHMARK_TEMPLATE(Count_Prefix, 8388608, HTRIE)->RangeMultiplier(2)->Ranges({{2
 
 BENCHMARK_TEMPLATE(Count_Prefix_SONIC, 8388608, 4)->RangeMultiplier(2)->Ranges({{2, 8}});
 
+template <size_t RowsNumber, size_t BucketSize>
+static void Count_Prefix_Batch_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{2, CountPrefixBatchBenchmark<
+               RowsNumber, 1,
+               SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int>, int,
+               int>},
+       {4, CountPrefixBatchBenchmark<
+               RowsNumber, 2,
+               SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int, int, int>,
+               int, int, int, int>},
+       {8, CountPrefixBatchBenchmark<RowsNumber, 4,
+                                     SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize,
+                                                0, int, int, int, int, int, int, int, int>,
+                                     int, int, int, int, int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Count_Prefix_Batch_SONIC, 8388608, 4)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}, {1, 64}});
+
+/// Point lookups (state.range(0) = 0) and prefix counts (1) on levels sized at runtime, where slot
+/// numbers come from hashes by a multiplication rather than a division.
+template <size_t RowsNumber, size_t BucketSize>
+static void Runtime_Capacity_Lookup_SONIC(benchmark::State& state) {
+  constexpr auto slots = Capacity<RowsNumber, BucketSize>() / 4 * 3;
+  map<int, function<void(benchmark::State&)>>(
+      {{0, PointLookupBenchmark<RowsNumber,
+                                RuntimeSizedSonicIndex<slots, BucketSize, int, int, int, int>, int,
+                                int, int, int>},
+       {1, CountPrefixBenchmark<RowsNumber, 2,
+                                RuntimeSizedSonicIndex<slots, BucketSize, int, int, int, int>, int,
+                                int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Runtime_Capacity_Lookup_SONIC, 8388608, 4)->Arg(0)->Arg(1);
+
+// ================================= START-UP ==================================
+
+template <size_t RowsNumber, size_t BucketSize> static void Startup_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{2, StartupBenchmark<RowsNumber,
+                            SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int,
+                                       int>,
+                            int, int>},
+       {4, StartupBenchmark<RowsNumber,
+                            SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int,
+                                       int, int, int>,
+                            int, int, int, int>},
+       {8, StartupBenchmark<RowsNumber,
+                            SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int,
+                                       int, int, int, int, int, int, int>,
+                            int, int, int, int, int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Startup_SONIC, 8388608, 4)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// ================================= HUGE PAGES ================================
+
+/// state.range(0) == 1 places the slot arrays on huge pages.
+template <size_t RowsNumber, size_t BucketSize>
+static void Huge_Page_Build_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, PageFootprintBenchmark<RowsNumber,
+                                  SonicIndex<capacity, BucketSize, 0, int, int, int, int>, int,
+                                  int, int, int>},
+       {1, PageFootprintBenchmark<RowsNumber,
+                                  HugePageSonicIndex<capacity, BucketSize, int, int, int, int>,
+                                  int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Huge_Page_Build_SONIC, 8388608, 4)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+// ================================ HASH POLICY ================================
+
+/// state.range(0) picks the key hash: 0 CRCHash, 1 WordCRCHash, 2 MultiplyShiftHash.
+template <size_t RowsNumber, size_t BucketSize>
+static void Hash_Bulk_Build_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, BulkBuildIndexBenchmark<RowsNumber,
+                                   HashedSonicIndex<CRCHash, capacity, BucketSize, int, int, int,
+                                                    int>,
+                                   int, int, int, int>},
+       {1, BulkBuildIndexBenchmark<RowsNumber,
+                                   HashedSonicIndex<WordCRCHash, capacity, BucketSize, int, int,
+                                                    int, int>,
+                                   int, int, int, int>},
+       {2, BulkBuildIndexBenchmark<RowsNumber,
+                                   HashedSonicIndex<MultiplyShiftHash, capacity, BucketSize, int,
+                                                    int, int, int>,
+                                   int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Hash_Po_Lookup_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, PointLookupBenchmark<RowsNumber,
+                                HashedSonicIndex<CRCHash, capacity, BucketSize, int, int, int, int>,
+                                int, int, int, int>},
+       {1, PointLookupBenchmark<RowsNumber,
+                                HashedSonicIndex<WordCRCHash, capacity, BucketSize, int, int, int,
+                                                 int>,
+                                int, int, int, int>},
+       {2, PointLookupBenchmark<RowsNumber,
+                                HashedSonicIndex<MultiplyShiftHash, capacity, BucketSize, int, int,
+                                                 int, int>,
+                                int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+/// String keys: state.range(0) picks CRCHash (0) or WordCRCHash (1).
+template <size_t RowsNumber, size_t BucketSize>
+static void String_Key_Hash_B_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, BuildIndexBenchmarkString<RowsNumber,
+                                     HashedSonicIndex<CRCHash, capacity, BucketSize, string,
+                                                      string, string, string>,
+                                     string, string, string, string>},
+       {1, BuildIndexBenchmarkString<RowsNumber,
+                                     HashedSonicIndex<WordCRCHash, capacity, BucketSize, string,
+                                                      string, string, string>,
+                                     string, string, string, string>}})
+      .at(state.range(0))(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void String_Key_Hash_Pr_Lookup_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, PrefixLookupBenchmarkString<RowsNumber, 2,
+                                       HashedSonicIndex<CRCHash, capacity, BucketSize, string,
+                                                        string, string, string>,
+                                       string, string, string, string>},
+       {1, PrefixLookupBenchmarkString<RowsNumber, 2,
+                                       HashedSonicIndex<WordCRCHash, capacity, BucketSize, string,
+                                                        string, string, string>,
+                                       string, string, string, string>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Hash_Bulk_Build_SONIC, 8388608, 4)->DenseRange(0, 2);
+
+BENCHMARK_TEMPLATE(Hash_Po_Lookup_SONIC, 8388608, 4)->DenseRange(0, 2);
+
+BENCHMARK_TEMPLATE(String_Key_Hash_B_SONIC, 262144, 4)->Arg(0)->Arg(1);
+
+BENCHMARK_TEMPLATE(String_Key_Hash_Pr_Lookup_SONIC, 262144, 4)->Arg(0)->Arg(1);
+
+// ============================== DUPLICATE LOOKUP =============================
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Duplicate_Lookup_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{0, DuplicateLookupBenchmark<RowsNumber, 2,
+                                    SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize,
+                                               0, int, int, int, int>,
+                                    int, int, int, int>},
+       {1, DuplicateLookupBenchmark<RowsNumber, 2,
+                                    MultisetSonicIndex<(Capacity<RowsNumber, BucketSize>()),
+                                                       BucketSize, 0, int, int, int, int>,
+                                    int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Duplicate_Lookup_SONIC, 8388608, 4)->Ranges({{0, 1}, {0, 1}});
+
+// ================================ MIXED WORKLOAD =============================
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Mixed_Workload_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{0, MixedWorkloadBenchmark<RowsNumber,
+                                  SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0,
+                                             int, int, int, int>,
+                                  int, int, int, int>},
+       {1, MixedWorkloadBenchmark<RowsNumber,
+                                  GrowableSonicIndex<(Capacity<RowsNumber, BucketSize>()),
+                                                     BucketSize, 0, int, int, int, int>,
+                                  int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Mixed_Workload_SONIC, 8388608, 4)->Arg(0)->Arg(1);
+
+// ============================= CONCURRENT LOOKUP =============================
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Concurrent_Prefix_Lookup_SONIC(benchmark::State& state) {
+  map<int, function<void(benchmark::State&)>>(
+      {{2, ConcurrentPrefixLookupBenchmark<
+               RowsNumber, 1,
+               ConcurrentSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int>,
+               int, int>},
+       {4, ConcurrentPrefixLookupBenchmark<
+               RowsNumber, 2,
+               ConcurrentSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int,
+                                    int, int>,
+               int, int, int, int>},
+       {8, ConcurrentPrefixLookupBenchmark<
+               RowsNumber, 4,
+               ConcurrentSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int,
+                                    int, int, int, int, int, int>,
+               int, int, int, int, int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Concurrent_Prefix_Lookup_SONIC, 8388608, 4)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}, {0, 1}});
+
+// ================================= NUMA PROBE ================================
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Numa_Probe_SONIC(benchmark::State& state) {
+  NumaProbeBenchmark<RowsNumber, 2,
+                     NumaSonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int,
+                                    int, int>,
+                     int, int, int, int>(state);
+}
+
+BENCHMARK_TEMPLATE(Numa_Probe_SONIC, 8388608, 4)->DenseRange(0, 2)->UseRealTime();
+
 // ======================================= BUCKET SIZE =========================
 
 template <size_t RowsNumber> static void Bucket_Size_B_SONIC(benchmark::State& state) {
   map<int, function<void(benchmark::State&)>>(
-      {{2, BuildIndexBenchmark<RowsNumber,
+      {{0, BuildIndexBenchmark<RowsNumber,
+                               AdaptiveSonicIndex<RowsNumber, 4, 0, int, int, int, int>, int, int,
+                               int, int>},
+       {2, BuildIndexBenchmark<RowsNumber,
                                SonicIndex<(Capacity<RowsNumber, 2>()), 2, 0, int, int, int, int>,
                                int, int, int, int>},
        {4, BuildIndexBenchmark<RowsNumber,
@@ -432,21 +1313,27 @@ template <size_t RowsNumber> static void Bucket_Size_B_SONIC(benchmark::State& s
 
 template <size_t RowsNumber> static void Bucket_Size_Po_Lookup_SONIC(benchmark::State& state) {
   map<int, function<void(benchmark::State&)>>(
-      {{2, PointLookupBenchmark<RowsNumber,
+      {{0, PointLookupBenchmark<RowsNumber,
+                                AdaptiveSonicIndex<RowsNumber, 4, 0, int, int, int, int>, int, int,
+                                int, int>},
+       {2, PointLookupBenchmark<RowsNumber,
                                 SonicIndex<(Capacity<RowsNumber, 2>()), 2, 0, int, int, int, int>,
                                 int, int, int, int>},
        {4, PointLookupBenchmark<RowsNumber,
                                 SonicIndex<(Capacity<RowsNumber, 4>()), 4, 0, int, int, int, int>,
                                 int, int, int, int>},
        {8, PointLookupBenchmark<RowsNumber,
-                                SonicIndex<(Capacity<RowsNumber, 4>()), 4, 0, int, int, int, int>,
+                                SonicIndex<(Capacity<RowsNumber, 8>()), 8, 0, int, int, int, int>,
                                 int, int, int, int>}})
       .at(state.range(0))(state);
 }
 
 template <size_t RowsNumber> static void Bucket_Size_Pr_Lookup_SONIC(benchmark::State& state) {
   map<int, function<void(benchmark::State&)>>(
-      {{2, PrefixLookupBenchmark<RowsNumber, 2,
+      {{0, PrefixLookupBenchmark<RowsNumber, 2,
+                                 AdaptiveSonicIndex<RowsNumber, 4, 0, int, int, int, int>, int, int,
+                                 int, int>},
+       {2, PrefixLookupBenchmark<RowsNumber, 2,
                                  SonicIndex<(Capacity<RowsNumber, 2>()), 2, 0, int, int, int, int>,
                                  int, int, int, int>},
        {4, PrefixLookupBenchmark<RowsNumber, 2,
@@ -458,11 +1345,18 @@ template <size_t RowsNumber> static void Bucket_Size_Pr_Lookup_SONIC(benchmark::
       .at(state.range(0))(state);
 }
 
-BENCHMARK_TEMPLATE(Bucket_Size_B_SONIC, 8388608)->RangeMultiplier(2)->Ranges({{2, 8}});
+// Bucket size 0 lets the index choose its own from the fan-out of the table.
+BENCHMARK_TEMPLATE(Bucket_Size_B_SONIC, 8388608)->Arg(0)->RangeMultiplier(2)->Ranges({{2, 8}});
 
-BENCHMARK_TEMPLATE(Bucket_Size_Po_Lookup_SONIC, 8388608)->RangeMultiplier(2)->Ranges({{2, 8}});
+BENCHMARK_TEMPLATE(Bucket_Size_Po_Lookup_SONIC, 8388608)
+    ->Arg(0)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}});
 
-BENCHMARK_TEMPLATE(Bucket_Size_Pr_Lookup_SONIC, 8388608)->RangeMultiplier(2)->Ranges({{2, 8}});
+BENCHMARK_TEMPLATE(Bucket_Size_Pr_Lookup_SONIC, 8388608)
+    ->Arg(0)
+    ->RangeMultiplier(2)
+    ->Ranges({{2, 8}});
 
 // ============================== BUILD STRING =================================
 
@@ -544,6 +1438,133 @@ BENCHMARK_TEMPLATE(String_Key_B, 262144, SURF)
     ->Ranges({{2, 8}})
     ->Unit(benchmark::kMillisecond);
 
+// ============================ INTERNED STRING KEYS ===========================
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Long_String_Key_B_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  LongStringBuildBenchmark<
+      RowsNumber, SonicIndex<capacity, BucketSize, 0, string, string, string, string>,
+      SonicIndex<capacity, BucketSize, 0, SonicString, SonicString, SonicString, SonicString>>(
+      state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Long_String_Key_Count_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  LongStringCountBenchmark<
+      RowsNumber, SonicIndex<capacity, BucketSize, 0, string, string, string, string>,
+      SonicIndex<capacity, BucketSize, 0, SonicString, SonicString, SonicString, SonicString>>(
+      state);
+}
+
+BENCHMARK_TEMPLATE(Long_String_Key_B_SONIC, 262144, 4)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(Long_String_Key_Count_SONIC, 262144, 4)->Arg(0)->Arg(1);
+
+// ================================ PARALLEL SCAN ==============================
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Parallel_Scan_SONIC(benchmark::State& state) {
+  ParallelScanBenchmark<RowsNumber,
+                        SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize, 0, int, int,
+                                   int, int>,
+                        int, int, int, int>(state);
+}
+
+BENCHMARK_TEMPLATE(Parallel_Scan_SONIC, 8388608, 4)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// ============================= COMPRESSED LEAVES =============================
+
+/// state.range(0) picks whole tuples (0) or frame-of-reference encoded leaves (1).
+template <size_t RowsNumber, size_t BucketSize>
+static void Compressed_Leaf_B_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, BuildIndexBenchmark<RowsNumber, SonicIndex<capacity, BucketSize, 0, int, int, int, int>,
+                               int, int, int, int>},
+       {1, BuildIndexBenchmark<RowsNumber,
+                               BasicSonicIndex<CompressedLeafSonicPolicy<>, capacity, BucketSize,
+                                               0, int, int, int, int>,
+                               int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Compressed_Leaf_Pr_Lookup_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, PrefixLookupBenchmark<RowsNumber, 2,
+                                 SonicIndex<capacity, BucketSize, 0, int, int, int, int>, int, int,
+                                 int, int>},
+       {1, PrefixLookupBenchmark<RowsNumber, 2,
+                                 BasicSonicIndex<CompressedLeafSonicPolicy<>, capacity,
+                                                 BucketSize, 0, int, int, int, int>,
+                                 int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Compressed_Leaf_Scan_SONIC(benchmark::State& state) {
+  constexpr auto capacity = Capacity<RowsNumber, BucketSize>();
+  map<int, function<void(benchmark::State&)>>(
+      {{0, ScanBenchmark<RowsNumber, SonicIndex<capacity, BucketSize, 0, int, int, int, int>, int,
+                         int, int, int>},
+       {1, ScanBenchmark<RowsNumber,
+                         BasicSonicIndex<CompressedLeafSonicPolicy<>, capacity, BucketSize, 0,
+                                         int, int, int, int>,
+                         int, int, int, int>}})
+      .at(state.range(0))(state);
+}
+
+BENCHMARK_TEMPLATE(Compressed_Leaf_B_SONIC, 8388608, 4)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(Compressed_Leaf_Pr_Lookup_SONIC, 8388608, 4)->Arg(0)->Arg(1);
+
+BENCHMARK_TEMPLATE(Compressed_Leaf_Scan_SONIC, 8388608, 4)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+// ================================ PREFIX RANGE ===============================
+
+template <size_t RowsNumber, const char* IndexName>
+static void Prefix_Range(benchmark::State& state) {
+  map<string, function<void(benchmark::State&)>>(
+      {{"btree", PrefixRangeBenchmark<RowsNumber, BTreeAdapter<int, int, int>>}})
+      .at(IndexName)(state);
+}
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Prefix_Range_SONIC(benchmark::State& state) {
+  PrefixRangeBenchmark<RowsNumber, SonicIndex<(Capacity<RowsNumber, BucketSize>()), BucketSize,
+                                              0, int, int, int>>(state);
+}
+
+BENCHMARK_TEMPLATE(Prefix_Range, 8388608, BTREE)->RangeMultiplier(16)->Ranges({{0, 1}, {16, 4096}});
+
+BENCHMARK_TEMPLATE(Prefix_Range_SONIC, 8388608, 4)
+    ->RangeMultiplier(16)
+    ->Ranges({{0, 1}, {16, 4096}});
+
+template <size_t RowsNumber, size_t BucketSize>
+static void Prefix_Estimate_SONIC(benchmark::State& state) {
+  PrefixEstimateBenchmark<RowsNumber, SketchedSonicIndex<(Capacity<RowsNumber, BucketSize>()),
+                                                         BucketSize, 0, int, int, int>>(state);
+}
+
+BENCHMARK_TEMPLATE(Prefix_Estimate_SONIC, 8388608, 4)->DenseRange(0, 1);
+
 // ========================= PREFIX LOOKUP STRING ==============================
 
 template <size_t RowsNumber, template <typename...> typename Index>
@@ -4,6 +4,7 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include "../../header/dictionary.h"
 #include "../BinaryJoin.hpp"
 #include "join_interfaces.h"
 
@@ -25,6 +26,28 @@ public:
                                                  OffsetsOfStoredTuplesInTotalOrder...>;
 };
 
+class SketchedSonic {
+public:
+  template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+  using Index = SketchedSonicIndex<Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
+
+  template <typename Index, typename TupleOfTypesInTotalOrder,
+            size_t... OffsetsOfStoredTuplesInTotalOrder>
+  using Adapter = SonicToTotalOrderLookupAdapter<Index, TupleOfTypesInTotalOrder,
+                                                 OffsetsOfStoredTuplesInTotalOrder...>;
+};
+
+class FilteredSonic {
+public:
+  template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
+  using Index = FilteredSonicIndex<Capacity, BucketSize, ColumnIndex, ColumnTypes...>;
+
+  template <typename Index, typename TupleOfTypesInTotalOrder,
+            size_t... OffsetsOfStoredTuplesInTotalOrder>
+  using Adapter = SonicToTotalOrderLookupAdapter<Index, TupleOfTypesInTotalOrder,
+                                                 OffsetsOfStoredTuplesInTotalOrder...>;
+};
+
 class BinaryHashJoin {
 public:
   template <size_t Capacity, size_t BucketSize, size_t ColumnIndex, typename... ColumnTypes>
@@ -39,6 +62,7 @@ public:
 }; // namespace TestConfigurations
 
 TEMPLATE_TEST_CASE("ThreeTables", "[ThreeTables]", TestConfigurations::Sonic,
+                   TestConfigurations::SketchedSonic, TestConfigurations::FilteredSonic,
                    TestConfigurations::BinaryHashJoin) {
   using Configuration = TestType;
   constexpr size_t Capacity = 8;
@@ -95,7 +119,85 @@ TEMPLATE_TEST_CASE("ThreeTables", "[ThreeTables]", TestConfigurations::Sonic,
   }
 }
 
+TEMPLATE_TEST_CASE("DictionaryEncodedJoin", "[DictionaryEncodedJoin]", TestConfigurations::Sonic,
+                   TestConfigurations::SketchedSonic, TestConfigurations::FilteredSonic,
+                   TestConfigurations::BinaryHashJoin) {
+  using Configuration = TestType;
+  constexpr size_t Capacity = 16;
+
+  /// The query of ThreeTables, joined on codes that every relation takes from the same
+  /// dictionary per attribute.
+  using totalOrderSchema = tuple<int, int, int>;
+
+  using inputSchemaR = tuple<int, int>;
+  using sonicIndexR =
+      typename Configuration::template Index<Capacity, SONIC_BUCKET_SIZE, 0, int, int>;
+  using sonicAdapterR =
+      typename Configuration::template Adapter<sonicIndexR, totalOrderSchema, 0, 1>;
+  using attributesInTotalOrderR = AttributeIndex<1, 0>;
+  using attributesOrderR = AttributeIndex<1, 0>;
+
+  using inputSchemaS = tuple<int, int>;
+  using sonicIndexS =
+      typename Configuration::template Index<Capacity, SONIC_BUCKET_SIZE, 0, int, int>;
+  using sonicAdapterS =
+      typename Configuration::template Adapter<sonicIndexS, totalOrderSchema, 0, 2>;
+  using attributesInTotalOrderS = AttributeIndex<0, 2>;
+  using attributesOrderS = AttributeIndex<0, 1>;
+
+  using inputSchemaT = tuple<int, int>;
+  using sonicIndexT =
+      typename Configuration::template Index<Capacity, SONIC_BUCKET_SIZE, 0, int, int>;
+  using sonicAdapterT =
+      typename Configuration::template Adapter<sonicIndexT, totalOrderSchema, 1, 2>;
+  using attributesInTotalOrderT = AttributeIndex<1, 2>;
+  using attributesOrderT = AttributeIndex<0, 1>;
+
+  auto tableR = vector<tuple<int, string>>{{10, "a rather long customer name"},
+                                           {20, "another rather long name"},
+                                           {30, "a third customer"},
+                                           {40, "nobody in S"}};
+  auto tableS = vector<tuple<string, int>>{{"a rather long customer name", 7},
+                                           {"another rather long name", 8},
+                                           {"a third customer", 9},
+                                           {"a rather long customer name", 8}};
+  auto tableT = vector<tuple<int, int>>{{10, 7}, {10, 8}, {20, 8}, {30, 7}};
+
+  Dictionary<string> names;
+  Dictionary<int> accounts;
+  Dictionary<int> regions;
+  auto encodedR = encodeRows(tableR, accounts, names);
+  auto encodedS = encodeRows(tableS, names, regions);
+  auto encodedT = encodeRows(tableT, accounts, regions);
+  REQUIRE(names.size() == 4);
+  REQUIRE(get<1>(encodedR[0]) == get<0>(encodedS[3]));
+  REQUIRE(names.find("not in any table") == 0);
+
+  auto R =
+      Relation<sonicAdapterR, inputSchemaR, attributesInTotalOrderR, attributesOrderR>(1, encodedR);
+  auto S =
+      Relation<sonicAdapterS, inputSchemaS, attributesInTotalOrderS, attributesOrderS>(2, encodedS);
+  auto T =
+      Relation<sonicAdapterT, inputSchemaT, attributesInTotalOrderT, attributesOrderT>(3, encodedT);
+
+  tuple<Relation<sonicAdapterR, inputSchemaR, attributesInTotalOrderR, attributesOrderR>&,
+        Relation<sonicAdapterS, inputSchemaS, attributesInTotalOrderS, attributesOrderS>&,
+        Relation<sonicAdapterT, inputSchemaT, attributesInTotalOrderT, attributesOrderT>&>
+      relationSet = {R, S, T};
+
+  auto joinResult = decodeRows(join3<totalOrderSchema>(relationSet), names, accounts, regions);
+  auto expectedResult = vector<tuple<string, int, int>>{{"a rather long customer name", 10, 7},
+                                                        {"a rather long customer name", 10, 8},
+                                                        {"another rather long name", 20, 8}};
+
+  REQUIRE(joinResult.size() == expectedResult.size());
+  for(auto t : expectedResult) {
+    REQUIRE(find(joinResult.begin(), joinResult.end(), t) != joinResult.end());
+  }
+}
+
 TEMPLATE_TEST_CASE("FiveTables", "[FiveTables]", TestConfigurations::Sonic,
+                   TestConfigurations::SketchedSonic, TestConfigurations::FilteredSonic,
                    TestConfigurations::BinaryHashJoin) {
   using Configuration = TestType;
   constexpr size_t Capacity = 8;
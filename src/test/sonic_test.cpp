@@ -3,7 +3,17 @@
 
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include "../../header/indices/sonic/sonic_adaptive_index.h"
+#include "../../header/indices/sonic/sonic_growable_index.h"
 #include "../../header/indices/sonic/sonic_index.h"
+#include "../../header/indices/sonic/sonic_numa_index.h"
+#include "../../header/indices/sonic/sonic_partitioned_index.h"
+#include "../../header/indices/sonic/sonic_probe.h"
+#include "../../header/indices/sonic/sonic_string.h"
 
 #endif
 
@@ -200,4 +210,1295 @@ TEST_CASE("VariableLengthKey", "[KeyLength]") {
 
   auto prefixLookup1 = sonic.template prefixLookup<string>(tuple<string>{"first"}).size();
   REQUIRE(prefixLookup1 == 2);
-}
\ No newline at end of file
+}
+
+TEST_CASE("InternedStringKeys", "[KeyLength]") {
+  SonicStringArena arena;
+  auto const shortKey = arena.intern("twelve chars");
+  auto const longKey = arena.intern("more than twelve characters");
+  REQUIRE(shortKey.isInline());
+  REQUIRE(!longKey.isInline());
+  REQUIRE(arena.view(shortKey) == "twelve chars");
+  REQUIRE(arena.view(longKey) == "more than twelve characters");
+  REQUIRE(arena.intern(string("more than twelve characters")) == longKey);
+  REQUIRE(arena.find("more than twelve characters") == longKey);
+  auto const unseen = arena.find("more than twelve characterz");
+  REQUIRE(unseen != arena.intern("more than twelve characterz"));
+  auto const cream = arena.intern("apple pie with cream");
+  REQUIRE(arena.compare(cream, arena.intern("apple pie with custard")) < 0);
+  REQUIRE(arena.compare(arena.intern("banana"), cream) > 0);
+  REQUIRE(arena.compare(longKey, longKey) == 0);
+
+  vector<tuple<string, string, string>> strings;
+  vector<tuple<SonicString, SonicString, SonicString>> interned;
+  for(auto i = 0; i < 3000; i++) {
+    strings.emplace_back("customer number " + to_string(i % 97), "c" + to_string(i % 13),
+                         "order " + to_string(i) + " of many orders");
+    auto const& row = strings.back();
+    interned.emplace_back(arena.intern(get<0>(row)), arena.intern(get<1>(row)),
+                          arena.intern(get<2>(row)));
+  }
+  SonicIndex<8192, 4, 0, string, string, string> stringIndex(strings);
+  SonicIndex<8192, 4, 0, SonicString, SonicString, SonicString> internedIndex(interned);
+  for(auto i = 0; i < 100; i++) {
+    auto const customer = "customer number " + to_string(i);
+    REQUIRE(internedIndex.countPrefix(tuple<SonicString>{arena.find(customer)}) ==
+            stringIndex.countPrefix(tuple<string>{customer}));
+    REQUIRE(internedIndex.countPrefix(make_tuple(arena.find(customer), arena.find("c3"))) ==
+            stringIndex.countPrefix(make_tuple(customer, string("c3"))));
+  }
+  for(auto i = 0; i < interned.size(); i += 7) {
+    REQUIRE(internedIndex.pointLookup(interned[i]) == 1);
+    auto const matches =
+        internedIndex.prefixLookup<SonicString>(tuple<SonicString>{get<0>(interned[i])});
+    REQUIRE(!matches.empty());
+    REQUIRE(arena.view(get<0>(matches.front().get())) == get<0>(strings[i]));
+  }
+  REQUIRE(internedIndex.memoryUsage() < stringIndex.memoryUsage());
+}
+
+TEST_CASE("GrowableIndex", "[Growable]") {
+  GrowableSonicIndex<8, 2, 0, int, int, int> sonic;
+  vector<tuple<int, int, int>> data;
+  auto sawMigration = false;
+
+  for(auto i = 1; i <= 2000; i++) {
+    data.emplace_back(tuple<int, int, int>{i % 37 + 1, i % 11 + 1, i});
+    sonic.insert(data.back());
+    sawMigration = sawMigration || sonic.isMigrating();
+
+    if(i % 250 == 0) {
+      REQUIRE(sonic.pointLookup(data[i / 2]) == 1);
+      REQUIRE(sonic.template countPrefix<int>(tuple<int>{1}) == i / 37);
+    }
+  }
+  REQUIRE(sawMigration);
+  REQUIRE(sonic.getSize() == 2000);
+  REQUIRE(sonic.getCapacity() >= 2000);
+  REQUIRE(sonic.scan().size() == 2000);
+
+  for(auto const& t : data) {
+    REQUIRE(sonic.pointLookup(t) == 1);
+  }
+  REQUIRE(sonic.pointLookup(tuple<int, int, int>{1, 1, 1}) == 0);
+
+  auto countPrefix1 = sonic.template countPrefix<int>(tuple<int>{5});
+  REQUIRE(countPrefix1 == 54);
+
+  auto countPrefix2 = sonic.template countPrefix<int, int>(tuple<int, int>{5, 5});
+  auto expected = count_if(data.begin(), data.end(), [](auto const& t) {
+    return get<0>(t) == 5 && get<1>(t) == 5;
+  });
+  REQUIRE(countPrefix2 == expected);
+
+  auto prefixLookup1 = sonic.template prefixLookup<int>(tuple<int>{5}).size();
+  REQUIRE(prefixLookup1 == 54);
+}
+
+TEST_CASE("BulkLoad", "[BulkLoad]") {
+  vector<tuple<int, int, int>> data;
+  for(auto i = 1; i <= 200; i++) {
+    data.emplace_back(tuple<int, int, int>{i % 13 + 1, i % 7 + 1, i});
+  }
+  SonicIndex<2048, 2, 0, int, int, int> sonic(data);
+  SonicIndex<2048, 2, 0, int, int, int> bulkLoaded;
+  bulkLoaded.bulkLoad(data, 4);
+
+  for(auto const& t : data) {
+    REQUIRE(bulkLoaded.pointLookup(t) == 1);
+  }
+  REQUIRE(bulkLoaded.pointLookup(tuple<int, int, int>{1, 1, 1}) == 0);
+  REQUIRE(bulkLoaded.scan().size() == data.size());
+
+  for(auto a = 1; a <= 14; a++) {
+    REQUIRE(bulkLoaded.template countPrefix<int>(tuple<int>{a}) ==
+            sonic.template countPrefix<int>(tuple<int>{a}));
+    REQUIRE(bulkLoaded.template prefixLookup<int>(tuple<int>{a}).size() ==
+            sonic.template prefixLookup<int>(tuple<int>{a}).size());
+    for(auto b = 1; b <= 8; b++) {
+      REQUIRE(bulkLoaded.template countPrefix<int, int>(tuple<int, int>{a, b}) ==
+              sonic.template countPrefix<int, int>(tuple<int, int>{a, b}));
+    }
+  }
+
+  // The directly laid out chains take inserts and erases like inserted ones.
+  bulkLoaded.insert(tuple<int, int, int>{1, 1, 1});
+  bulkLoaded.insert(tuple<int, int, int>{20, 1, 1});
+  REQUIRE(bulkLoaded.erase(data[0]) == 1);
+  REQUIRE(bulkLoaded.pointLookup(tuple<int, int, int>{1, 1, 1}) == 1);
+  REQUIRE(bulkLoaded.pointLookup(tuple<int, int, int>{20, 1, 1}) == 1);
+  REQUIRE(bulkLoaded.pointLookup(data[0]) == 0);
+  REQUIRE(bulkLoaded.getSize() == data.size() + 1);
+  REQUIRE(bulkLoaded.countPrefix(tuple<int>{1}) == sonic.countPrefix(tuple<int>{1}) + 1);
+
+  // Copies of a tuple share a leaf.
+  vector<tuple<int, int, int>> copies;
+  for(auto i = 0; i < 3000; i++) {
+    copies.emplace_back(i % 7 + 1, i % 5 + 1, i % 40 + 1);
+  }
+  MultisetSonicIndex<1024, 4, 0, int, int, int> multiset(copies);
+  MultisetSonicIndex<1024, 4, 0, int, int, int> bulkMultiset;
+  bulkMultiset.bulkLoad(copies, 3);
+  REQUIRE(bulkMultiset.getSize() == copies.size());
+  REQUIRE(bulkMultiset.scan().size() == 280);
+  for(auto a = 1; a <= 8; a++) {
+    for(auto b = 1; b <= 6; b++) {
+      REQUIRE(bulkMultiset.countPrefix(tuple<int, int>{a, b}) ==
+              multiset.countPrefix(tuple<int, int>{a, b}));
+    }
+  }
+
+  // The last column is no key, so it may hold the empty key.
+  vector<tuple<int, int, int>> payloads;
+  for(auto i = 1; i <= 50; i++) {
+    payloads.emplace_back(i % 6 + 1, i, i % 2 == 0 ? 0 : i);
+  }
+  SonicIndex<512, 2, 0, int, int, int> zeroPayloads;
+  zeroPayloads.bulkLoad(payloads, 2);
+  REQUIRE(zeroPayloads.getSize() == payloads.size());
+  for(auto const& t : payloads) {
+    REQUIRE(zeroPayloads.pointLookup(t) == 1);
+  }
+
+  // Each chain takes a bucket of its own, so 40 one-node chains outgrow the 32 buckets of level
+  // 1, and the rows are inserted instead.
+  vector<tuple<int, int, int>> spread;
+  for(auto i = 1; i <= 40; i++) {
+    spread.emplace_back(i, 1, 1);
+  }
+  SonicIndex<64, 2, 0, int, int, int> crowded;
+  crowded.bulkLoad(spread);
+  REQUIRE(crowded.getSize() == spread.size());
+  for(auto const& t : spread) {
+    REQUIRE(crowded.pointLookup(t) == 1);
+  }
+}
+
+TEST_CASE("PartitionedIndex", "[Partitioned]") {
+  vector<tuple<int, int, int>> data;
+  for(auto i = 1; i <= 500; i++) {
+    data.emplace_back(tuple<int, int, int>{i % 29 + 1, i % 5 + 1, i});
+  }
+  SonicIndex<4096, 2, 0, int, int, int> sonic(data);
+  PartitionedSonicIndex<4096, 2, 0, int, int, int> partitioned(data, 4);
+
+  REQUIRE(partitioned.getNumberOfPartitions() == 4);
+  REQUIRE(partitioned.getSize() == data.size());
+  REQUIRE(partitioned.scan().size() == data.size());
+
+  for(auto const& t : data) {
+    REQUIRE(partitioned.pointLookup(t) == 1);
+  }
+  REQUIRE(partitioned.pointLookup(tuple<int, int, int>{1, 1, 1}) == 0);
+
+  for(auto a = 1; a <= 30; a++) {
+    REQUIRE(partitioned.template countPrefix<int>(tuple<int>{a}) ==
+            sonic.template countPrefix<int>(tuple<int>{a}));
+    REQUIRE(partitioned.template prefixLookup<int>(tuple<int>{a}).size() ==
+            sonic.template prefixLookup<int>(tuple<int>{a}).size());
+    for(auto b = 1; b <= 6; b++) {
+      REQUIRE(partitioned.template countPrefix<int, int>(tuple<int, int>{a, b}) ==
+              sonic.template countPrefix<int, int>(tuple<int, int>{a, b}));
+    }
+  }
+}
+
+TEST_CASE("NumaIndex", "[Partitioned]") {
+  REQUIRE(parseCpuList("0-3,8,10-11\n") == vector<int>{0, 1, 2, 3, 8, 10, 11});
+  REQUIRE(!numaNodeCpus().empty());
+  REQUIRE(pinToNumaNode(0));
+
+  vector<tuple<int, int, int>> data;
+  for(auto i = 1; i <= 500; i++) {
+    data.emplace_back(tuple<int, int, int>{i % 29 + 1, i % 5 + 1, i});
+  }
+  SonicIndex<4096, 2, 0, int, int, int> sonic(data);
+  // More shards than this machine has nodes place several on the same node.
+  NumaSonicIndex<4096, 2, 0, int, int, int> numa(data, 3);
+
+  REQUIRE(numa.getNumberOfNodes() == 3);
+  REQUIRE(numa.getSize() == data.size());
+  REQUIRE(numa.scan().size() == data.size());
+  REQUIRE(numa.pointLookupBatch(data) == vector<size_t>(data.size(), 1));
+  REQUIRE(numa.pointLookup(tuple<int, int, int>{1, 1, 1}) == 0);
+
+  vector<tuple<int, int>> prefixes;
+  for(auto a = 1; a <= 30; a++) {
+    REQUIRE(numa.countPrefix(tuple<int>{a}) == sonic.countPrefix(tuple<int>{a}));
+    REQUIRE(numa.prefixLookup<int>(tuple<int>{a}).size() ==
+            sonic.prefixLookup<int>(tuple<int>{a}).size());
+    for(auto b = 1; b <= 6; b++) {
+      prefixes.emplace_back(a, b);
+    }
+  }
+  auto const counts = numa.countPrefixBatch(prefixes, 2);
+  for(auto i = 0; i < prefixes.size(); i++) {
+    REQUIRE(counts[i] == sonic.countPrefix(prefixes[i]));
+  }
+}
+
+TEST_CASE("ConcurrentReaders", "[Concurrent]") {
+  constexpr int keys = 37;
+  vector<tuple<int, int, int, int>> data;
+  vector<vector<int>> positionsOfKey(keys + 1);
+  for(auto i = 1; i <= 4000; i++) {
+    data.emplace_back(tuple<int, int, int, int>{i % keys + 1, i % 11 + 1, i % 5 + 1, i});
+    positionsOfKey[i % keys + 1].emplace_back(i);
+  }
+  SonicIndex<16384, 2, 0, int, int, int, int> sonic(data);
+  ConcurrentSonicIndex<16384, 2, 0, int, int, int, int> concurrent;
+
+  atomic<int> published(0);
+  atomic<size_t> lookups(0);
+  atomic<size_t> violations(0);
+
+  auto reader = [&](int seed) {
+    for(auto a = seed % keys + 1; published.load() < (int)data.size(); a = a % keys + 1) {
+      auto const visible = published.load(memory_order_acquire);
+      auto const& positions = positionsOfKey[a];
+      size_t const lowerBound = upper_bound(positions.begin(), positions.end(), visible) -
+                                positions.begin();
+
+      auto const count = concurrent.template countPrefix<int>(tuple<int>{a});
+      auto const tuples = concurrent.template prefixLookup<int>(tuple<int>{a});
+      if(count < lowerBound || count > positions.size()) {
+        violations++;
+      }
+      for(auto const& t : tuples) {
+        auto const row = get<3>(t.get());
+        if(get<0>(t.get()) != a || row < 1 || row > (int)data.size() || t.get() != data[row - 1]) {
+          violations++;
+        }
+      }
+      lookups++;
+    }
+  };
+
+  vector<thread> readers;
+  for(auto r = 0; r < 3; r++) {
+    readers.emplace_back(reader, r * 13);
+  }
+  for(auto const& t : data) {
+    concurrent.insert(t);
+    published.fetch_add(1, memory_order_release);
+  }
+  for(auto& r : readers) {
+    r.join();
+  }
+
+  REQUIRE(violations == 0);
+  REQUIRE(lookups > 0);
+  REQUIRE(concurrent.getSize() == data.size());
+  for(auto const& t : data) {
+    REQUIRE(concurrent.pointLookup(t) == sonic.pointLookup(t));
+  }
+  for(auto a = 1; a <= keys; a++) {
+    REQUIRE(concurrent.template countPrefix<int>(tuple<int>{a}) ==
+            sonic.template countPrefix<int>(tuple<int>{a}));
+    for(auto b = 1; b <= 11; b++) {
+      REQUIRE(concurrent.template prefixLookup<int, int>(tuple<int, int>{a, b}).size() ==
+              sonic.template prefixLookup<int, int>(tuple<int, int>{a, b}).size());
+    }
+  }
+}
+
+TEST_CASE("ProbeKernels", "[Probe]") {
+  vector<int> intKeys(probeGroupSize<int>());
+  vector<long> longKeys(probeGroupSize<long>());
+  for(auto round = 0; round < 64; round++) {
+    for(auto i = 0; i < intKeys.size(); i++) {
+      intKeys[i] = (i * 7 + round) % 5;
+    }
+    for(auto i = 0; i < longKeys.size(); i++) {
+      longKeys[i] = (i * 3 + round) % 4;
+    }
+    auto const expectedInt = probeGroupScalar<int>(intKeys.data(), round % 5, 0);
+    auto const expectedLong = probeGroupScalar<long>(longKeys.data(), round % 4, 0);
+
+    for(auto isa : {ProbeIsa::SSE42, ProbeIsa::AVX2, ProbeIsa::AVX512}) {
+      if(!supportsProbeIsa(isa)) {
+        continue;
+      }
+      auto const intMasks = probeKernel<int>(isa)(intKeys.data(), round % 5, 0);
+      auto const longMasks = probeKernel<long>(isa)(longKeys.data(), round % 4, 0);
+      REQUIRE(intMasks.matches == expectedInt.matches);
+      REQUIRE(intMasks.empties == expectedInt.empties);
+      REQUIRE(longMasks.matches == expectedLong.matches);
+      REQUIRE(longMasks.empties == expectedLong.empties);
+    }
+  }
+}
+
+TEST_CASE("NarrowSlotWords", "[Memory]") {
+  static_assert(is_same_v<SlotWord<1024>, uint32_t>);
+  static_assert(is_same_v<SlotWord<RuntimeCapacity>, size_t>);
+
+  SonicIndex<1024, 4, 0, int, int, int> narrow;
+  SonicIndex<RuntimeCapacity, 4, 0, int, int, int> wide(1024);
+  for(auto i = 0; i < 600; i++) {
+    narrow.insert(tuple<int, int, int>{i % 37 + 1, i % 11 + 1, i + 1});
+    wide.insert(tuple<int, int, int>{i % 37 + 1, i % 11 + 1, i + 1});
+  }
+
+  for(auto a = 1; a <= 37; a++) {
+    REQUIRE(narrow.template countPrefix<int>(tuple<int>{a}) ==
+            wide.template countPrefix<int>(tuple<int>{a}));
+    REQUIRE(narrow.template prefixLookup<int>(tuple<int>{a}).size() ==
+            wide.template prefixLookup<int>(tuple<int>{a}).size());
+  }
+  REQUIRE(narrow.memoryUsage() < wide.memoryUsage());
+}
+
+TEST_CASE("SparsePatchKeys", "[Memory]") {
+  SparsePatchKeys<string> patches(1000);
+  auto const emptyFootprint = patches.memoryUsage();
+
+  patches.set(3, "a");
+  patches.set(70, "b");
+  patches.set(71, "c");
+  REQUIRE(patches.get(3) == "a");
+  REQUIRE(patches.get(70) == "b");
+  REQUIRE(patches.get(71) == "c");
+  REQUIRE(patches.get(4) == "");
+  REQUIRE(patches.get(999) == "");
+  REQUIRE(patches.memoryUsage() < emptyFootprint + 1000 * sizeof(string));
+}
+
+TEST_CASE("PrefixCursor", "[Cursor]") {
+  vector<tuple<int, string, int, string>> data = {tuple<int, string, int, string>{1, "s", 2, "ss"},
+                                                  tuple<int, string, int, string>{1, "p", 3, "ss"},
+                                                  tuple<int, string, int, string>{1, "s", 6, "ss"},
+                                                  tuple<int, string, int, string>{1, "d", 5, "x"},
+                                                  tuple<int, string, int, string>{2, "f", 8, "q"},
+                                                  tuple<int, string, int, string>{2, "p", 8, "q"},
+                                                  tuple<int, string, int, string>{1, "s", 4, "q"}};
+  SonicIndex<14, 2, 0, int, string, int, string> sonic(data);
+
+  vector<tuple<int, string, int, string>> streamed;
+  for(auto cursor = sonic.prefixCursor(tuple<int>{1}); cursor.valid(); cursor.next()) {
+    REQUIRE(get<0>(*cursor) == 1);
+    streamed.emplace_back(*cursor);
+  }
+  auto const materialised = sonic.template prefixLookup<int>(tuple<int>{1});
+  REQUIRE(streamed.size() == 5);
+  REQUIRE(equal(streamed.begin(), streamed.end(), materialised.begin(), materialised.end(),
+                [](auto const& a, auto const& b) { return a == b.get(); }));
+
+  auto cursor = sonic.prefixCursor(tuple<int, string>{1, "s"});
+  auto matches = 0;
+  for(; cursor.valid(); cursor.next()) {
+    REQUIRE(get<1>(*cursor) == "s");
+    matches++;
+  }
+  REQUIRE(matches == 3);
+  REQUIRE(!sonic.prefixCursor(tuple<int, string>{2, "q"}).valid());
+}
+
+TEST_CASE("CountPrefixBatch", "[Batch]") {
+  vector<tuple<int, int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 97 + 1, i % 13 + 1, i % 7 + 1, i + 1);
+  }
+  SonicIndex<16384, 4, 0, int, int, int, int> sonic(data);
+  SonicIndex<4096, 4, 0, int, int> pairs;
+  for(auto i = 0; i < 1500; i++) {
+    pairs.insert(tuple<int, int>{i % 89 + 1, i + 1});
+  }
+
+  vector<tuple<int>> singles;
+  vector<tuple<int, int>> doubles;
+  vector<tuple<int, int, int>> triples;
+  for(auto i = 0; i < 500; i++) {
+    singles.emplace_back(i % 120 + 1);
+    doubles.emplace_back(i % 110 + 1, i % 15 + 1);
+    triples.emplace_back(i % 100 + 1, i % 14 + 1, i % 8 + 1);
+  }
+
+  auto const singleCounts = sonic.countPrefixBatch(singles);
+  auto const doubleCounts = sonic.countPrefixBatch(doubles);
+  auto const tripleCounts = sonic.countPrefixBatch(triples);
+  auto const pairCounts = pairs.countPrefixBatch(singles);
+  for(auto i = 0; i < 500; i++) {
+    REQUIRE(singleCounts[i] == sonic.template countPrefix<int>(singles[i]));
+    REQUIRE(doubleCounts[i] == sonic.template countPrefix<int, int>(doubles[i]));
+    REQUIRE(tripleCounts[i] == sonic.template countPrefix<int, int, int>(triples[i]));
+    REQUIRE(pairCounts[i] == pairs.template countPrefix<int>(singles[i]));
+  }
+}
+
+TEST_CASE("SaveAndLoad", "[Persistence]") {
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 97 + 1, i % 13 + 1, i + 1);
+  }
+  SonicIndex<8192, 4, 0, int, int, int> sonic(data);
+  SonicIndex<RuntimeCapacity, 4, 0, int, int, int> runtimeSonic(data, 8192);
+  auto const path = "sonic_test.idx";
+  auto const runtimePath = "sonic_test_runtime.idx";
+  REQUIRE(sonic.save(path));
+  REQUIRE(runtimeSonic.save(runtimePath));
+
+  SonicIndex<8192, 4, 0, int, int, int> loaded;
+  SonicIndex<RuntimeCapacity, 4, 0, int, int, int> runtimeLoaded(16);
+  REQUIRE(loaded.load(path));
+  REQUIRE(runtimeLoaded.load(runtimePath));
+  REQUIRE(loaded.getSize() == sonic.getSize());
+  REQUIRE(runtimeLoaded.getCapacity() == runtimeSonic.getCapacity());
+  for(auto i = 0; i < 120; i++) {
+    auto const point = tuple<int, int, int>{i % 97 + 1, i % 13 + 1, i + 1};
+    REQUIRE(loaded.pointLookup(point) == sonic.pointLookup(point));
+    REQUIRE(runtimeLoaded.pointLookup(point) == runtimeSonic.pointLookup(point));
+    REQUIRE(loaded.countPrefix(tuple<int>{i}) == sonic.countPrefix(tuple<int>{i}));
+    REQUIRE(loaded.countPrefix(tuple<int, int>{i, i % 13 + 1}) ==
+            sonic.countPrefix(tuple<int, int>{i, i % 13 + 1}));
+    REQUIRE(loaded.prefixLookup<int>(tuple<int>{i}).size() ==
+            sonic.prefixLookup<int>(tuple<int>{i}).size());
+  }
+
+  // Inserts into a loaded index stay private to it and leave the file untouched.
+  loaded.insert(tuple<int, int, int>{1000, 1, 1});
+  REQUIRE(loaded.pointLookup(tuple<int, int, int>{1000, 1, 1}) == 1);
+  SonicIndex<8192, 4, 0, int, int, int> reloaded;
+  REQUIRE(reloaded.load(path));
+  REQUIRE(reloaded.pointLookup(tuple<int, int, int>{1000, 1, 1}) == 0);
+  REQUIRE(reloaded.getSize() == sonic.getSize());
+
+  SonicIndex<4096, 4, 0, int, int, int> otherCapacity;
+  SonicIndex<8192, 4, 0, int, int, long> otherSchema;
+  REQUIRE(!otherCapacity.load(path));
+  REQUIRE(!otherSchema.load(path));
+  REQUIRE(!reloaded.load("sonic_test_missing.idx"));
+  REQUIRE(reloaded.getSize() == 0);
+  REQUIRE(reloaded.countPrefix(tuple<int>{1}) == 0);
+
+  {
+    ofstream truncated(runtimePath, ios::binary | ios::trunc);
+    truncated.write("SONICIDX", 8);
+  }
+  REQUIRE(!runtimeLoaded.load(runtimePath));
+  REQUIRE(runtimeLoaded.getSize() == 0);
+  REQUIRE(runtimeLoaded.getCapacity() == runtimeSonic.getCapacity());
+
+  remove(path);
+  remove(runtimePath);
+}
+
+TEST_CASE("Erase", "[Erase]") {
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 4000; i++) {
+    data.emplace_back(i % 97 + 1, i % 13 + 1, i % 500 + 1);
+  }
+  SonicIndex<16384, 4, 0, int, int, int> sonic(data);
+  SonicIndex<8192, 4, 0, int, int> pairs;
+  for(auto i = 0; i < 3000; i++) {
+    pairs.insert(tuple<int, int>{i % 89 + 1, i + 1});
+  }
+
+  multiset<tuple<int, int, int>> reference(data.begin(), data.end());
+  auto checkAgainstReference = [&]() {
+    REQUIRE(sonic.getSize() == reference.size());
+    REQUIRE(sonic.scan().size() == reference.size());
+    for(auto a = 1; a <= 98; a++) {
+      auto const first = reference.lower_bound({a, 0, 0});
+      auto const last = reference.lower_bound({a + 1, 0, 0});
+      REQUIRE(sonic.countPrefix(tuple<int>{a}) == distance(first, last));
+      REQUIRE(sonic.prefixLookup<int>(tuple<int>{a}).size() == distance(first, last));
+      for(auto b = 1; b <= 13; b += 4) {
+        REQUIRE(sonic.countPrefix(tuple<int, int>{a, b}) ==
+                distance(reference.lower_bound({a, b, 0}), reference.lower_bound({a, b + 1, 0})));
+      }
+    }
+    for(auto const& row : data) {
+      REQUIRE(sonic.pointLookup(row) == (reference.count(row) > 0));
+    }
+  };
+
+  for(auto i = 0; i < 4000; i += 3) {
+    REQUIRE(sonic.erase(data[i]) == 1);
+    reference.erase(reference.find(data[i]));
+  }
+  REQUIRE(sonic.erase(tuple<int, int, int>{1000, 1, 1}) == 0);
+  REQUIRE(sonic.tombstoneCount() > 0);
+  checkAgainstReference();
+
+  // Re-inserted tuples reuse the tombstones of their runs.
+  auto const tombstones = sonic.tombstoneCount();
+  for(auto i = 0; i < 4000; i += 6) {
+    sonic.insert(data[i]);
+    reference.insert(data[i]);
+  }
+  REQUIRE(sonic.tombstoneCount() < tombstones);
+  checkAgainstReference();
+
+  sonic.compact();
+  REQUIRE(sonic.tombstoneCount() == 0);
+  checkAgainstReference();
+
+  for(auto i = 0; i < 3000; i += 2) {
+    REQUIRE(pairs.erase(tuple<int, int>{i % 89 + 1, i + 1}) == 1);
+  }
+  REQUIRE(pairs.getSize() == 1500);
+  REQUIRE(pairs.scan().size() == 1500);
+  for(auto i = 0; i < 3000; i++) {
+    REQUIRE(pairs.pointLookup(tuple<int, int>{i % 89 + 1, i + 1}) == i % 2);
+  }
+
+  // Below level 0 the chains of a four-column index share buckets; erase finds every tuple.
+  vector<tuple<int, int, int, int>> quads;
+  for(auto i = 0; i < 3000; i++) {
+    quads.emplace_back(i % 71 + 1, i * 7 % 43 + 1, i * 13 % 29 + 1, i + 1);
+  }
+  SonicIndex<8192, 4, 0, int, int, int, int> inserted;
+  for(auto const& row : quads) {
+    inserted.insert(row);
+  }
+  SonicIndex<8192, 4, 0, int, int, int, int> loaded(quads);
+  for(auto i = 0; i < 3000; i += 2) {
+    REQUIRE(inserted.erase(quads[i]) == 1);
+    REQUIRE(loaded.erase(quads[i]) == 1);
+  }
+  REQUIRE(inserted.getSize() == 1500);
+  REQUIRE(loaded.getSize() == 1500);
+  for(auto i = 0; i < 3000; i++) {
+    REQUIRE(inserted.pointLookup(quads[i]) == i % 2);
+    REQUIRE(loaded.pointLookup(quads[i]) == i % 2);
+  }
+}
+
+TEST_CASE("GrowableCompaction", "[Erase]") {
+  GrowableSonicIndex<64, 4, 0, int, int, int> growable;
+  for(auto i = 0; i < 2000; i++) {
+    growable.insert(tuple<int, int, int>{i % 37 + 1, i % 11 + 1, i + 1});
+  }
+  while(growable.isMigrating()) {
+    growable.insert(tuple<int, int, int>{1, 1, 1});
+    REQUIRE(growable.erase(tuple<int, int, int>{1, 1, 1}) == 1);
+  }
+  auto const capacity = growable.getCapacity();
+
+  auto compacted = false;
+  for(auto i = 0; i < 2000; i += 2) {
+    REQUIRE(growable.erase(tuple<int, int, int>{i % 37 + 1, i % 11 + 1, i + 1}) == 1);
+    compacted |= growable.isMigrating();
+  }
+  REQUIRE(compacted);
+  REQUIRE(growable.getCapacity() == capacity);
+  REQUIRE(growable.getSize() == 1000);
+  REQUIRE(growable.scan().size() == 1000);
+  for(auto i = 0; i < 2000; i++) {
+    REQUIRE(growable.pointLookup(tuple<int, int, int>{i % 37 + 1, i % 11 + 1, i + 1}) == i % 2);
+  }
+  for(auto a = 1; a <= 37; a++) {
+    auto expected = 0;
+    for(auto i = 1; i < 2000; i += 2) {
+      expected += (i % 37 + 1 == a);
+    }
+    REQUIRE(growable.countPrefix(tuple<int>{a}) == expected);
+  }
+}
+
+TEST_CASE("MultisetIndex", "[Multiset]") {
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 6000; i++) {
+    data.emplace_back(i % 7 + 1, i % 5 + 1, i % 40 + 1);
+  }
+  SonicIndex<16384, 4, 0, int, int, int> sonic(data);
+  MultisetSonicIndex<16384, 4, 0, int, int, int> multiset(data);
+  // Only distinct tuples take slots, so a table far smaller than the row count suffices.
+  MultisetSonicIndex<1024, 4, 0, int, int, int> small(data);
+  MultisetSonicIndex<1024, 4, 0, int, int> pairs;
+  for(auto i = 0; i < 900; i++) {
+    pairs.insert(tuple<int, int>{i % 11 + 1, i % 30 + 1});
+  }
+
+  REQUIRE(multiset.getSize() == data.size());
+  REQUIRE(multiset.scan().size() == 280);
+  REQUIRE(small.memoryUsage() * 8 < sonic.memoryUsage());
+  for(auto a = 1; a <= 8; a++) {
+    REQUIRE(multiset.countPrefix(tuple<int>{a}) == sonic.countPrefix(tuple<int>{a}));
+    REQUIRE(small.countPrefix(tuple<int>{a}) == sonic.countPrefix(tuple<int>{a}));
+    for(auto b = 1; b <= 6; b++) {
+      REQUIRE(multiset.countPrefix(tuple<int, int>{a, b}) ==
+              sonic.countPrefix(tuple<int, int>{a, b}));
+      for(auto c = 1; c <= 41; c++) {
+        REQUIRE(multiset.countPrefix(tuple<int, int, int>{a, b, c}) ==
+                sonic.countPrefix(tuple<int, int, int>{a, b, c}));
+      }
+    }
+
+    auto const counted = multiset.prefixLookupWithMultiplicities(tuple<int>{a});
+    size_t copies = 0;
+    for(auto const& entry : counted) {
+      REQUIRE(get<0>(entry.first.get()) == a);
+      copies += entry.second;
+    }
+    REQUIRE(counted.size() == multiset.prefixLookup<int>(tuple<int>{a}).size());
+    REQUIRE(copies == sonic.countPrefix(tuple<int>{a}));
+  }
+  REQUIRE(pairs.scan().size() == 330);
+  REQUIRE(pairs.countPrefix(tuple<int, int>{1, 1}) == 3);
+  REQUIRE(pairs.prefixLookup<int>(tuple<int>{1}).size() == 30);
+
+  // Erasing drops one copy at a time; the slot only turns into a tombstone with the last one.
+  auto const row = data[0];
+  auto const copies = multiset.countPrefix(row);
+  for(auto i = 1; i < copies; i++) {
+    REQUIRE(multiset.erase(row) == 1);
+    REQUIRE(multiset.pointLookup(row) == 1);
+  }
+  REQUIRE(multiset.tombstoneCount() == 0);
+  REQUIRE(multiset.erase(row) == 1);
+  REQUIRE(multiset.pointLookup(row) == 0);
+  REQUIRE(multiset.erase(row) == 0);
+  REQUIRE(multiset.getSize() == data.size() - copies);
+  REQUIRE(multiset.countPrefix(tuple<int>{get<0>(row)}) ==
+          sonic.countPrefix(tuple<int>{get<0>(row)}) - copies);
+}
+
+TEST_CASE("MultisetCompaction", "[Multiset]") {
+  // Tuple t is inserted t times, 55 tuples in all.
+  MultisetSonicIndex<1024, 4, 0, int, int, int> multiset;
+  for(auto t = 1; t <= 10; t++) {
+    for(auto copy = 0; copy < t; copy++) {
+      multiset.insert(tuple<int, int, int>{t % 3 + 1, t, t * 7});
+    }
+  }
+  REQUIRE(multiset.getSize() == 55);
+  for(auto copy = 0; copy < 4; copy++) {
+    REQUIRE(multiset.erase(tuple<int, int, int>{2, 4, 28}) == 1);
+  }
+  REQUIRE(multiset.tombstoneCount() > 0);
+
+  auto const check = [&]() {
+    REQUIRE(multiset.getSize() == 51);
+    for(auto t = 1; t <= 10; t++) {
+      auto const row = tuple<int, int, int>{t % 3 + 1, t, t * 7};
+      REQUIRE(multiset.pointLookup(row) == (t != 4));
+      REQUIRE(multiset.countPrefix(row) == (t != 4 ? t : 0));
+      REQUIRE(multiset.countPrefix(tuple<int, int>{t % 3 + 1, t}) == (t != 4 ? t : 0));
+    }
+    REQUIRE(multiset.countPrefix(tuple<int>{1}) == 3 + 6 + 9);
+    REQUIRE(multiset.countPrefix(tuple<int>{2}) == 1 + 7 + 10);
+    REQUIRE(multiset.countPrefix(tuple<int>{3}) == 2 + 5 + 8);
+  };
+  check();
+  multiset.compact();
+  REQUIRE(multiset.tombstoneCount() == 0);
+  check();
+}
+
+TEST_CASE("HashPolicies", "[Hash]") {
+  vector<tuple<int, long>> rows;
+  for(auto i = 0; i < 1003; i++) {
+    rows.emplace_back(i * 7919 - 4000000, (long)i << 40 | i);
+  }
+  vector<size_t> batchInts(rows.size()), batchLongs(rows.size());
+  hashColumn<0, int, MultiplyShiftHash<int>>(rows, batchInts.data());
+  hashColumn<1, long, MultiplyShiftHash<long>>(rows, batchLongs.data());
+  for(auto i = 0; i < rows.size(); i++) {
+    REQUIRE(batchInts[i] == MultiplyShiftHash<int>()(get<0>(rows[i])));
+    REQUIRE(batchLongs[i] == MultiplyShiftHash<long>()(get<1>(rows[i])));
+  }
+
+  // The wider hashes fill the upper half of the word too.
+  REQUIRE(WordCRCHash<int>()(42) >> 32 != 0);
+  REQUIRE(WordCRCHash<string>()("a key longer than one word") >> 32 != 0);
+  REQUIRE(WordCRCHash<string>()("a key longer than one word") !=
+          WordCRCHash<string>()("a key longer than one wore"));
+
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 97 + 1, i % 13 + 1, i + 1);
+  }
+  SonicIndex<8192, 4, 0, int, int, int> sonic(data);
+  BasicSonicIndex<HashedSonicPolicy<MultiplyShiftHash>, 8192, 4, 0, int, int, int> multiplyShift;
+  BasicSonicIndex<HashedSonicPolicy<WordCRCHash>, 8192, 4, 0, int, int, int> wordCRC;
+  multiplyShift.bulkLoad(data);
+  wordCRC.bulkLoad(data);
+  for(auto i = 0; i < 120; i++) {
+    REQUIRE(multiplyShift.countPrefix(tuple<int>{i}) == sonic.countPrefix(tuple<int>{i}));
+    REQUIRE(wordCRC.countPrefix(tuple<int, int>{i, i % 13 + 1}) ==
+            sonic.countPrefix(tuple<int, int>{i, i % 13 + 1}));
+    REQUIRE(multiplyShift.pointLookup(data[i]) == 1);
+    REQUIRE(wordCRC.pointLookup(data[i]) == 1);
+  }
+
+  vector<tuple<string, string>> strings;
+  for(auto i = 0; i < 500; i++) {
+    strings.emplace_back("customer number " + to_string(i % 50), "order " + to_string(i));
+  }
+  BasicSonicIndex<HashedSonicPolicy<WordCRCHash>, 2048, 4, 0, string, string> stringIndex(strings);
+  REQUIRE(stringIndex.countPrefix(tuple<string>{"customer number 7"}) == 10);
+  REQUIRE(stringIndex.pointLookup(tuple<string, string>{"customer number 7", "order 57"}) == 1);
+}
+
+TEST_CASE("HugePagePolicy", "[Memory]") {
+  HugePageAllocator<int> allocator;
+  auto* slots = allocator.allocate(3);
+  REQUIRE((uintptr_t)slots % (size_t(1) << 21) == 0);
+  allocator.deallocate(slots, 3);
+
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 97 + 1, i % 13 + 1, i + 1);
+  }
+  SonicIndex<8192, 4, 0, int, int, int> sonic(data);
+  BasicSonicIndex<HugePageSonicPolicy<>, 8192, 4, 0, int, int, int> huge(data);
+  BasicSonicIndex<HugePageSonicPolicy<MultisetSonicPolicy>, RuntimeCapacity, 4, 0, int, int, int>
+      multiset(data, 5000);
+  // Gigabyte pages fall back to transparent ones when the hugetlbfs pool is empty.
+  BasicSonicIndex<HugePageSonicPolicy<DefaultSonicPolicy, size_t(1) << 30>, 8192, 4, 0, int, int,
+                  int>
+      gigabyte(data);
+  auto copy = huge;
+  for(auto i = 0; i < 120; i++) {
+    REQUIRE(huge.countPrefix(tuple<int>{i}) == sonic.countPrefix(tuple<int>{i}));
+    REQUIRE(multiset.countPrefix(tuple<int>{i}) == sonic.countPrefix(tuple<int>{i}));
+    REQUIRE(gigabyte.countPrefix(tuple<int, int>{i, i % 13 + 1}) ==
+            sonic.countPrefix(tuple<int, int>{i, i % 13 + 1}));
+    REQUIRE(huge.pointLookup(data[i]) == 1);
+    REQUIRE(copy.pointLookup(data[i]) == 1);
+  }
+  REQUIRE(huge.scan().size() == data.size());
+
+  auto const path = "sonic_huge_page_test.idx";
+  REQUIRE(huge.save(path));
+  BasicSonicIndex<HugePageSonicPolicy<>, 8192, 4, 0, int, int, int> loaded;
+  REQUIRE(loaded.load(path));
+  remove(path);
+  REQUIRE(loaded.countPrefix(tuple<int>{5}) == sonic.countPrefix(tuple<int>{5}));
+}
+
+TEST_CASE("CompressedLeaves", "[Memory]") {
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 97 + 1, -(i % 13 + 1), i % 5 == 0 ? i * 7919 + 1 : i + 1);
+  }
+  SonicIndex<8192, 4, 0, int, int, int> sonic(data);
+  BasicSonicIndex<CompressedLeafSonicPolicy<>, 8192, 4, 0, int, int, int> compressed(data);
+  REQUIRE(compressed.getSize() == data.size());
+  REQUIRE(compressed.memoryUsage() < sonic.memoryUsage());
+
+  auto sorted = [](auto const& tuples) {
+    vector<tuple<int, int, int>> result(tuples.begin(), tuples.end());
+    sort(result.begin(), result.end());
+    return result;
+  };
+  REQUIRE(sorted(compressed.scan()) == sorted(sonic.scan()));
+  for(auto i = 0; i < 120; i++) {
+    REQUIRE(compressed.countPrefix(tuple<int>{i}) == sonic.countPrefix(tuple<int>{i}));
+    REQUIRE(compressed.countPrefix(tuple<int, int>{i, -(i % 13 + 1)}) ==
+            sonic.countPrefix(tuple<int, int>{i, -(i % 13 + 1)}));
+    REQUIRE(sorted(compressed.prefixLookup<int>({i})) == sorted(sonic.prefixLookup<int>({i})));
+    REQUIRE(compressed.pointLookup(data[i]) == 1);
+    REQUIRE(compressed.pointLookup(tuple<int, int, int>{get<0>(data[i]), get<1>(data[i]), -1}) ==
+            0);
+  }
+
+  // Erased slots are reused by tuples that no longer fit the frame of their bucket.
+  for(auto i = 0; i < 3000; i += 3) {
+    REQUIRE(compressed.erase(data[i]) == 1);
+    REQUIRE(sonic.erase(data[i]) == 1);
+  }
+  for(auto i = 0; i < 3000; i += 6) {
+    auto const wide = tuple<int, int, int>{get<0>(data[i]), get<1>(data[i]), 2000000000 - i};
+    compressed.insert(wide);
+    sonic.insert(wide);
+  }
+  REQUIRE(sorted(compressed.scan()) == sorted(sonic.scan()));
+
+  // Columns whose distances need more than 64 bits spill their bucket.
+  vector<tuple<int64_t, int64_t, int64_t>> wide;
+  for(int64_t i = 1; i <= 2000; i++) {
+    wide.emplace_back(i % 50 + 1, i * 0x7fffffffffffll % 1000003 * 0x100000001ll, -i);
+  }
+  MultisetSonicIndex<4096, 4, 0, int64_t, int64_t, int64_t> multiset(wide);
+  BasicSonicIndex<CompressedLeafSonicPolicy<MultisetSonicPolicy>, 4096, 4, 0, int64_t, int64_t,
+                  int64_t>
+      compressedMultiset(wide);
+  multiset.insert(wide[7]);
+  compressedMultiset.insert(wide[7]);
+  for(auto i = 0; i < 60; i++) {
+    REQUIRE(compressedMultiset.countPrefix(tuple<int64_t>{i}) ==
+            multiset.countPrefix(tuple<int64_t>{i}));
+  }
+  REQUIRE(compressedMultiset.countPrefix(wide[7]) == 2);
+
+  auto const path = "sonic_compressed_test.idx";
+  REQUIRE(compressedMultiset.save(path));
+  BasicSonicIndex<CompressedLeafSonicPolicy<MultisetSonicPolicy>, 4096, 4, 0, int64_t, int64_t,
+                  int64_t>
+      loaded;
+  REQUIRE(loaded.load(path));
+  MultisetSonicIndex<4096, 4, 0, int64_t, int64_t, int64_t> uncompressed;
+  REQUIRE(!uncompressed.load(path));
+  remove(path);
+  for(auto const& input_tuple : wide) {
+    REQUIRE(loaded.countPrefix(input_tuple) == multiset.countPrefix(input_tuple));
+  }
+}
+
+TEST_CASE("ScanPartitioned", "[Scan]") {
+  typedef tuple<int, int, int> Row;
+  vector<Row> data;
+  for(auto i = 0; i < 40000; i++) {
+    data.emplace_back(i % 5003 + 1, i % 7 + 1, i + 1);
+  }
+  SonicIndex<RuntimeCapacity, 4, 0, int, int, int> sonic(data, size_t(1) << 19);
+  BasicSonicIndex<CompressedLeafSonicPolicy<>, RuntimeCapacity, 4, 0, int, int, int> compressed(
+      data, size_t(1) << 19);
+  for(auto i = 0; i < 40000; i += 3) {
+    sonic.erase(data[i]);
+    compressed.erase(data[i]);
+  }
+
+  // The buffers of the threads, in order, hold exactly what scan returns, in the same order.
+  auto concatenated = [](auto const& partitions) {
+    vector<Row> rows;
+    for(auto const& partition : partitions) {
+      rows.insert(rows.end(), partition.begin(), partition.end());
+    }
+    return rows;
+  };
+  auto const references = sonic.scan();
+  vector<Row> const scanned(references.begin(), references.end());
+  REQUIRE(scanned.size() == sonic.getSize());
+  for(auto threads : {1, 3, 8, 64}) {
+    auto const partitions = sonic.scanPartitioned(threads);
+    REQUIRE(partitions.size() == min(threads, 8));
+    REQUIRE(concatenated(partitions) == scanned);
+    REQUIRE(concatenated(compressed.scanPartitioned(threads)) == compressed.scan());
+  }
+
+  auto const doubled =
+      sonic.scanPartitioned<int>(4, [](Row const& row) { return 2 * get<2>(row); });
+  REQUIRE(doubled.size() == 4);
+  for(auto i = 0; i < 4; i++) {
+    auto const partition = sonic.scanPartitioned(4)[i];
+    REQUIRE(doubled[i].size() == partition.size());
+    for(auto j = 0; j < partition.size(); j++) {
+      REQUIRE(doubled[i][j] == 2 * get<2>(partition[j].get()));
+    }
+  }
+
+  // Small indexes are not worth a thread per partition.
+  SonicIndex<8192, 4, 0, int, int, int> small(vector<Row>(data.begin(), data.begin() + 3000));
+  REQUIRE(small.scanPartitioned(8).size() == 1);
+  REQUIRE(small.scanPartitioned(8)[0].size() == 3000);
+
+  // The occupancy of the buckets is saved with the slots.
+  auto const path = "sonic_test_scan.idx";
+  REQUIRE(sonic.save(path));
+  SonicIndex<RuntimeCapacity, 4, 0, int, int, int> loaded(16);
+  REQUIRE(loaded.load(path));
+  REQUIRE(concatenated(loaded.scanPartitioned(8)) == scanned);
+  remove(path);
+}
+
+TEST_CASE("LevelStats", "[Stats]") {
+  // Runs wrap around the end of the slots.
+  SonicLevelStats runs;
+  set<size_t> const used = {0, 1, 2, 3, 6, 14, 15};
+  countRuns(runs, 16, 4, [&](size_t slot) { return used.count(slot) > 0; });
+  REQUIRE(runs.usedSlots == 7);
+  REQUIRE(runs.buckets == 4);
+  REQUIRE(runs.fullBuckets == 1);
+  REQUIRE(runs.longestRun == 6);
+  REQUIRE(runs.runLengths == vector<size_t>{0, 1, 0, 1});
+  REQUIRE(runs.averageRunLength() == 3.5);
+
+  vector<tuple<int, int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 97 + 1, i % 13 + 1, i % 7 + 1, i + 1);
+  }
+  SonicIndex<16384, 4, 0, int, int, int, int> sonic(data);
+  size_t erased = 0;
+  for(auto i = 0; i < 300; i++) {
+    erased += sonic.erase(data[i]);
+  }
+  auto const levels = sonic.stats();
+  REQUIRE(levels.size() == 3);
+  REQUIRE(levels[0].column == 0);
+  REQUIRE(levels[2].leaf);
+  REQUIRE(levels[0].usedSlots == 97);
+  REQUIRE(levels[0].slots == 16384);
+  REQUIRE(levels[2].usedSlots == 3000);
+  REQUIRE(levels[2].deadSlots == erased);
+  REQUIRE(levels[1].deadSlots + levels[2].deadSlots == sonic.tombstoneCount());
+  size_t displaced = 0;
+  for(auto count : levels[0].displacements) {
+    displaced += count;
+  }
+  REQUIRE(displaced == levels[0].usedSlots);
+  REQUIRE(levels[0].overflowedSlots <= levels[0].usedSlots);
+  for(auto const& level : levels) {
+    REQUIRE(level.loadFactor() == level.usedSlots / (double)level.slots);
+    REQUIRE(level.longestRun <= level.usedSlots);
+  }
+  // Chains of 13 nodes below every key overflow their first bucket of 4.
+  REQUIRE(levels[1].patchedSlots > 0);
+  REQUIRE(levels[1].patchedBuckets >= levels[1].patchedSlots / 4);
+
+  BasicSonicIndex<CompressedLeafSonicPolicy<>, 8192, 4, 0, int, int, int> compressed;
+  compressed.insert(tuple<int, int, int>{1, 2, 3});
+  REQUIRE(compressed.stats()[1].usedSlots == 1);
+
+  if constexpr(sonicProbeStats) {
+    auto const before = sonic.stats()[0].probes;
+    sonic.pointLookup(data[500]);
+    auto const after = sonic.stats();
+    REQUIRE(after[0].probes == before + 1);
+    REQUIRE(after[0].longestProbe >= 1);
+    REQUIRE(after[2].averageProbeLength() >= 1);
+  }
+}
+
+TEST_CASE("PrefixRange", "[Range]") {
+  vector<int> intKeys(probeGroupSize<int>());
+  vector<unsigned long> longKeys(probeGroupSize<unsigned long>());
+  for(auto round = 0; round < 64; round++) {
+    for(auto i = 0; i < intKeys.size(); i++) {
+      intKeys[i] = (i * 7 + round) % 9 - 4;
+    }
+    for(auto i = 0; i < longKeys.size(); i++) {
+      longKeys[i] = (i * 3 + round) % 4 == 0 ? ~0ul - i : i;
+    }
+    auto const expectedInt = rangeGroupScalar<int>(intKeys.data(), -2, round % 5, 0);
+    auto const expectedLong = rangeGroupScalar<unsigned long>(longKeys.data(), 2, ~0ul - 3, 0);
+
+    for(auto isa : {ProbeIsa::SSE42, ProbeIsa::AVX2, ProbeIsa::AVX512}) {
+      if(!supportsProbeIsa(isa)) {
+        continue;
+      }
+      auto const intMasks = rangeKernel<int>(isa)(intKeys.data(), -2, round % 5, 0);
+      auto const longMasks = rangeKernel<unsigned long>(isa)(longKeys.data(), 2, ~0ul - 3, 0);
+      REQUIRE(intMasks.matches == expectedInt.matches);
+      REQUIRE(intMasks.empties == expectedInt.empties);
+      REQUIRE(longMasks.matches == expectedLong.matches);
+      REQUIRE(longMasks.empties == expectedLong.empties);
+    }
+  }
+
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 6000; i++) {
+    auto const b = i % 40 - 20;
+    data.emplace_back(i % 7 + 1, b >= 0 ? b + 1 : b, i % 13 + 1);
+  }
+  SonicIndex<16384, 4, 0, int, int, int> sonic(data);
+  MultisetSonicIndex<4096, 4, 0, int, int, int> counted(data);
+  BasicSonicIndex<CompressedLeafSonicPolicy<>, 16384, 4, 0, int, int, int> compressed(data);
+  auto const expected = [&](int a, int const* b, int low, int high) {
+    multiset<tuple<int, int, int>> matches;
+    for(auto const& row : data) {
+      auto const value = b ? get<2>(row) : get<1>(row);
+      if(get<0>(row) == a && (!b || get<1>(row) == *b) && value >= low && value <= high) {
+        matches.insert(row);
+      }
+    }
+    return matches;
+  };
+
+  for(auto a = 1; a <= 8; a++) {
+    for(auto [low, high] : {pair{-20, 20}, pair{-3, 4}, pair{5, 5}, pair{7, 2}, pair{21, 30}}) {
+      // The range is on the leaf key.
+      auto const matches = expected(a, nullptr, low, high);
+      auto const found = sonic.prefixRangeLookup(tuple<int>{a}, low, high);
+      REQUIRE(multiset<tuple<int, int, int>>(found.begin(), found.end()) == matches);
+      REQUIRE(sonic.prefixRangeCount(tuple<int>{a}, low, high) == matches.size());
+      REQUIRE(counted.prefixRangeCount(tuple<int>{a}, low, high) == matches.size());
+      auto const distinct = set<tuple<int, int, int>>(matches.begin(), matches.end());
+      REQUIRE(counted.prefixRangeLookup(tuple<int>{a}, low, high).size() == distinct.size());
+      auto const decoded = compressed.prefixRangeLookup(tuple<int>{a}, low, high);
+      REQUIRE(multiset<tuple<int, int, int>>(decoded.begin(), decoded.end()) == matches);
+
+      // The range is on the last column, below the leaf key.
+      auto const b = low;
+      auto const below = expected(a, &b, 3, 9);
+      auto const last = sonic.prefixRangeLookup(tuple<int, int>{a, b}, 3, 9);
+      REQUIRE(multiset<tuple<int, int, int>>(last.begin(), last.end()) == below);
+      REQUIRE(compressed.prefixRangeCount(tuple<int, int>{a, b}, 3, 9) == below.size());
+    }
+  }
+
+  // The range is on a node level, whose matching nodes hand over their subtrees.
+  vector<tuple<int, int, int, int>> wide;
+  for(auto i = 0; i < 3000; i++) {
+    wide.emplace_back(i % 11 + 1, i % 17 + 1, i % 5 + 1, i + 1);
+  }
+  SonicIndex<16384, 4, 0, int, int, int, int> deep(wide);
+  for(auto a = 1; a <= 12; a++) {
+    for(auto [low, high] : {pair{1, 17}, pair{4, 9}, pair{9, 9}, pair{18, 20}}) {
+      set<tuple<int, int, int, int>> filtered;
+      for(auto const& row : deep.template prefixLookup<int>(tuple<int>{a})) {
+        if(get<1>(row.get()) >= low && get<1>(row.get()) <= high) {
+          filtered.insert(row);
+        }
+      }
+      auto const found = deep.prefixRangeLookup(tuple<int>{a}, low, high);
+      REQUIRE(set<tuple<int, int, int, int>>(found.begin(), found.end()) == filtered);
+      size_t count = 0;
+      for(auto b = low; b <= high; b++) {
+        count += deep.countPrefix(tuple<int, int>{a, b});
+      }
+      REQUIRE(deep.prefixRangeCount(tuple<int>{a}, low, high) == count);
+    }
+  }
+}
+
+TEST_CASE("PrefixSketches", "[Sketch]") {
+  REQUIRE(sketchEstimate(0) == 0);
+  for(auto keys : {1, 10, 100, 1000}) {
+    SonicSketch sketch = 0;
+    for(auto round = 0; round < 2; round++) {
+      for(auto i = 0; i < keys; i++) {
+        sketch = addToSketch(sketch, CRCHash<int>()(i));
+      }
+    }
+    REQUIRE(sketchEstimate(sketch) == Approx(keys).epsilon(0.5));
+  }
+
+  // Prefix a has a distinct second columns, each with three tuples.
+  vector<tuple<int, int, int>> data;
+  for(auto a : {1, 4, 40, 400, 2000}) {
+    for(auto b = 1; b <= a; b++) {
+      for(auto c = 1; c <= 3; c++) {
+        data.emplace_back(a, b, c);
+      }
+    }
+  }
+  SonicIndex<16384, 4, 0, int, int, int> exact(data);
+  SketchedSonicIndex<16384, 4, 0, int, int, int> sketched(data);
+  REQUIRE(sketched.memoryUsage() > exact.memoryUsage());
+  for(auto a : {1, 4, 40, 400, 2000}) {
+    REQUIRE(sketched.estimatePrefix(tuple<int>{a}) == a * 3);
+    REQUIRE(sketched.estimateDistinct(tuple<int>{a}) == Approx(a).epsilon(0.5));
+    for(auto b : {1, a / 2 + 1, a}) {
+      REQUIRE(sketched.estimatePrefix(tuple<int, int>{a, b}) == Approx(3).epsilon(0.5));
+      REQUIRE(sketched.estimatePrefix(tuple<int, int, int>{a, b, 2}) == 1);
+      REQUIRE(exact.estimatePrefix(tuple<int, int>{a, b}) ==
+              exact.countPrefix(tuple<int, int>{a, b}));
+    }
+    REQUIRE(sketched.estimatePrefix(tuple<int, int>{a + 1, 1}) == 0);
+  }
+  REQUIRE(sketched.estimateDistinct(tuple<int>{3}) == 0);
+
+  auto const path = "sonic_sketch_test.idx";
+  REQUIRE(sketched.save(path));
+  SketchedSonicIndex<16384, 4, 0, int, int, int> loaded;
+  REQUIRE(loaded.load(path));
+  SonicIndex<16384, 4, 0, int, int, int> unsketched;
+  REQUIRE(!unsketched.load(path));
+  remove(path);
+  for(auto a : {1, 4, 40, 400, 2000}) {
+    REQUIRE(loaded.estimatePrefix(tuple<int, int>{a, 1}) ==
+            sketched.estimatePrefix(tuple<int, int>{a, 1}));
+  }
+}
+
+TEST_CASE("PrefixFilters", "[Filter]") {
+  auto const hashOf = [](int key) {
+    return prefixFilterHash<DefaultSonicPolicy, tuple<int>>(tuple{key}, make_index_sequence<1>());
+  };
+  SonicPrefixFilter<DefaultSonicPolicy> filter(8192);
+  for(auto key = 0; key < 1000; key++) {
+    filter.add(hashOf(key));
+  }
+  size_t falsePositives = 0;
+  for(auto key = 0; key < 11000; key++) {
+    if(key < 1000) {
+      REQUIRE(filter.mayContain(hashOf(key)));
+    } else {
+      falsePositives += filter.mayContain(hashOf(key));
+    }
+  }
+  REQUIRE(falsePositives < 100);
+
+  vector<tuple<int, int, int>> data;
+  for(auto i = 0; i < 3000; i++) {
+    data.emplace_back(i % 50 * 2 + 1, i % 70 * 3 + 1, i + 1);
+  }
+  SonicIndex<8192, 4, 0, int, int, int> sonic(data);
+  FilteredSonicIndex<8192, 4, 0, int, int, int> filtered(data);
+  REQUIRE(filtered.memoryUsage() > sonic.memoryUsage());
+  vector<tuple<int, int>> prefixes;
+  for(auto a = 1; a < 110; a++) {
+    REQUIRE(filtered.countPrefix(tuple<int>{a}) == sonic.countPrefix(tuple<int>{a}));
+    REQUIRE(filtered.template prefixLookup<int>(tuple<int>{a}).size() ==
+            sonic.template prefixLookup<int>(tuple<int>{a}).size());
+    REQUIRE(filtered.prefixRangeCount(tuple<int>{a}, 10, 100) ==
+            sonic.prefixRangeCount(tuple<int>{a}, 10, 100));
+    for(auto b = 1; b < 220; b += 7) {
+      prefixes.emplace_back(a, b);
+      REQUIRE(filtered.countPrefix(tuple<int, int>{a, b}) ==
+              sonic.countPrefix(tuple<int, int>{a, b}));
+    }
+  }
+  REQUIRE(filtered.countPrefixBatch(prefixes) == sonic.countPrefixBatch(prefixes));
+  for(auto i = 0; i < 4000; i += 3) {
+    auto const row = tuple<int, int, int>{i % 50 * 2 + 1, i % 70 * 3 + 1, i + 1};
+    REQUIRE(filtered.pointLookup(row) == sonic.pointLookup(row));
+  }
+
+  auto const stats = filtered.filterStats();
+  REQUIRE(stats.size() == 2);
+  REQUIRE(stats[0].prefixLength == 2);
+  REQUIRE(sonic.filterStats().empty());
+  for(auto const& length : stats) {
+    REQUIRE(length.fillRatio > 0);
+    REQUIRE(length.fillRatio < 0.5);
+    if constexpr(sonicProbeStats) {
+      REQUIRE(length.rejections > 0);
+      REQUIRE(length.rejections < length.probes);
+    }
+  }
+
+  // Erased prefixes keep passing the filter, but are still found missing.
+  REQUIRE(filtered.erase(data[0]) == 1);
+  REQUIRE(filtered.pointLookup(data[0]) == 0);
+  REQUIRE(filtered.countPrefix(data[0]) == 0);
+
+  auto const path = "sonic_filter_test.idx";
+  REQUIRE(filtered.save(path));
+  FilteredSonicIndex<8192, 4, 0, int, int, int> loaded;
+  REQUIRE(loaded.load(path));
+  REQUIRE(!sonic.load(path));
+  remove(path);
+  for(auto a = 1; a < 110; a++) {
+    REQUIRE(loaded.countPrefix(tuple<int>{a}) == filtered.countPrefix(tuple<int>{a}));
+  }
+
+  vector<tuple<int, int>> pairs;
+  for(auto i = 0; i < 500; i++) {
+    pairs.emplace_back(i % 40 + 1, i + 1);
+  }
+  BasicSonicIndex<FilteredSonicPolicy<ConcurrentSonicPolicy>, 2048, 4, 0, int, int> concurrent(
+      pairs);
+  for(auto i = 0; i < 600; i++) {
+    REQUIRE(concurrent.countPrefix(tuple<int, int>{i % 40 + 1, i + 1}) == (i < 500));
+  }
+}
+
+TEST_CASE("AdaptiveBucketSize", "[Adaptive]") {
+  // Leaf chains hold every tuple of a first-column key, so the fan-out sets the bucket width.
+  auto const tableWithFanOut = [](size_t fanOut) {
+    vector<tuple<int, int, int>> data;
+    for(auto i = 0; i < 2400; i++) {
+      data.emplace_back(i / fanOut + 1, i % 7 + 1, i + 1);
+    }
+    return data;
+  };
+  REQUIRE(AdaptiveSonicIndex<64, 4, 0, int, int, int>(tableWithFanOut(1)).bucketSize() == 2);
+  REQUIRE(AdaptiveSonicIndex<64, 4, 0, int, int, int>(tableWithFanOut(3)).bucketSize() == 4);
+  REQUIRE(AdaptiveSonicIndex<64, 4, 0, int, int, int>(tableWithFanOut(6)).bucketSize() == 8);
+
+  auto const data = tableWithFanOut(12);
+  AdaptiveSonicIndex<64, 4, 0, int, int, int> adaptive(data);
+  SonicIndex<65536, 16, 0, int, int, int> sonic(data);
+  REQUIRE(adaptive.bucketSize() == 16);
+  REQUIRE(adaptive.shape().firstLevelKeys == 200);
+  REQUIRE(adaptive.shape().levels.size() == 1);
+  REQUIRE(adaptive.shape().levels[0].fanOut() == 12);
+  REQUIRE(adaptive.getCapacity() < sonic.getCapacity());
+  REQUIRE(adaptive.getSize() == data.size());
+
+  vector<tuple<int>> prefixes;
+  for(auto a = 1; a < 210; a++) {
+    prefixes.emplace_back(a);
+    REQUIRE(adaptive.countPrefix(tuple<int>{a}) == sonic.countPrefix(tuple<int>{a}));
+    REQUIRE(adaptive.template prefixLookup<int>(tuple<int>{a}).size() ==
+            sonic.template prefixLookup<int>(tuple<int>{a}).size());
+    size_t cursorTuples = 0;
+    for(auto cursor = adaptive.prefixCursor(tuple<int>{a}); cursor.valid(); cursor.next()) {
+      REQUIRE(get<0>(*cursor) == a);
+      cursorTuples++;
+    }
+    REQUIRE(cursorTuples == sonic.countPrefix(tuple<int>{a}));
+  }
+  REQUIRE(adaptive.countPrefixBatch(prefixes) == sonic.countPrefixBatch(prefixes));
+  for(auto const& row : data) {
+    REQUIRE(adaptive.pointLookup(row) == 1);
+  }
+  REQUIRE(adaptive.scan().size() == data.size());
+  REQUIRE(adaptive.scanPartitioned(2)[0].size() == data.size());
+  REQUIRE(adaptive.stats().size() == 2);
+
+  REQUIRE(adaptive.erase(data[0]) == 1);
+  REQUIRE(adaptive.pointLookup(data[0]) == 0);
+  adaptive.insert(data[0]);
+  REQUIRE(adaptive.pointLookup(data[0]) == 1);
+
+  // An empty index keeps its template width until bulkLoad samples its input.
+  AdaptiveSonicIndex<4096, 4, 0, int, int, int> loaded;
+  REQUIRE(loaded.bucketSize() == 4);
+  REQUIRE(loaded.getCapacity() == 4096);
+  loaded.bulkLoad(data);
+  REQUIRE(loaded.bucketSize() == 16);
+  REQUIRE(loaded.getSize() == data.size());
+  REQUIRE(loaded.countPrefix(tuple<int>{5}) == 12);
+
+  // Two columns leave the first level as the leaf, which holds every tuple.
+  vector<tuple<int, int>> pairs;
+  for(auto i = 0; i < 1000; i++) {
+    pairs.emplace_back(i % 10 + 1, i + 1);
+  }
+  AdaptiveSonicIndex<64, 8, 0, int, int> twoColumns(pairs);
+  REQUIRE(twoColumns.shape().firstLevelKeys == pairs.size());
+  REQUIRE(twoColumns.shape().levels.empty());
+  REQUIRE(twoColumns.getCapacity() >= 2 * pairs.size());
+  REQUIRE(twoColumns.countPrefix(tuple<int>{3}) == 100);
+
+  // Large inputs are sampled by first-column key and the counts scaled back up.
+  vector<tuple<int, int, int>> large;
+  for(auto i = 0; i < 400000; i++) {
+    large.emplace_back(i / 4 + 1, i % 3 + 1, i + 1);
+  }
+  auto const shape = AdaptiveSonicIndex<64, 4, 0, int, int, int>::estimateShape(large);
+  REQUIRE(shape.rows == large.size());
+  REQUIRE(shape.firstLevelKeys > 90000);
+  REQUIRE(shape.firstLevelKeys < 110000);
+  REQUIRE(shape.levels[0].fanOut() == 4);
+  REQUIRE(shape.overflow(0) > 0);
+  REQUIRE(shape.overflow(1) == 0);
+
+  // A key holding half the rows may fall outside the sample; the plan still has a slot per row.
+  vector<tuple<int, int, int>> skewed;
+  for(auto heavy = -1; skewed.empty(); heavy--) {
+    for(auto i = 0; i < 150000; i++) {
+      skewed.emplace_back(i % 2 ? heavy : i + 1, i % 5 + 1, i + 1);
+    }
+    if(AdaptiveSonicIndex<64, 4, 0, int, int, int>::estimateShape(skewed).levels[0].entries >=
+       skewed.size()) {
+      skewed.clear();
+    }
+  }
+  AdaptiveSonicIndex<64, 4, 0, int, int, int> skewedInserted(skewed);
+  AdaptiveSonicIndex<64, 4, 0, int, int, int> skewedLoaded;
+  skewedLoaded.bulkLoad(skewed);
+  REQUIRE(skewedInserted.getCapacity() > skewed.size());
+  REQUIRE(skewedInserted.getSize() == skewed.size());
+  REQUIRE(skewedLoaded.getSize() == skewed.size());
+  REQUIRE(skewedLoaded.countPrefix(tuple<int>{get<0>(skewed[1])}) == skewed.size() / 2);
+  for(auto i = 0; i < skewed.size(); i += 97) {
+    REQUIRE(skewedInserted.pointLookup(skewed[i]) == 1);
+    REQUIRE(skewedLoaded.pointLookup(skewed[i]) == 1);
+  }
+
+  // Inserts past the headroom plan the index again instead of filling it.
+  auto const capacity = adaptive.getCapacity();
+  for(auto i = 0; i < 3 * data.size(); i++) {
+    adaptive.insert(tuple<int, int, int>{i / 12 + 1000, i % 7 + 1, i + 1});
+  }
+  REQUIRE(adaptive.getCapacity() > capacity);
+  REQUIRE(adaptive.getSize() == 4 * data.size());
+  REQUIRE(adaptive.countPrefix(tuple<int>{1000}) == 12);
+  for(auto const& row : data) {
+    REQUIRE(adaptive.pointLookup(row) == 1);
+  }
+  AdaptiveSonicIndex<64, 4, 0, int, int, int> grown;
+  for(auto i = 0; i < 1000; i++) {
+    grown.insert(tuple<int, int, int>{i % 10 + 1, i % 3 + 1, i + 1});
+  }
+  REQUIRE(grown.getSize() == 1000);
+  REQUIRE(grown.scan().size() == 1000);
+  REQUIRE(grown.countPrefix(tuple<int, int>{1, 1}) == 34);
+}